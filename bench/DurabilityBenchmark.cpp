@@ -0,0 +1,141 @@
+//Загрузок в секунду при разных режимах долговечности: несколько потоков одновременно сохраняют через FileSaver
+//небольшие файлы в каталог на проверяемом диске, ответ каждой загрузки ждёт сброса её файла на диск.
+//Запись идёт через дисковые потоки DiskWriteStage, как в сервере.
+//Запуск: DurabilityBenchmark [каталог] [потоков] [загрузок на поток] [размер файла в КБ] [окно GroupCommit в мкс]
+
+#include "FileSaver.h"
+#include "DurabilityCommitter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+const std::string boundary = "----BenchmarkBoundary7MA4YWxkTrZu0gW";
+
+std::string uploadBody(const std::string& filename, size_t size)
+{
+    return "--" + boundary + "\r\n"
+           "Content-Disposition: form-data; name=\"file\"; filename=\"" + filename + "\"\r\n"
+           "Content-Type: application/octet-stream\r\n"
+           "\r\n" + std::string(size, 'd') + "\r\n"
+           "--" + boundary + "--\r\n";
+}
+
+struct Result
+{
+    double seconds;
+    uint64_t uploads;
+    uint64_t failed;
+    std::vector<double> latenciesUs;
+};
+
+Result run(DurabilityCommitter::Mode mode, const std::string& dir, size_t threads, size_t uploads, size_t fileSize,
+           std::chrono::microseconds window)
+{
+    auto stage = std::make_shared<DiskWriteStage>(2, 1024, 256 * 1024);
+    auto committer = std::make_shared<DurabilityCommitter>(mode, window, 256);
+
+    std::atomic<uint64_t> failed(0);
+    std::vector<std::vector<double>> latencies(threads);
+    std::vector<std::thread> workers;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for(size_t t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]()
+                             {
+                                 FileSaver fileSaver;
+                                 fileSaver.setDir(dir);
+                                 fileSaver.setWriterBackend(FileWriter::Pwritev);
+                                 fileSaver.setDiskWriteStage(stage, 1024 * 1024);
+                                 fileSaver.setDurability(committer);
+
+                                 for(size_t i = 0; i < uploads; i++)
+                                 {
+                                     //Имена повторяются, чтобы каталог не разрастался
+                                     std::string body = uploadBody("durability-" + std::to_string(t) + "-" + std::to_string(i % 16) + ".bin", fileSize);
+
+                                     SimpleWeb::CaseInsensitiveMultimap headers;
+                                     headers.emplace("Content-Type", "multipart/form-data; boundary=" + boundary);
+                                     headers.emplace("Content-Length", std::to_string(body.size()));
+
+                                     auto uploadStart = std::chrono::steady_clock::now();
+
+                                     fileSaver.setRequestHeader(headers);
+                                     fileSaver.processChunk(body.data(), body.size());
+                                     std::string result = fileSaver.finishStream();
+
+                                     latencies[t].push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - uploadStart).count());
+
+                                     if(result.find("\"status\":\"success\"") == std::string::npos)
+                                     {
+                                         failed++;
+                                     }
+                                 }
+                             });
+    }
+
+    for(std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    Result result;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.uploads = threads * uploads;
+    result.failed = failed;
+
+    for(auto& threadLatencies : latencies)
+    {
+        result.latenciesUs.insert(result.latenciesUs.end(), threadLatencies.begin(), threadLatencies.end());
+    }
+
+    std::sort(result.latenciesUs.begin(), result.latenciesUs.end());
+
+    for(size_t t = 0; t < threads; t++)
+    {
+        for(size_t i = 0; i < 16; i++)
+        {
+            std::remove((dir + "/durability-" + std::to_string(t) + "-" + std::to_string(i) + ".bin").c_str());
+        }
+    }
+
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string dir = argc > 1 ? argv[1] : "/tmp";
+    size_t threads = argc > 2 ? std::stoul(argv[2]) : 16;
+    size_t uploads = argc > 3 ? std::stoul(argv[3]) : 200;
+    size_t fileSize = (argc > 4 ? std::stoul(argv[4]) : 64) * 1024;
+    std::chrono::microseconds window(argc > 5 ? std::stoul(argv[5]) : 200);
+
+    std::printf("%zu threads x %zu uploads of %zu KB into %s, group commit window %lld us\n", threads, uploads, fileSize / 1024, dir.c_str(),
+                static_cast<long long>(window.count()));
+    std::printf("%-20s %12s %12s %12s %8s\n", "mode", "uploads/s", "p50 us", "p99 us", "failed");
+
+    for(DurabilityCommitter::Mode mode : {DurabilityCommitter::None, DurabilityCommitter::PerFile, DurabilityCommitter::GroupCommit})
+    {
+        Result result = run(mode, dir, threads, uploads, fileSize, window);
+
+        auto percentile = [&result](double p)
+                          {
+                              return result.latenciesUs.empty() ? 0.0 : result.latenciesUs[std::min(result.latenciesUs.size() - 1,
+                                                                                                   static_cast<size_t>(p * result.latenciesUs.size()))];
+                          };
+
+        std::printf("%-20s %12.0f %12.0f %12.0f %8llu\n", DurabilityCommitter::modeName(mode).c_str(),
+                    result.uploads / result.seconds, percentile(0.5), percentile(0.99),
+                    static_cast<unsigned long long>(result.failed));
+    }
+
+    return 0;
+}
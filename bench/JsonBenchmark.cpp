@@ -0,0 +1,223 @@
+//Сериализация JSON ответов: дерево nlohmann::json + dump() + operator<< против JsonResponse,
+//который пишет тело прямо в буфер ответа. Ответ выводится в поток, который только считает байты.
+//Запуск: JsonBenchmark [ответов на сценарий]
+
+#include "JsonResponse.h"
+
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+
+//Подсчёт выделений памяти
+static std::atomic<uint64_t> allocationCount(0);
+
+void* operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+    if(void* pointer = std::malloc(size ? size : 1))
+    {
+        return pointer;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t /*size*/) noexcept
+{
+    std::free(pointer);
+}
+
+
+//Поток, который отбрасывает данные, как сокет без задержек
+class NullBuffer : public std::streambuf
+{
+public:
+    uint64_t bytes = 0;
+
+protected:
+    std::streamsize xsputn(const char* /*data*/, std::streamsize count) override
+    {
+        bytes += count;
+        return count;
+    }
+
+    int overflow(int c) override
+    {
+        bytes++;
+        return c;
+    }
+};
+
+
+struct File
+{
+    std::string name;
+    uint64_t size;
+    std::string digest;
+};
+
+//Ответ /upload так, как он строился раньше: описание каждого файла - отдельный json, затем dump() и operator<<
+static void nlohmannUpload(std::ostream& out, const std::vector<File>& files)
+{
+    json uploadedFiles = json::array();
+
+    for(const File& file : files)
+    {
+        json descriptionFile = {
+                                   {"filename", file.name},
+                                   {"size", file.size},
+                                   {"xxh64", file.digest}
+                               };
+
+        uploadedFiles.push_back(descriptionFile);
+    }
+
+    json result = {
+                      {"status", "success"},
+                      {"uploadedFiles", uploadedFiles}
+                  };
+
+    std::string content = result.dump();
+
+    out << "HTTP/1.1 " << SimpleWeb::status_code(SimpleWeb::StatusCode::success_ok) << "\r\n"
+        << "Content-Type: application/json\r\n"
+        << "Content-Length: " << content.length() << "\r\n"
+        << "\r\n" << content;
+}
+
+static void writerUpload(std::ostream& out, const std::vector<File>& files)
+{
+    JsonResponse result(SimpleWeb::StatusCode::success_ok);
+    JsonWriter& body = result.body();
+
+    body.beginObject()
+        .field("status", "success")
+        .key("uploadedFiles")
+        .beginArray();
+
+    for(const File& file : files)
+    {
+        body.beginObject()
+            .field("filename", file.name)
+            .field("size", file.size)
+            .field("xxh64", file.digest)
+            .endObject();
+    }
+
+    body.endArray()
+        .endObject();
+
+    result.finalize();
+    out.write(result.data(), result.size());
+}
+
+//Ответ с ошибкой, как на отказ /upload
+static void nlohmannError(std::ostream& out, const std::vector<File>& /*files*/)
+{
+    json result = {
+                      {"status", "error"},
+                      {"description", "Line is longer than window size 262144"}
+                  };
+
+    std::string content = result.dump();
+
+    out << "HTTP/1.1 " << SimpleWeb::status_code(SimpleWeb::StatusCode::client_error_bad_request) << "\r\n"
+        << "Content-Type: application/json\r\n"
+        << "Content-Length: " << content.length() << "\r\n"
+        << "\r\n" << content;
+}
+
+static void writerError(std::ostream& out, const std::vector<File>& /*files*/)
+{
+    JsonResponse result(SimpleWeb::StatusCode::client_error_bad_request);
+
+    result.body().beginObject()
+                 .field("status", "error")
+                 .field("description", "Line is longer than window size 262144")
+                 .endObject();
+
+    result.finalize();
+    out.write(result.data(), result.size());
+}
+
+struct Scenario
+{
+    std::string name;
+    size_t files;
+    std::function<void(std::ostream&, const std::vector<File>&)> nlohmannPath;
+    std::function<void(std::ostream&, const std::vector<File>&)> writerPath;
+};
+
+int main(int argc, char* argv[])
+{
+    int responses = argc > 1 ? std::atoi(argv[1]) : 200000;
+
+    std::vector<Scenario> scenarios =
+    {
+        {"error", 0, nlohmannError, writerError},
+        {"upload, 1 file", 1, nlohmannUpload, writerUpload},
+        {"upload, 10 files", 10, nlohmannUpload, writerUpload},
+        {"upload, 100 files", 100, nlohmannUpload, writerUpload}
+    };
+
+    NullBuffer sink;
+    std::ostream out(&sink);
+
+    std::printf("%-20s %-10s %12s %14s %12s\n", "scenario", "path", "ns/resp", "allocs/resp", "bytes/resp");
+
+    for(const Scenario& scenario : scenarios)
+    {
+        std::vector<File> files;
+        for(size_t i = 0; i < scenario.files; i++)
+        {
+            files.push_back({"file-" + std::to_string(i) + "-with-a-longer-name.bin", 1000000 + i, "c4a6bd469fad3404"});
+        }
+
+        for(int path = 0; path < 2; path++)
+        {
+            auto& function = path == 0 ? scenario.nlohmannPath : scenario.writerPath;
+
+            //Прогрев: буфер потока JsonResponse достигает рабочего размера
+            for(int i = 0; i < 100; i++)
+            {
+                function(out, files);
+            }
+
+            sink.bytes = 0;
+            uint64_t allocationsBefore = allocationCount.load();
+            auto start = std::chrono::steady_clock::now();
+
+            for(int i = 0; i < responses; i++)
+            {
+                function(out, files);
+            }
+
+            double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            uint64_t allocations = allocationCount.load() - allocationsBefore;
+
+            std::printf("%-20s %-10s %12.1f %14.2f %12.1f\n",
+                        scenario.name.c_str(), path == 0 ? "nlohmann" : "writer",
+                        nanoseconds / responses, static_cast<double>(allocations) / responses,
+                        static_cast<double>(sink.bytes) / responses);
+        }
+    }
+
+    return 0;
+}
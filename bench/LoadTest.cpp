@@ -0,0 +1,552 @@
+//Нагрузочный тест через loopback: запускает HTTPServer на 127.0.0.1 с --limits off (или использует уже запущенный
+//с тем же параметром), гоняет смесь GET /info, GET /log и POST /upload по keep-alive соединениям и проверяет загруженные файлы.
+//Результат - JSON в stdout (или в --output), краткая сводка - в stderr.
+//
+//LoadTest [--server ./HTTPServer] [--port 18080] [--connections 32] [--duration 10]
+//         [--mix info=1,log=1,upload=2] [--upload-size 65536] [--upload-dir /tmp] [--output result.json]
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+using json = nlohmann::json;
+
+enum Route
+{
+    Info,
+    Log,
+    Upload,
+    QuantityRoute
+};
+
+const char* routeNames[QuantityRoute] = {"/info", "/log", "/upload"};
+
+struct Options
+{
+    std::string server;
+    std::string host = "127.0.0.1";
+    int port = 18080;
+    size_t connections = 32;
+    double duration = 10;
+    unsigned mix[QuantityRoute] = {1, 1, 2};
+    size_t uploadSize = 64 * 1024;
+    std::string uploadDir = "/tmp";
+    std::string output;
+};
+
+struct UploadedFile
+{
+    std::string name;
+    uint32_t seed;
+    size_t size;
+};
+
+struct ConnectionResult
+{
+    std::vector<uint32_t> latencies[QuantityRoute];     //мкс
+    uint64_t errors[QuantityRoute] = {0, 0, 0};
+    uint64_t bytesSent = 0;
+    uint64_t bytesReceived = 0;
+    uint64_t reconnects = 0;
+    std::vector<UploadedFile> uploads;
+};
+
+const std::string boundary = "----LoadTestBoundary4k8Qz1";
+
+std::string fileContent(uint32_t seed, size_t size)
+{
+    std::mt19937 random(seed);
+    std::string data(size, '\0');
+
+    for(char& c : data)
+    {
+        c = static_cast<char>(random());
+    }
+
+    return data;
+}
+
+int connectTo(const Options& options)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+    {
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(options.port));
+    inet_pton(AF_INET, options.host.c_str(), &address.sin_addr);
+
+    if(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+bool sendAll(int fd, const std::string& data)
+{
+    size_t sent = 0;
+
+    while(sent < data.size())
+    {
+        ssize_t result = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if(result <= 0)
+        {
+            return false;
+        }
+
+        sent += result;
+    }
+
+    return true;
+}
+
+//Читает один ответ с Content-Length. buffer хранит байты, прочитанные сверх ответа
+bool readResponse(int fd, std::string& buffer, int& status, std::string& body)
+{
+    char chunk[64 * 1024];
+    size_t headerEnd;
+
+    while((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos)
+    {
+        ssize_t result = recv(fd, chunk, sizeof(chunk), 0);
+        if(result <= 0)
+        {
+            return false;
+        }
+
+        buffer.append(chunk, result);
+    }
+
+    std::string header = buffer.substr(0, headerEnd);
+    status = (header.size() > 12) ? std::atoi(header.c_str() + 9) : 0;
+
+    size_t contentLength = 0;
+    std::string lower = header;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+
+    size_t position = lower.find("content-length:");
+    if(position != std::string::npos)
+    {
+        contentLength = std::stoull(header.substr(position + 15));
+    }
+
+    size_t total = headerEnd + 4 + contentLength;
+
+    while(buffer.size() < total)
+    {
+        ssize_t result = recv(fd, chunk, sizeof(chunk), 0);
+        if(result <= 0)
+        {
+            return false;
+        }
+
+        buffer.append(chunk, result);
+    }
+
+    body = buffer.substr(headerEnd + 4, contentLength);
+    buffer.erase(0, total);
+
+    return true;
+}
+
+std::string makeRequest(Route route, const Options& options, UploadedFile& upload)
+{
+    if(route != Upload)
+    {
+        return std::string("GET ") + routeNames[route] + " HTTP/1.1\r\nHost: " + options.host + "\r\n\r\n";
+    }
+
+    std::string body = "--" + boundary + "\r\n"
+                       "Content-Disposition: form-data; name=\"file\"; filename=\"" + upload.name + "\"\r\n"
+                       "Content-Type: application/octet-stream\r\n"
+                       "\r\n" +
+                       fileContent(upload.seed, upload.size) + "\r\n"
+                       "--" + boundary + "--\r\n";
+
+    return "POST /upload HTTP/1.1\r\nHost: " + options.host + "\r\n"
+           "Content-Type: multipart/form-data; boundary=" + boundary + "\r\n"
+           "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+void runConnection(size_t index, const Options& options, std::chrono::steady_clock::time_point deadline, ConnectionResult& result)
+{
+    std::mt19937 random(static_cast<uint32_t>(index) * 7919 + 1);
+
+    unsigned weightSum = options.mix[Info] + options.mix[Log] + options.mix[Upload];
+
+    int fd = connectTo(options);
+    std::string buffer;
+    std::string body;
+    uint32_t uploadNumber = 0;
+
+    while(std::chrono::steady_clock::now() < deadline)
+    {
+        if(fd < 0)
+        {
+            result.reconnects++;
+            fd = connectTo(options);
+
+            if(fd < 0)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+
+            buffer.clear();
+        }
+
+        unsigned pick = random() % weightSum;
+        Route route = (pick < options.mix[Info]) ? Info : (pick < options.mix[Info] + options.mix[Log]) ? Log : Upload;
+
+        UploadedFile upload;
+        if(route == Upload)
+        {
+            upload.name = "loadtest_" + std::to_string(index) + "_" + std::to_string(uploadNumber++) + ".bin";
+            upload.seed = static_cast<uint32_t>(index) * 1000003u + uploadNumber;
+            upload.size = options.uploadSize;
+        }
+
+        std::string request = makeRequest(route, options, upload);
+
+        auto start = std::chrono::steady_clock::now();
+
+        int status = 0;
+        bool ok = sendAll(fd, request) && readResponse(fd, buffer, status, body);
+
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+        if(!ok)
+        {
+            result.errors[route]++;
+            close(fd);
+            fd = -1;
+            continue;
+        }
+
+        result.bytesSent += request.size();
+        result.bytesReceived += body.size();
+
+        bool success = (status == 200);
+        if(route == Upload && success)
+        {
+            success = body.find("\"success\"") != std::string::npos;
+        }
+
+        if(!success)
+        {
+            result.errors[route]++;
+            continue;
+        }
+
+        result.latencies[route].push_back(static_cast<uint32_t>(latency));
+
+        if(route == Upload)
+        {
+            result.uploads.push_back(upload);
+        }
+    }
+
+    if(fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+double percentile(const std::vector<uint32_t>& sorted, double p)
+{
+    if(sorted.empty())
+    {
+        return 0;
+    }
+
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))] / 1000.0;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string name = argv[i];
+        std::string value = argv[i + 1];
+
+        if(name == "--server")
+        {
+            options.server = value;
+        }
+        else if(name == "--host")
+        {
+            options.host = value;
+        }
+        else if(name == "--port")
+        {
+            options.port = std::stoi(value);
+        }
+        else if(name == "--connections")
+        {
+            options.connections = std::max<size_t>(1, std::stoul(value));
+        }
+        else if(name == "--duration")
+        {
+            options.duration = std::stod(value);
+        }
+        else if(name == "--upload-size")
+        {
+            options.uploadSize = std::stoul(value);
+        }
+        else if(name == "--upload-dir")
+        {
+            options.uploadDir = value;
+        }
+        else if(name == "--output")
+        {
+            options.output = value;
+        }
+        else if(name == "--mix")
+        {
+            //info=1,log=1,upload=2
+            std::stringstream list(value);
+            std::string item;
+
+            while(std::getline(list, item, ','))
+            {
+                size_t equal = item.find('=');
+                if(equal == std::string::npos)
+                {
+                    return false;
+                }
+
+                std::string route = item.substr(0, equal);
+                unsigned weight = std::stoul(item.substr(equal + 1));
+
+                if(route == "info")
+                {
+                    options.mix[Info] = weight;
+                }
+                else if(route == "log")
+                {
+                    options.mix[Log] = weight;
+                }
+                else if(route == "upload")
+                {
+                    options.mix[Upload] = weight;
+                }
+                else
+                {
+                    return false;
+                }
+            }
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return options.mix[Info] + options.mix[Log] + options.mix[Upload] > 0;
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+
+    if(argc % 2 == 0 || !parseOptions(argc, argv, options))
+    {
+        std::cerr << "Usage: " << argv[0] << " [--server ./HTTPServer] [--port 18080] [--connections 32] [--duration 10]"
+                  << " [--mix info=1,log=1,upload=2] [--upload-size 65536] [--upload-dir /tmp] [--output result.json]" << std::endl;
+        return 1;
+    }
+
+    //Запускаем сервер и ждём, пока он начнёт принимать соединения
+    pid_t serverPid = -1;
+
+    if(!options.server.empty())
+    {
+        serverPid = fork();
+
+        if(serverPid == 0)
+        {
+            std::string port = std::to_string(options.port);
+            //Все соединения теста идут с одного адреса, ограничитель запросов сервера отклонял бы их с 429 и 503
+            execl(options.server.c_str(), options.server.c_str(), options.host.c_str(), port.c_str(), "--limits", "off", static_cast<char*>(nullptr));
+            _exit(127);
+        }
+
+        bool started = false;
+        for(int attempt = 0; attempt < 100 && !started; attempt++)
+        {
+            int fd = connectTo(options);
+            if(fd >= 0)
+            {
+                close(fd);
+                started = true;
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+        }
+
+        if(!started)
+        {
+            std::cerr << "Server did not start on " << options.host << ":" << options.port << std::endl;
+            kill(serverPid, SIGTERM);
+            waitpid(serverPid, nullptr, 0);
+            return 1;
+        }
+    }
+
+    std::vector<ConnectionResult> results(options.connections);
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options.duration));
+
+    for(size_t i = 0; i < options.connections; i++)
+    {
+        threads.emplace_back(runConnection, i, std::cref(options), deadline, std::ref(results[i]));
+    }
+
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    //Сверяем загруженные файлы с тем, что отправляли
+    uint64_t verified = 0;
+    uint64_t corrupted = 0;
+
+    for(auto& result : results)
+    {
+        for(const UploadedFile& upload : result.uploads)
+        {
+            std::string path = options.uploadDir + "/" + upload.name;
+            std::ifstream file(path, std::ios::binary);
+            std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+            if(content == fileContent(upload.seed, upload.size))
+            {
+                verified++;
+            }
+            else
+            {
+                corrupted++;
+            }
+
+            std::remove(path.c_str());
+        }
+    }
+
+    if(serverPid > 0)
+    {
+        kill(serverPid, SIGTERM);
+        waitpid(serverPid, nullptr, 0);
+    }
+
+    //Сводка
+    json report;
+    report["connections"] = options.connections;
+    report["durationSeconds"] = elapsed;
+    report["uploadSize"] = options.uploadSize;
+    report["mix"] = {{"info", options.mix[Info]}, {"log", options.mix[Log]}, {"upload", options.mix[Upload]}};
+
+    uint64_t totalRequests = 0;
+    uint64_t totalErrors = 0;
+    uint64_t bytesSent = 0;
+    uint64_t bytesReceived = 0;
+    uint64_t reconnects = 0;
+
+    for(int route = 0; route < QuantityRoute; route++)
+    {
+        std::vector<uint32_t> latencies;
+        uint64_t errors = 0;
+
+        for(auto& result : results)
+        {
+            latencies.insert(latencies.end(), result.latencies[route].begin(), result.latencies[route].end());
+            errors += result.errors[route];
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+
+        totalRequests += latencies.size();
+        totalErrors += errors;
+
+        report["routes"][routeNames[route]] =
+        {
+            {"requests", latencies.size()},
+            {"errors", errors},
+            {"requestsPerSecond", latencies.size() / elapsed},
+            {"p50Ms", percentile(latencies, 0.5)},
+            {"p99Ms", percentile(latencies, 0.99)},
+            {"p999Ms", percentile(latencies, 0.999)},
+            {"maxMs", latencies.empty() ? 0.0 : latencies.back() / 1000.0}
+        };
+
+        std::fprintf(stderr, "%-8s %8zu req %10.1f req/s  p50 %8.3f ms  p99 %8.3f ms  p999 %8.3f ms  errors %lu\n",
+                     routeNames[route], latencies.size(), latencies.size() / elapsed,
+                     percentile(latencies, 0.5), percentile(latencies, 0.99), percentile(latencies, 0.999),
+                     static_cast<unsigned long>(errors));
+    }
+
+    for(auto& result : results)
+    {
+        bytesSent += result.bytesSent;
+        bytesReceived += result.bytesReceived;
+        reconnects += result.reconnects;
+    }
+
+    report["requests"] = totalRequests;
+    report["errors"] = totalErrors;
+    report["requestsPerSecond"] = totalRequests / elapsed;
+    report["sentMBps"] = bytesSent / elapsed / (1024 * 1024);
+    report["receivedMBps"] = bytesReceived / elapsed / (1024 * 1024);
+    report["reconnects"] = reconnects;
+    report["uploads"] = {{"verified", verified}, {"corrupted", corrupted}};
+
+    std::fprintf(stderr, "total    %8lu req %10.1f req/s  uploads verified %lu corrupted %lu\n",
+                 static_cast<unsigned long>(totalRequests), totalRequests / elapsed,
+                 static_cast<unsigned long>(verified), static_cast<unsigned long>(corrupted));
+
+    if(options.output.empty())
+    {
+        std::cout << report.dump(2) << std::endl;
+    }
+    else
+    {
+        std::ofstream(options.output) << report.dump(2) << std::endl;
+    }
+
+    return (totalErrors == 0 && corrupted == 0) ? 0 : 2;
+}
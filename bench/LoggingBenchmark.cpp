@@ -0,0 +1,132 @@
+//Стоимость записи в лог для потока запроса: синхронный логгер с flush_on(trace), как было раньше,
+//и асинхронный с политиками block и overrun_oldest.
+//Запуск: LoggingBenchmark [потоков] [записей на поток]
+
+#include "spdlog/spdlog.h"
+#include "spdlog/async.h"
+#include "spdlog/async_logger.h"
+#include "spdlog/sinks/rotating_file_sink.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+const std::string logPath = "/tmp/logging_benchmark.txt";
+
+struct Result
+{
+    double totalSeconds;
+    double meanNs;
+    double p50Ns;
+    double p99Ns;
+    double p999Ns;
+};
+
+Result run(std::shared_ptr<spdlog::logger> logger, size_t threadCount, size_t recordsPerThread)
+{
+    std::vector<std::vector<uint32_t>> latencies(threadCount);
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for(size_t t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&, t]()
+        {
+            std::vector<uint32_t>& own = latencies[t];
+            own.reserve(recordsPerThread);
+
+            for(size_t i = 0; i < recordsPerThread; i++)
+            {
+                //Та же запись, что делает FileSaver на каждый сохранённый файл
+                std::string message = "Was saved file: upload_" + std::to_string(i) + ".bin, size: " + std::to_string(i * 4096);
+
+                auto before = std::chrono::steady_clock::now();
+                logger->trace(message);
+                auto after = std::chrono::steady_clock::now();
+
+                own.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count()));
+            }
+        });
+    }
+
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    logger->flush();
+
+    auto finish = std::chrono::steady_clock::now();
+
+    std::vector<uint32_t> all;
+    for(auto& own : latencies)
+    {
+        all.insert(all.end(), own.begin(), own.end());
+    }
+
+    std::sort(all.begin(), all.end());
+
+    double sum = 0;
+    for(uint32_t value : all)
+    {
+        sum += value;
+    }
+
+    auto percentile = [&all](double p) { return static_cast<double>(all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))]); };
+
+    return {std::chrono::duration<double>(finish - start).count(), sum / all.size(), percentile(0.5), percentile(0.99), percentile(0.999)};
+}
+
+void print(const std::string& name, const Result& result, size_t records)
+{
+    std::printf("%-26s %10.0f %10.0f %10.0f %10.0f %14.0f\n",
+                name.c_str(), result.meanNs, result.p50Ns, result.p99Ns, result.p999Ns, records / result.totalSeconds);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t threadCount = (argc > 1) ? std::stoul(argv[1]) : 4;
+    size_t recordsPerThread = (argc > 2) ? std::stoul(argv[2]) : 100000;
+    size_t records = threadCount * recordsPerThread;
+
+    std::printf("%zu threads, %zu records per thread, per-call latency in ns\n", threadCount, recordsPerThread);
+    std::printf("%-26s %10s %10s %10s %10s %14s\n", "mode", "mean", "p50", "p99", "p999", "records/s");
+
+    {
+        std::remove(logPath.c_str());
+        auto sink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>(logPath, 1024 * 1024 * 1024, 1);
+        auto logger = std::make_shared<spdlog::logger>("sync", sink);
+        logger->set_level(spdlog::level::trace);
+        logger->flush_on(spdlog::level::trace);
+
+        print("sync, flush_on(trace)", run(logger, threadCount, recordsPerThread), records);
+    }
+
+    for(auto policy : {spdlog::async_overflow_policy::block, spdlog::async_overflow_policy::overrun_oldest})
+    {
+        std::remove(logPath.c_str());
+        auto pool = std::make_shared<spdlog::details::thread_pool>(8192, 1);
+        auto sink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>(logPath, 1024 * 1024 * 1024, 1);
+        auto logger = std::make_shared<spdlog::async_logger>("async", sink, pool, policy);
+        logger->set_level(spdlog::level::trace);
+        logger->flush_on(spdlog::level::err);
+
+        Result result = run(logger, threadCount, recordsPerThread);
+
+        //flush асинхронного логгера только ставит задание в очередь, дожидаемся, пока пул её разберёт
+        logger.reset();
+        pool.reset();
+
+        print(policy == spdlog::async_overflow_policy::block ? "async, block" : "async, overrun_oldest", result, records);
+    }
+
+    std::remove(logPath.c_str());
+
+    return 0;
+}
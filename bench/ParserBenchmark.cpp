@@ -0,0 +1,211 @@
+//Скорость разбора multipart в FileSaver без диска: тело подаётся через processStream из памяти,
+//файлы пишутся в FileWriter::Null.
+//Запуск: ParserBenchmark [размер тела в МБ] [повторов]
+
+#include "FileSaver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <istream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+
+//Подсчёт выделений памяти во время разбора
+static std::atomic<uint64_t> allocationCount(0);
+
+void* operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+    if(void* pointer = std::malloc(size ? size : 1))
+    {
+        return pointer;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t /*size*/) noexcept
+{
+    std::free(pointer);
+}
+
+
+//Поток поверх готового буфера, без копирования
+class MemoryBuffer : public std::streambuf
+{
+public:
+    MemoryBuffer(const std::string& data)
+    {
+        char* begin = const_cast<char*>(data.data());
+        setg(begin, begin, begin + data.size());
+    }
+};
+
+const std::string boundary = "----BenchmarkBoundary7MA4YWxkTrZu0gW";
+
+std::string partHeader(size_t index)
+{
+    return "--" + boundary + "\r\n"
+           "Content-Disposition: form-data; name=\"file\"; filename=\"part" + std::to_string(index) + ".bin\"\r\n"
+           "Content-Type: application/octet-stream\r\n"
+           "\r\n";
+}
+
+std::string finish(std::string body)
+{
+    return body + "--" + boundary + "--\r\n";
+}
+
+std::string hugeBinary(size_t size, std::mt19937& random)
+{
+    std::string data(size, '\0');
+    for(char& c : data)
+    {
+        c = static_cast<char>(random());
+    }
+
+    return finish(partHeader(0) + data + "\r\n");
+}
+
+std::string tinyParts(size_t size, std::mt19937& random)
+{
+    std::string body;
+    size_t index = 0;
+
+    while(body.size() < size)
+    {
+        std::string data(64 + random() % 64, 'x');
+        body += partHeader(index++) + data + "\r\n";
+    }
+
+    return finish(body);
+}
+
+std::string newlineText(size_t size, std::mt19937& random)
+{
+    std::string data;
+    data.reserve(size);
+
+    while(data.size() < size)
+    {
+        data.append(1 + random() % 16, 'a');
+        data += (random() % 2) ? "\r\n" : "\n";
+    }
+
+    return finish(partHeader(0) + data + "\r\n");
+}
+
+std::string boundaryLike(size_t size, std::mt19937& random)
+{
+    std::string data;
+    data.reserve(size);
+
+    //Почти разделители: "\r\n--" и префиксы boundary разной длины
+    while(data.size() < size)
+    {
+        data.append(random() % 256, 'b');
+        data += "\r\n--" + boundary.substr(0, random() % boundary.size());
+    }
+
+    return finish(partHeader(0) + data + "\r\n");
+}
+
+struct Scenario
+{
+    std::string name;
+    std::string body;
+};
+
+int main(int argc, char* argv[])
+{
+    size_t sizeMb = (argc > 1) ? std::stoul(argv[1]) : 64;
+    int repeats = (argc > 2) ? std::stoi(argv[2]) : 5;
+    size_t size = sizeMb * 1024 * 1024;
+
+    std::mt19937 random(42);
+
+    std::vector<Scenario> scenarios;
+    scenarios.push_back({"huge binary part", hugeBinary(size, random)});
+    scenarios.push_back({"many tiny parts", tinyParts(size, random)});
+    scenarios.push_back({"newline-dense text", newlineText(size, random)});
+    scenarios.push_back({"boundary-like data", boundaryLike(size, random)});
+
+    SimpleWeb::CaseInsensitiveMultimap headers;
+    headers.emplace("Content-Type", "multipart/form-data; boundary=" + boundary);
+
+    std::printf("%-22s %10s %14s %12s %8s\n", "scenario", "MB/s", "allocs/MB", "cycles/B", "status");
+
+    for(const Scenario& scenario : scenarios)
+    {
+        double bestSeconds = 1e30;
+        double bestCycles = 0;
+        uint64_t allocations = 0;
+        std::string status;
+
+        FileSaver fileSaver;
+        fileSaver.setDir("/tmp");
+        fileSaver.setWriterBackend(FileWriter::Null);
+
+        for(int repeat = 0; repeat < repeats; repeat++)
+        {
+            MemoryBuffer buffer(scenario.body);
+            std::istream stream(&buffer);
+
+            fileSaver.setRequestHeader(headers);
+
+            uint64_t allocationsBefore = allocationCount.load();
+#ifdef HAVE_RDTSC
+            uint64_t cyclesBefore = __rdtsc();
+#endif
+            auto start = std::chrono::steady_clock::now();
+
+            std::string result = fileSaver.processStream(stream);
+
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+#ifdef HAVE_RDTSC
+            double cycles = static_cast<double>(__rdtsc() - cyclesBefore);
+#else
+            double cycles = 0;
+#endif
+            uint64_t allocationsAfter = allocationCount.load();
+
+            if(seconds < bestSeconds)
+            {
+                bestSeconds = seconds;
+                bestCycles = cycles;
+                allocations = allocationsAfter - allocationsBefore;
+            }
+
+            status = result.find("\"status\":\"success\"") != std::string::npos ? "success" : "error";
+        }
+
+        double megabytes = scenario.body.size() / (1024.0 * 1024.0);
+
+        std::printf("%-22s %10.1f %14.1f %12.2f %8s\n",
+                    scenario.name.c_str(), megabytes / bestSeconds, allocations / megabytes,
+                    bestCycles / scenario.body.size(), status.c_str());
+    }
+
+#ifndef HAVE_RDTSC
+    std::printf("cycles/B is not available on this architecture\n");
+#endif
+
+    return 0;
+}
@@ -0,0 +1,115 @@
+//Выбор маршрута: перебор регулярных выражений, как в SimpleWeb, против RouteTable.
+//Половина маршрутов - точные пути, половина - выражения с параметром; запросы попадают в случайные маршруты
+//или не попадают ни в один (404).
+//Запуск: RouterBenchmark [запросов на сценарий]
+
+#include "RouteTable.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+
+using Handler = int;
+using Resources = std::map<SimpleWeb::Server<SimpleWeb::HTTP>::regex_orderable, std::map<std::string, Handler>>;
+
+//Так маршрут ищет ServerBase::find_resource
+static const Handler* linearFind(Resources& resources, const std::string& method, const std::string& path, SimpleWeb::regex::smatch& match)
+{
+    for(auto& regexMethod : resources)
+    {
+        auto it = regexMethod.second.find(method);
+        if(it != regexMethod.second.end() && SimpleWeb::regex::regex_match(path, match, regexMethod.first))
+        {
+            return &it->second;
+        }
+    }
+
+    return nullptr;
+}
+
+int main(int argc, char* argv[])
+{
+    int requests = argc > 1 ? std::atoi(argv[1]) : 200000;
+
+    std::printf("%-8s %-8s %14s %14s %10s\n", "routes", "requests", "linear ns/req", "table ns/req", "speedup");
+
+    for(size_t routeCount : {10, 100, 1000})
+    {
+        Resources resources;
+        std::vector<std::string> hits;
+
+        for(size_t i = 0; i < routeCount; i++)
+        {
+            if(i % 2 == 0)
+            {
+                resources["^/api/resource" + std::to_string(i) + "$"]["GET"] = static_cast<Handler>(i);
+                hits.push_back("/api/resource" + std::to_string(i));
+            }
+            else
+            {
+                resources["^/r" + std::to_string(i) + "/items/([0-9]+)$"]["GET"] = static_cast<Handler>(i);
+                hits.push_back("/r" + std::to_string(i) + "/items/12345");
+            }
+        }
+
+        RouteTable<Handler> table;
+        table.build(resources);
+
+        std::mt19937 random(1);
+        std::vector<std::string> paths;
+        for(int i = 0; i < 1024; i++)
+        {
+            //Каждый восьмой запрос - мимо всех маршрутов
+            paths.push_back(i % 8 == 7 ? "/missing/" + std::to_string(i) : hits[random() % hits.size()]);
+        }
+
+        //Оба способа должны выбирать одно и то же
+        const std::string method = "GET";
+        SimpleWeb::regex::smatch match;
+        for(const std::string& path : paths)
+        {
+            const Handler* expected = linearFind(resources, method, path, match);
+            const Handler* found = table.find(method, path, match);
+
+            if(expected != found)
+            {
+                std::printf("mismatch on %s\n", path.c_str());
+                return 1;
+            }
+        }
+
+        double results[2];
+
+        for(int variant = 0; variant < 2; variant++)
+        {
+            //Для 1000 маршрутов перебор медленный, число запросов уменьшаем
+            int count = variant == 0 ? std::max<int>(requests / static_cast<int>(routeCount / 10), 1000) : requests;
+            size_t found = 0;
+
+            auto start = std::chrono::steady_clock::now();
+
+            for(int i = 0; i < count; i++)
+            {
+                const std::string& path = paths[i & (paths.size() - 1)];
+                found += (variant == 0 ? linearFind(resources, method, path, match) : table.find(method, path, match)) != nullptr;
+            }
+
+            results[variant] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+
+            if(found == 0)
+            {
+                std::printf("no routes found\n");
+            }
+        }
+
+        std::printf("%-8zu %-8d %14.1f %14.1f %9.1fx\n", routeCount, requests, results[0], results[1], results[0] / results[1]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,347 @@
+#include "AsyncFileWriter.h"
+
+#include <cstring>
+#include <thread>
+#include <algorithm>
+
+
+AsyncFileWriter::AsyncFileWriter(std::shared_ptr<DiskWriteStage> stage, std::unique_ptr<FileWriter> writer, size_t maxPendingBytes) :
+                 m_stage(stage),
+                 m_writer(std::move(writer)),
+                 m_queue(stage->nextQueue()),
+                 m_open(false),
+                 m_used(0),
+                 m_flushed(0),
+                 m_maxPendingBytes(maxPendingBytes),
+                 m_pendingBytes(0),
+                 m_failed(false),
+                 m_tasksInFlight(0),
+                 m_overflowTasks(0)
+{
+}
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+    if(m_open)
+    {
+        close();
+    }
+
+    //Задания в очереди ссылаются на этот объект, дожидаемся их выполнения
+    while(m_tasksInFlight > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+bool AsyncFileWriter::open(const std::string& path)
+{
+    if(m_open)
+    {
+        close();
+    }
+
+    DiskWriteStage::Task task;
+    task.type = DiskWriteStage::Task::Open;
+    task.path = path;
+    push(task);
+
+    m_open = true;
+
+    //Ошибка открытия станет известна позже, в дисковом потоке
+    return true;
+}
+
+bool AsyncFileWriter::reopen(const std::string& path, uint64_t offset)
+{
+    if(m_open)
+    {
+        close();
+    }
+
+    DiskWriteStage::Task task;
+    task.type = DiskWriteStage::Task::Reopen;
+    task.path = path;
+    task.size = offset;
+    push(task);
+
+    m_open = true;
+
+    return true;
+}
+
+bool AsyncFileWriter::write(const char* data, size_t size)
+{
+    if(!m_open || m_failed)
+    {
+        return false;
+    }
+
+    const size_t bufferSize = m_stage->bufferSize();
+
+    while(size > 0)
+    {
+        if(!m_buffer || m_used == bufferSize)
+        {
+            flush();
+
+            m_buffer = m_stage->acquireBuffer();
+            m_used = 0;
+            m_flushed = 0;
+        }
+
+        size_t portion = std::min(size, bufferSize - m_used);
+        std::memcpy(m_buffer.get() + m_used, data, portion);
+        m_used += portion;
+
+        data += portion;
+        size -= portion;
+
+        //Заполненный буфер отдаём дисковому потоку
+        if(m_used == bufferSize)
+        {
+            flush();
+        }
+    }
+
+    return true;
+}
+
+bool AsyncFileWriter::preallocate(uint64_t size, bool keepSize)
+{
+    if(!m_open)
+    {
+        return true;
+    }
+
+    DiskWriteStage::Task task;
+    task.type = DiskWriteStage::Task::Preallocate;
+    task.size = static_cast<size_t>(size);
+    task.keepSize = keepSize;
+    push(task);
+
+    //Нехватку места заранее проверяет FileSaver, ошибку fallocate сообщит whenWritten
+    return true;
+}
+
+bool AsyncFileWriter::close()
+{
+    return closeAndRename("", "");
+}
+
+bool AsyncFileWriter::closeAndRename(const std::string& path, const std::string& newPath)
+{
+    return closeAndLink(path, "", newPath);
+}
+
+bool AsyncFileWriter::closeAndLink(const std::string& path, const std::string& blobPath, const std::string& newPath)
+{
+    if(!m_open)
+    {
+        return true;
+    }
+
+    flush();
+
+    DiskWriteStage::Task task;
+    task.type = DiskWriteStage::Task::Close;
+    task.path = path;
+    task.finalPath = newPath;
+    task.blobPath = blobPath;
+    push(task);
+
+    m_open = false;
+
+    //Ошибка записи станет известна позже, её сообщит whenWritten
+    return true;
+}
+
+bool AsyncFileWriter::isOpen() const
+{
+    return m_open;
+}
+
+FileWriter::Backend AsyncFileWriter::backend() const
+{
+    return m_writer->backend();
+}
+
+bool AsyncFileWriter::ready(std::function<void()> resume)
+{
+    if(m_pendingBytes < m_maxPendingBytes && m_overflowTasks <= 0)
+    {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(m_resumeMutex);
+
+    //Дисковый поток мог успеть освободить место, пока мы брали мьютекс
+    if(m_pendingBytes <= m_maxPendingBytes / 2 && m_overflowTasks <= 0)
+    {
+        return true;
+    }
+
+    m_resume = std::move(resume);
+    m_stallStart = std::chrono::steady_clock::now();
+
+    return false;
+}
+
+void AsyncFileWriter::whenWritten(std::function<void(bool)> callback)
+{
+    flush();
+
+    //Частично заполненный буфер больше не нужен, возвращаем его в пул
+    m_buffer.reset();
+    m_used = 0;
+    m_flushed = 0;
+
+    DiskWriteStage::Task task;
+    task.type = DiskWriteStage::Task::Notify;
+    task.callback = std::move(callback);
+    push(task);
+}
+
+void AsyncFileWriter::execute(DiskWriteStage::Task& task)
+{
+    switch(task.type)
+    {
+        case DiskWriteStage::Task::Open:
+        {
+            if(!m_writer->open(task.path))
+            {
+                m_failed = true;
+            }
+            break;
+        }
+        case DiskWriteStage::Task::Reopen:
+        {
+            if(!m_writer->reopen(task.path, task.size))
+            {
+                m_failed = true;
+            }
+            break;
+        }
+        case DiskWriteStage::Task::Preallocate:
+        {
+            if(!m_failed && !m_writer->preallocate(task.size, task.keepSize))
+            {
+                m_failed = true;
+            }
+            break;
+        }
+        case DiskWriteStage::Task::Write:
+        {
+            //После ошибки оставшиеся данные файла уже не пишем
+            if(!m_failed && !m_writer->write(task.data, task.size))
+            {
+                m_failed = true;
+            }
+
+            wrote(task.size);
+            break;
+        }
+        case DiskWriteStage::Task::Close:
+        {
+            bool result;
+            if(task.finalPath.empty())
+            {
+                result = m_writer->close();
+            }
+            else if(task.blobPath.empty())
+            {
+                result = m_writer->closeAndRename(task.path, task.finalPath);
+            }
+            else
+            {
+                result = m_writer->closeAndLink(task.path, task.blobPath, task.finalPath);
+            }
+            if(!result)
+            {
+                m_failed = true;
+            }
+            break;
+        }
+        case DiskWriteStage::Task::Notify:
+        {
+            task.callback(!m_failed.exchange(false));
+            break;
+        }
+    }
+
+    //Запасная очередь разгрузилась - соединение может снова читать из сокета
+    if(task.overflow && --m_overflowTasks <= 0)
+    {
+        resumeIfDrained();
+    }
+
+    m_tasksInFlight--;
+}
+
+void AsyncFileWriter::flush()
+{
+    if(m_used == m_flushed)
+    {
+        return;
+    }
+
+    size_t size = m_used - m_flushed;
+
+    DiskWriteStage::Task task;
+    task.type = DiskWriteStage::Task::Write;
+    task.buffer = m_buffer;
+    task.data = m_buffer.get() + m_flushed;
+    task.size = size;
+
+    m_flushed = m_used;
+
+    m_pendingBytes += size;
+    m_stage->addPending(static_cast<int64_t>(size));
+
+    push(task);
+}
+
+void AsyncFileWriter::push(DiskWriteStage::Task& task)
+{
+    task.writer = this;
+
+    m_tasksInFlight++;
+
+    if(!m_stage->push(m_queue, task))
+    {
+        m_overflowTasks++;
+    }
+}
+
+void AsyncFileWriter::wrote(size_t size)
+{
+    m_stage->addPending(-static_cast<int64_t>(size));
+    m_stage->addWritten(size);
+
+    m_pendingBytes -= size;
+
+    //Очередь разгрузилась наполовину - соединение может снова читать из сокета
+    resumeIfDrained();
+}
+
+void AsyncFileWriter::resumeIfDrained()
+{
+    if(m_pendingBytes <= m_maxPendingBytes / 2 && m_overflowTasks <= 0)
+    {
+        std::function<void()> resume;
+
+        {
+            std::lock_guard<std::mutex> lock(m_resumeMutex);
+            resume = std::move(m_resume);
+            m_resume = nullptr;
+        }
+
+        if(resume)
+        {
+            auto stall = std::chrono::steady_clock::now() - m_stallStart;
+            m_stage->addStall(std::chrono::duration_cast<std::chrono::microseconds>(stall).count());
+
+            resume();
+        }
+    }
+}
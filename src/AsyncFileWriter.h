@@ -0,0 +1,67 @@
+#ifndef ASYNC_FILE_WRITER_H
+#define ASYNC_FILE_WRITER_H
+
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include "FileWriter.h"
+#include "DiskWriteStage.h"
+
+
+//Запись в отдельном дисковом потоке. Данные копируются в промежуточные буферы DiskWriteStage
+//и передаются дисковому потоку, который пишет их через обычный FileWriter.
+//Объём данных в очереди ограничен: когда он превышен или задания ждут в запасной очереди DiskWriteStage,
+//ready() просит соединение перестать читать из сокета
+class AsyncFileWriter : public FileWriter
+{
+public:
+    AsyncFileWriter(std::shared_ptr<DiskWriteStage> stage, std::unique_ptr<FileWriter> writer, size_t maxPendingBytes);
+    ~AsyncFileWriter();
+
+    bool open(const std::string& path) override;
+    bool reopen(const std::string& path, uint64_t offset) override;
+    bool write(const char* data, size_t size) override;
+    bool close() override;
+    bool preallocate(uint64_t size, bool keepSize) override;
+    bool closeAndRename(const std::string& path, const std::string& newPath) override;
+    bool closeAndLink(const std::string& path, const std::string& blobPath, const std::string& newPath) override;
+    bool isOpen() const override;
+    Backend backend() const override;
+
+    bool ready(std::function<void()> resume) override;
+    void whenWritten(std::function<void(bool)> callback) override;
+
+    //Выполнение задания, вызывается в дисковом потоке
+    void execute(DiskWriteStage::Task& task);
+
+private:
+    std::shared_ptr<DiskWriteStage> m_stage;
+    std::unique_ptr<FileWriter> m_writer;
+    size_t m_queue;
+
+    //Состояние со стороны сетевого потока
+    bool m_open;
+    std::shared_ptr<char> m_buffer;
+    size_t m_used;
+    size_t m_flushed;
+
+    //Общее с дисковым потоком
+    size_t m_maxPendingBytes;
+    std::atomic<size_t> m_pendingBytes;
+    std::atomic<bool> m_failed;
+    std::atomic<size_t> m_tasksInFlight;
+    std::atomic<int64_t> m_overflowTasks;   //В запасной очереди. Дисковый поток может уменьшить счётчик раньше, чем его увеличит сетевой
+
+    std::mutex m_resumeMutex;
+    std::function<void()> m_resume;
+    std::chrono::steady_clock::time_point m_stallStart;
+
+    void flush();
+    void push(DiskWriteStage::Task& task);
+    void wrote(size_t size);
+    void resumeIfDrained();
+};
+
+#endif //ASYNC_FILE_WRITER_H
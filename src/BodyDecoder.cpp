@@ -0,0 +1,373 @@
+#include "BodyDecoder.h"
+
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+
+BodyDecoder::BodyDecoder(size_t outputSize) :
+             m_encoding(Identity),
+             m_maxDecodedSize(0),
+             m_output(outputSize),
+             m_zlib(nullptr),
+             m_zstd(nullptr),
+             m_streamEnd(false),
+             m_compressedBytes(0),
+             m_decodedBytes(0),
+             m_cpuTime(0)
+{
+}
+
+BodyDecoder::~BodyDecoder()
+{
+#ifdef HAVE_ZLIB
+    if(m_zlib)
+    {
+        inflateEnd(m_zlib);
+        delete m_zlib;
+    }
+#endif
+
+#ifdef HAVE_ZSTD
+    if(m_zstd)
+    {
+        ZSTD_freeDCtx(m_zstd);
+    }
+#endif
+}
+
+BodyDecoder::Encoding BodyDecoder::parse(const std::string& contentEncoding)
+{
+    std::string name;
+    for(char c : contentEncoding)
+    {
+        if(!std::isspace(static_cast<unsigned char>(c)))
+        {
+            name.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+        }
+    }
+
+    if(name.empty() || name == "identity")
+    {
+        return Identity;
+    }
+
+    if(name == "gzip" || name == "x-gzip")
+    {
+        return Gzip;
+    }
+
+    if(name == "zstd")
+    {
+        return Zstd;
+    }
+
+    return Unsupported;
+}
+
+bool BodyDecoder::isAvailable(Encoding encoding)
+{
+    switch(encoding)
+    {
+        case Identity:
+        {
+            return true;
+        }
+        case Gzip:
+        {
+#ifdef HAVE_ZLIB
+            return true;
+#else
+            return false;
+#endif
+        }
+        case Zstd:
+        {
+#ifdef HAVE_ZSTD
+            return true;
+#else
+            return false;
+#endif
+        }
+        default:
+        {
+            return false;
+        }
+    }
+}
+
+std::string BodyDecoder::encodingName(Encoding encoding)
+{
+    switch(encoding)
+    {
+        case Identity:
+        {
+            return "identity";
+        }
+        case Gzip:
+        {
+            return "gzip";
+        }
+        case Zstd:
+        {
+            return "zstd";
+        }
+        default:
+        {
+            return "unsupported";
+        }
+    }
+}
+
+bool BodyDecoder::reset(Encoding encoding, uint64_t maxDecodedSize)
+{
+    m_encoding = Identity;
+    m_maxDecodedSize = maxDecodedSize;
+    m_streamEnd = false;
+    m_compressedBytes = 0;
+    m_decodedBytes = 0;
+    m_cpuTime = std::chrono::nanoseconds(0);
+    m_lastError.clear();
+
+    if(!isAvailable(encoding))
+    {
+        m_lastError = "Unsupported Content-Encoding";
+        return false;
+    }
+
+#ifdef HAVE_ZLIB
+    if(encoding == Gzip)
+    {
+        if(!m_zlib)
+        {
+            m_zlib = new z_stream();
+
+            //15 + 16: окно 32 КБ, формат gzip
+            if(inflateInit2(m_zlib, 15 + 16) != Z_OK)
+            {
+                delete m_zlib;
+                m_zlib = nullptr;
+                m_lastError = "Cannot initialize gzip decoder";
+                return false;
+            }
+        }
+        else
+        {
+            inflateReset(m_zlib);
+        }
+    }
+#endif
+
+#ifdef HAVE_ZSTD
+    if(encoding == Zstd)
+    {
+        if(!m_zstd)
+        {
+            m_zstd = ZSTD_createDCtx();
+            if(!m_zstd)
+            {
+                m_lastError = "Cannot initialize zstd decoder";
+                return false;
+            }
+
+            ZSTD_DCtx_setParameter(m_zstd, ZSTD_d_windowLogMax, maxZstdWindowLog);
+        }
+        else
+        {
+            ZSTD_DCtx_reset(m_zstd, ZSTD_reset_session_only);
+        }
+    }
+#endif
+
+    m_encoding = encoding;
+    return true;
+}
+
+BodyDecoder::Encoding BodyDecoder::encoding() const
+{
+    return m_encoding;
+}
+
+bool BodyDecoder::decode(const char* data, size_t size, const std::function<bool(const char*, size_t)>& output)
+{
+    m_compressedBytes += size;
+
+    switch(m_encoding)
+    {
+        case Gzip:
+        {
+            return decodeGzip(data, size, output);
+        }
+        case Zstd:
+        {
+            return decodeZstd(data, size, output);
+        }
+        case Identity:
+        default:
+        {
+            m_decodedBytes += size;
+            return output(data, size);
+        }
+    }
+}
+
+bool BodyDecoder::finished() const
+{
+    return m_encoding == Identity || m_streamEnd;
+}
+
+const std::string& BodyDecoder::lastError() const
+{
+    return m_lastError;
+}
+
+uint64_t BodyDecoder::compressedBytes() const
+{
+    return m_compressedBytes;
+}
+
+uint64_t BodyDecoder::decodedBytes() const
+{
+    return m_decodedBytes;
+}
+
+std::chrono::nanoseconds BodyDecoder::cpuTime() const
+{
+    return m_cpuTime;
+}
+
+bool BodyDecoder::decodeGzip(const char* data, size_t size, const std::function<bool(const char*, size_t)>& output)
+{
+#ifdef HAVE_ZLIB
+    m_zlib->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    m_zlib->avail_in = static_cast<uInt>(size);
+
+    while(true)
+    {
+        //Тело может состоять из нескольких gzip подряд (cat a.gz b.gz), это один поток
+        if(m_streamEnd)
+        {
+            if(m_zlib->avail_in == 0)
+            {
+                return true;
+            }
+
+            inflateReset(m_zlib);
+            m_streamEnd = false;
+        }
+
+        m_zlib->next_out = reinterpret_cast<Bytef*>(m_output.data());
+        m_zlib->avail_out = static_cast<uInt>(m_output.size());
+
+        std::chrono::nanoseconds start = threadCpuTime();
+        int result = inflate(m_zlib, Z_NO_FLUSH);
+        m_cpuTime += threadCpuTime() - start;
+
+        size_t produced = m_output.size() - m_zlib->avail_out;
+
+        if(result == Z_STREAM_END)
+        {
+            m_streamEnd = true;
+        }
+        else if(result != Z_OK && result != Z_BUF_ERROR)
+        {
+            m_lastError = std::string("Corrupted gzip body: ") + (m_zlib->msg ? m_zlib->msg : std::to_string(result));
+            return false;
+        }
+
+        if(produced > 0 && !emit(produced, output))
+        {
+            return false;
+        }
+
+        //Вход кончился, а выходной буфер не заполнен - inflate отдал всё, что мог
+        if(m_zlib->avail_in == 0 && m_zlib->avail_out > 0)
+        {
+            return true;
+        }
+
+        if(result == Z_BUF_ERROR && produced == 0)
+        {
+            return true;
+        }
+    }
+#else
+    (void)data;
+    (void)size;
+    (void)output;
+
+    m_lastError = "gzip is not supported by this build";
+    return false;
+#endif
+}
+
+bool BodyDecoder::decodeZstd(const char* data, size_t size, const std::function<bool(const char*, size_t)>& output)
+{
+#ifdef HAVE_ZSTD
+    ZSTD_inBuffer input = {data, size, 0};
+
+    while(true)
+    {
+        ZSTD_outBuffer out = {m_output.data(), m_output.size(), 0};
+
+        std::chrono::nanoseconds start = threadCpuTime();
+        size_t result = ZSTD_decompressStream(m_zstd, &out, &input);
+        m_cpuTime += threadCpuTime() - start;
+
+        if(ZSTD_isError(result))
+        {
+            m_lastError = std::string("Corrupted zstd body: ") + ZSTD_getErrorName(result);
+            return false;
+        }
+
+        //0 - кадр закончен и весь его вывод отдан. Следующий кадр, если он есть, продолжит поток
+        m_streamEnd = result == 0;
+
+        if(out.pos > 0 && !emit(out.pos, output))
+        {
+            return false;
+        }
+
+        if(input.pos == input.size && out.pos < out.size)
+        {
+            return true;
+        }
+    }
+#else
+    (void)data;
+    (void)size;
+    (void)output;
+
+    m_lastError = "zstd is not supported by this build";
+    return false;
+#endif
+}
+
+bool BodyDecoder::emit(size_t size, const std::function<bool(const char*, size_t)>& output)
+{
+    m_decodedBytes += size;
+
+    if(m_maxDecodedSize > 0 && m_decodedBytes > m_maxDecodedSize)
+    {
+        m_lastError = "Decompressed body is larger than " + std::to_string(m_maxDecodedSize) + " bytes";
+        return false;
+    }
+
+    return output(m_output.data(), size);
+}
+
+std::chrono::nanoseconds BodyDecoder::threadCpuTime()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+
+    return std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec);
+}
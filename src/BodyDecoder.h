@@ -0,0 +1,90 @@
+#ifndef BODY_DECODER_H
+#define BODY_DECODER_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+
+
+struct z_stream_s;
+struct ZSTD_DCtx_s;
+
+//Распаковка тела запроса с Content-Encoding gzip или zstd по мере чтения из сокета, перед разбором multipart.
+//Распакованные данные отдаются кусками размером с выходной буфер, всё тело целиком в памяти не собирается.
+//Память на запрос ограничена: окно gzip 32 КБ, окно zstd не больше 1 << maxZstdWindowLog, выходной буфер.
+//Контексты распаковки создаются один раз и переиспользуются следующими телами.
+//gzip и zstd доступны, если сервер собран с zlib и libzstd (HAVE_ZLIB, HAVE_ZSTD)
+class BodyDecoder
+{
+public:
+    enum Encoding : uint8_t
+    {
+        Identity,       //Тело не сжато
+        Gzip,
+        Zstd,
+        Unsupported     //Неизвестная кодировка или цепочка из нескольких
+    };
+
+    //Больше окно zstd требует "zstd --long", такие тела отклоняются
+    static const int maxZstdWindowLog = 23;
+
+    explicit BodyDecoder(size_t outputSize = 64 * 1024);
+    ~BodyDecoder();
+
+    BodyDecoder(const BodyDecoder&) = delete;
+    BodyDecoder& operator=(const BodyDecoder&) = delete;
+
+    //Кодировка по значению заголовка Content-Encoding
+    static Encoding parse(const std::string& contentEncoding);
+    static bool isAvailable(Encoding encoding);
+    static std::string encodingName(Encoding encoding);
+
+    //Начинает новое тело. maxDecodedSize - больше распакованных байт тело дать не может, 0 - без ограничения.
+    //false - кодировка не поддерживается этой сборкой
+    bool reset(Encoding encoding, uint64_t maxDecodedSize);
+
+    Encoding encoding() const;
+
+    //Распаковывает порцию тела и передаёт результат в output. false - повреждённые данные,
+    //превышен maxDecodedSize или output вернул false. Причину ошибки распаковки вернёт lastError
+    bool decode(const char* data, size_t size, const std::function<bool(const char*, size_t)>& output);
+
+    //Сжатый поток дочитан до конца. Если тело закончилось раньше, оно обрезано
+    bool finished() const;
+
+    const std::string& lastError() const;
+
+    uint64_t compressedBytes() const;
+    uint64_t decodedBytes() const;
+
+    //Процессорное время распаковки, без разбора и записи результата
+    std::chrono::nanoseconds cpuTime() const;
+
+private:
+    Encoding m_encoding;
+    uint64_t m_maxDecodedSize;
+
+    std::vector<char> m_output;
+
+    z_stream_s* m_zlib;
+    ZSTD_DCtx_s* m_zstd;
+    bool m_streamEnd;       //Закончился член gzip или кадр zstd
+
+    uint64_t m_compressedBytes;
+    uint64_t m_decodedBytes;
+    std::chrono::nanoseconds m_cpuTime;
+
+    std::string m_lastError;
+
+    bool decodeGzip(const char* data, size_t size, const std::function<bool(const char*, size_t)>& output);
+    bool decodeZstd(const char* data, size_t size, const std::function<bool(const char*, size_t)>& output);
+
+    //Передаёт распакованный кусок дальше с проверкой предела
+    bool emit(size_t size, const std::function<bool(const char*, size_t)>& output);
+
+    static std::chrono::nanoseconds threadCpuTime();
+};
+
+#endif //BODY_DECODER_H
@@ -0,0 +1,80 @@
+#include "BoundaryScanner.h"
+
+#include <cstring>
+
+
+BoundaryScanner::BoundaryScanner()
+{
+    setPattern("");
+}
+
+void BoundaryScanner::setPattern(const std::string& newPattern)
+{
+    m_pattern = newPattern;
+
+    //Сдвиг по умолчанию - вся длина образца
+    for(size_t i = 0; i < 256; i++)
+    {
+        m_skipTable[i] = m_pattern.size();
+    }
+
+    //Для символов образца (кроме последнего) - расстояние до конца образца
+    for(size_t i = 0; i + 1 < m_pattern.size(); i++)
+    {
+        m_skipTable[static_cast<unsigned char>(m_pattern[i])] = m_pattern.size() - 1 - i;
+    }
+}
+
+size_t BoundaryScanner::size() const
+{
+    return m_pattern.size();
+}
+
+size_t BoundaryScanner::find(const char* data, size_t size) const
+{
+    const size_t patternSize = m_pattern.size();
+
+    if(patternSize == 0 || size < patternSize)
+    {
+        return std::string::npos;
+    }
+
+    const unsigned char* text = reinterpret_cast<const unsigned char*>(data);
+    const unsigned char last = static_cast<unsigned char>(m_pattern[patternSize - 1]);
+
+    size_t pos = 0;
+    while(pos <= size - patternSize)
+    {
+        unsigned char current = text[pos + patternSize - 1];
+
+        if(current == last && std::memcmp(text + pos, m_pattern.data(), patternSize - 1) == 0)
+        {
+            return pos;
+        }
+
+        pos += m_skipTable[current];
+    }
+
+    return std::string::npos;
+}
+
+size_t BoundaryScanner::safeLength(const char* data, size_t size) const
+{
+    if(m_pattern.empty())
+    {
+        return size;
+    }
+
+    //Начало разделителя может быть только среди последних patternSize - 1 байт
+    size_t pos = (size >= m_pattern.size()) ? size - m_pattern.size() + 1 : 0;
+
+    for(; pos < size; pos++)
+    {
+        if(data[pos] == m_pattern[0] && std::memcmp(data + pos, m_pattern.data(), size - pos) == 0)
+        {
+            return pos;
+        }
+    }
+
+    return size;
+}
@@ -0,0 +1,30 @@
+#ifndef BOUNDARY_SCANNER_H
+#define BOUNDARY_SCANNER_H
+
+#include <string>
+#include <cstddef>
+
+
+//Поиск разделителя частей multipart ("\r\n--boundary") в двоичных данных алгоритмом Хорспула.
+//Таблица сдвигов строится один раз при смене boundary, данные не копируются
+class BoundaryScanner
+{
+public:
+    BoundaryScanner();
+
+    void setPattern(const std::string& newPattern);
+    size_t size() const;
+
+    //Позиция первого вхождения разделителя или std::string::npos
+    size_t find(const char* data, size_t size) const;
+
+    //Количество начальных байт, которые точно не являются началом разделителя.
+    //Остальные байты - начало разделителя, который может закончиться в следующей порции данных
+    size_t safeLength(const char* data, size_t size) const;
+
+private:
+    std::string m_pattern;
+    size_t m_skipTable[256];
+};
+
+#endif //BOUNDARY_SCANNER_H
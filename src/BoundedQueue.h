@@ -0,0 +1,145 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+
+//Ограниченная неблокирующая очередь для нескольких писателей и читателей (кольцо Вьюкова).
+//Ёмкость округляется вверх до степени двойки
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) :
+             m_capacity(roundUpToPowerOfTwo(capacity)),
+             m_mask(m_capacity - 1),
+             m_cells(new Cell[m_capacity]),
+             m_enqueuePos(0),
+             m_dequeuePos(0)
+    {
+        for(size_t i = 0; i < m_capacity; i++)
+        {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    //false - очередь заполнена, значение не перемещено
+    bool tryPush(T& value)
+    {
+        Cell* cell;
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+
+        while(true)
+        {
+            cell = &m_cells[pos & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+            if(difference == 0)
+            {
+                if(m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if(difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->data = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    //false - очередь пуста
+    bool tryPop(T& value)
+    {
+        Cell* cell;
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+
+        while(true)
+        {
+            cell = &m_cells[pos & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+
+            if(difference == 0)
+            {
+                if(m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if(difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        value = std::move(cell->data);
+        cell->data = T();
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    //Приблизительное количество элементов, только для статистики
+    size_t size() const
+    {
+        size_t enqueuePos = m_enqueuePos.load(std::memory_order_relaxed);
+        size_t dequeuePos = m_dequeuePos.load(std::memory_order_relaxed);
+
+        return (enqueuePos > dequeuePos) ? enqueuePos - dequeuePos : 0;
+    }
+
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    static size_t roundUpToPowerOfTwo(size_t value)
+    {
+        size_t result = 2;
+
+        while(result < value)
+        {
+            result <<= 1;
+        }
+
+        return result;
+    }
+
+    const size_t m_capacity;
+    const size_t m_mask;
+    std::unique_ptr<Cell[]> m_cells;
+
+    //Позиции писателей и читателей на разных кэш-линиях
+    alignas(64) std::atomic<size_t> m_enqueuePos;
+    alignas(64) std::atomic<size_t> m_dequeuePos;
+};
+
+#endif //BOUNDED_QUEUE_H
@@ -0,0 +1,310 @@
+#include "ContentHash.h"
+
+#include <cstring>
+#include <algorithm>
+#include <cstdio>
+
+
+//Константы XXH64
+static const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t prime3 = 0x165667B19E3779F9ULL;
+static const uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+//Константы раундов SHA-256
+static const uint32_t shaRound[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint32_t rotr32(uint32_t x, int r)
+{
+    return (x >> r) | (x << (32 - r));
+}
+
+static inline uint64_t read64(const unsigned char* p)
+{
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t read32(const unsigned char* p)
+{
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t xxhRound(uint64_t lane, uint64_t input)
+{
+    lane += input * prime2;
+    lane = rotl64(lane, 31);
+    return lane * prime1;
+}
+
+static inline uint64_t xxhMerge(uint64_t hash, uint64_t lane)
+{
+    hash ^= xxhRound(0, lane);
+    return hash * prime1 + prime4;
+}
+
+ContentHash::ContentHash()
+{
+    reset(false);
+}
+
+void ContentHash::reset(bool sha256)
+{
+    m_lanes[0] = prime1 + prime2;
+    m_lanes[1] = prime2;
+    m_lanes[2] = 0;
+    m_lanes[3] = 0 - prime1;
+    m_total = 0;
+    m_xxhUsed = 0;
+
+    m_sha256 = sha256;
+    m_state[0] = 0x6a09e667;
+    m_state[1] = 0xbb67ae85;
+    m_state[2] = 0x3c6ef372;
+    m_state[3] = 0xa54ff53a;
+    m_state[4] = 0x510e527f;
+    m_state[5] = 0x9b05688c;
+    m_state[6] = 0x1f83d9ab;
+    m_state[7] = 0x5be0cd19;
+    m_shaUsed = 0;
+}
+
+void ContentHash::update(const char* data, size_t size)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+
+    xxhUpdate(bytes, size);
+
+    if(m_sha256)
+    {
+        shaUpdate(bytes, size);
+    }
+
+    m_total += size;
+}
+
+void ContentHash::xxhUpdate(const unsigned char* data, size_t size)
+{
+    //Дополняем неполную полосу из прошлой порции
+    if(m_xxhUsed > 0)
+    {
+        size_t portion = std::min(size, sizeof(m_xxhBuffer) - m_xxhUsed);
+        std::memcpy(m_xxhBuffer + m_xxhUsed, data, portion);
+        m_xxhUsed += portion;
+        data += portion;
+        size -= portion;
+
+        if(m_xxhUsed < sizeof(m_xxhBuffer))
+        {
+            return;
+        }
+
+        for(int i = 0; i < 4; i++)
+        {
+            m_lanes[i] = xxhRound(m_lanes[i], read64(m_xxhBuffer + i * 8));
+        }
+        m_xxhUsed = 0;
+    }
+
+    //Основной цикл прямо по данным вызывающего
+    while(size >= 32)
+    {
+        m_lanes[0] = xxhRound(m_lanes[0], read64(data));
+        m_lanes[1] = xxhRound(m_lanes[1], read64(data + 8));
+        m_lanes[2] = xxhRound(m_lanes[2], read64(data + 16));
+        m_lanes[3] = xxhRound(m_lanes[3], read64(data + 24));
+        data += 32;
+        size -= 32;
+    }
+
+    std::memcpy(m_xxhBuffer, data, size);
+    m_xxhUsed = size;
+}
+
+std::string ContentHash::xxh64Digest() const
+{
+    uint64_t hash;
+
+    if(m_total >= 32)
+    {
+        hash = rotl64(m_lanes[0], 1) + rotl64(m_lanes[1], 7) + rotl64(m_lanes[2], 12) + rotl64(m_lanes[3], 18);
+
+        for(int i = 0; i < 4; i++)
+        {
+            hash = xxhMerge(hash, m_lanes[i]);
+        }
+    }
+    else
+    {
+        hash = m_lanes[2] + prime5;
+    }
+
+    hash += m_total;
+
+    //Хвост короче полосы
+    const unsigned char* p = m_xxhBuffer;
+    size_t left = m_xxhUsed;
+
+    while(left >= 8)
+    {
+        hash ^= xxhRound(0, read64(p));
+        hash = rotl64(hash, 27) * prime1 + prime4;
+        p += 8;
+        left -= 8;
+    }
+
+    if(left >= 4)
+    {
+        hash ^= static_cast<uint64_t>(read32(p)) * prime1;
+        hash = rotl64(hash, 23) * prime2 + prime3;
+        p += 4;
+        left -= 4;
+    }
+
+    while(left > 0)
+    {
+        hash ^= (*p) * prime5;
+        hash = rotl64(hash, 11) * prime1;
+        p++;
+        left--;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+
+    char digest[17];
+    std::snprintf(digest, sizeof(digest), "%016llx", static_cast<unsigned long long>(hash));
+
+    return digest;
+}
+
+void ContentHash::shaUpdate(const unsigned char* data, size_t size)
+{
+    if(m_shaUsed > 0)
+    {
+        size_t portion = std::min(size, sizeof(m_shaBuffer) - m_shaUsed);
+        std::memcpy(m_shaBuffer + m_shaUsed, data, portion);
+        m_shaUsed += portion;
+        data += portion;
+        size -= portion;
+
+        if(m_shaUsed < sizeof(m_shaBuffer))
+        {
+            return;
+        }
+
+        shaBlock(m_shaBuffer);
+        m_shaUsed = 0;
+    }
+
+    while(size >= 64)
+    {
+        shaBlock(data);
+        data += 64;
+        size -= 64;
+    }
+
+    std::memcpy(m_shaBuffer, data, size);
+    m_shaUsed = size;
+}
+
+void ContentHash::shaBlock(const unsigned char* block)
+{
+    uint32_t w[64];
+
+    for(int i = 0; i < 16; i++)
+    {
+        w[i] = (static_cast<uint32_t>(block[i * 4]) << 24) | (static_cast<uint32_t>(block[i * 4 + 1]) << 16) |
+               (static_cast<uint32_t>(block[i * 4 + 2]) << 8) | static_cast<uint32_t>(block[i * 4 + 3]);
+    }
+
+    for(int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+    uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+
+    for(int i = 0; i < 64; i++)
+    {
+        uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+        uint32_t choice = (e & f) ^ (~e & g);
+        uint32_t temp1 = h + s1 + choice + shaRound[i] + w[i];
+        uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+        uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t temp2 = s0 + majority;
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + temp1;
+        d = c;
+        c = b;
+        b = a;
+        a = temp1 + temp2;
+    }
+
+    m_state[0] += a;
+    m_state[1] += b;
+    m_state[2] += c;
+    m_state[3] += d;
+    m_state[4] += e;
+    m_state[5] += f;
+    m_state[6] += g;
+    m_state[7] += h;
+}
+
+std::string ContentHash::sha256Digest() const
+{
+    if(!m_sha256)
+    {
+        return std::string();
+    }
+
+    //Дополнение считаем на копии, чтобы дайджест можно было запросить в любой момент
+    ContentHash copy(*this);
+
+    unsigned char padding[72] = {0x80};
+    size_t padLength = (m_shaUsed < 56) ? 56 - m_shaUsed : 120 - m_shaUsed;
+
+    uint64_t bits = m_total * 8;
+    for(int i = 0; i < 8; i++)
+    {
+        padding[padLength + i] = static_cast<unsigned char>(bits >> (56 - i * 8));
+    }
+
+    copy.shaUpdate(padding, padLength + 8);
+
+    char digest[65];
+    for(int i = 0; i < 8; i++)
+    {
+        std::snprintf(digest + i * 8, 9, "%08x", copy.m_state[i]);
+    }
+
+    return digest;
+}
@@ -0,0 +1,42 @@
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+
+//Хэш содержимого файла, который считается по мере записи, без повторного чтения с диска.
+//Всегда считается быстрый некриптографический XXH64, по желанию - ещё и SHA-256
+class ContentHash
+{
+public:
+    ContentHash();
+
+    //Начинает новый файл. sha256 - считать ли SHA-256
+    void reset(bool sha256);
+    void update(const char* data, size_t size);
+
+    //Шестнадцатеричные дайджесты всех переданных данных. sha256Digest пуст, если SHA-256 не считался
+    std::string xxh64Digest() const;
+    std::string sha256Digest() const;
+
+private:
+    //XXH64: четыре параллельные линии по 8 байт
+    uint64_t m_lanes[4];
+    uint64_t m_total;
+    unsigned char m_xxhBuffer[32];
+    size_t m_xxhUsed;
+
+    //SHA-256: состояние и неполный блок
+    bool m_sha256;
+    uint32_t m_state[8];
+    unsigned char m_shaBuffer[64];
+    size_t m_shaUsed;
+
+    void xxhUpdate(const unsigned char* data, size_t size);
+    void shaUpdate(const unsigned char* data, size_t size);
+    void shaBlock(const unsigned char* block);
+};
+
+#endif //CONTENT_HASH_H
@@ -0,0 +1,244 @@
+#include "DiskWriteStage.h"
+
+#include "AsyncFileWriter.h"
+
+#include <chrono>
+
+
+//Сколько свободных буферов держим для повторного использования
+const size_t maxIdleBuffers = 256;
+
+DiskWriteStage::Worker::Worker(size_t queueCapacity) :
+                        queue(queueCapacity),
+                        sleeping(false),
+                        overflowSize(0)
+{
+}
+
+DiskWriteStage::DiskWriteStage(size_t threadCount, size_t queueCapacity, size_t bufferSize) :
+                m_stopped(false),
+                m_nextQueue(0),
+                m_bufferSize(bufferSize),
+                m_freeBuffers(maxIdleBuffers),
+                m_buffersAllocated(0),
+                m_buffersInUse(0),
+                m_queueFullWaits(0),
+                m_stalls(0),
+                m_stallTimeUs(0),
+                m_bytesPending(0),
+                m_bytesWritten(0)
+{
+    for(size_t i = 0; i < std::max<size_t>(1, threadCount); i++)
+    {
+        m_workers.emplace_back(new Worker(queueCapacity));
+    }
+
+    for(auto& worker : m_workers)
+    {
+        Worker* current = worker.get();
+        worker->thread = std::thread([this, current]() { run(*current); });
+    }
+}
+
+DiskWriteStage::~DiskWriteStage()
+{
+    m_stopped = true;
+
+    for(auto& worker : m_workers)
+    {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->condition.notify_all();
+        }
+
+        worker->thread.join();
+    }
+
+    char* buffer = nullptr;
+    while(m_freeBuffers.tryPop(buffer))
+    {
+        delete[] buffer;
+    }
+}
+
+size_t DiskWriteStage::bufferSize() const
+{
+    return m_bufferSize;
+}
+
+std::shared_ptr<char> DiskWriteStage::acquireBuffer()
+{
+    char* buffer = nullptr;
+
+    if(!m_freeBuffers.tryPop(buffer))
+    {
+        buffer = new char[m_bufferSize];
+        m_buffersAllocated++;
+    }
+
+    m_buffersInUse++;
+
+    return std::shared_ptr<char>(buffer, [this](char* buffer) { releaseBuffer(buffer); });
+}
+
+size_t DiskWriteStage::nextQueue()
+{
+    return m_nextQueue++ % m_workers.size();
+}
+
+bool DiskWriteStage::push(size_t queue, Task& task)
+{
+    Worker& worker = *m_workers[queue % m_workers.size()];
+
+    task.overflow = false;
+
+    if(worker.overflowSize > 0 || !worker.queue.tryPush(task))
+    {
+        //Очередь заполнена. Обычно до этого не доходит: соединения раньше перестают читать из сокета,
+        //но одна порция тела с множеством мелких файлов может дать много заданий сразу
+        m_queueFullWaits++;
+
+        task.overflow = true;
+
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.overflow.push_back(std::move(task));
+        worker.overflowSize++;
+        worker.condition.notify_all();
+
+        return false;
+    }
+
+    //Будим дисковый поток, если он спит. Барьер парный барьеру в run, чтобы не потерять пробуждение
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if(worker.sleeping.load())
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.condition.notify_all();
+    }
+
+    return true;
+}
+
+DiskWriteStage::Statistics DiskWriteStage::statistics() const
+{
+    Statistics statistics;
+
+    statistics.threads = m_workers.size();
+    statistics.queueDepth = 0;
+    statistics.queueCapacity = 0;
+
+    for(auto& worker : m_workers)
+    {
+        statistics.queueDepth += worker->queue.size();
+        statistics.queueCapacity += worker->queue.capacity();
+    }
+
+    statistics.queueFullWaits = m_queueFullWaits;
+    statistics.stalls = m_stalls;
+    statistics.stallTimeUs = m_stallTimeUs;
+    statistics.bufferSize = m_bufferSize;
+    statistics.buffersAllocated = m_buffersAllocated;
+    statistics.buffersInUse = m_buffersInUse;
+    statistics.bytesPending = static_cast<uint64_t>(std::max<int64_t>(0, m_bytesPending));
+    statistics.bytesWritten = m_bytesWritten;
+
+    return statistics;
+}
+
+void DiskWriteStage::addPending(int64_t bytes)
+{
+    m_bytesPending += bytes;
+}
+
+void DiskWriteStage::addWritten(uint64_t bytes)
+{
+    m_bytesWritten += bytes;
+}
+
+void DiskWriteStage::addStall(uint64_t durationUs)
+{
+    m_stalls++;
+    m_stallTimeUs += durationUs;
+}
+
+void DiskWriteStage::run(Worker& worker)
+{
+    Task task;
+
+    while(true)
+    {
+        if(worker.queue.tryPop(task))
+        {
+            task.writer->execute(task);
+
+            //Освобождаем буфер и callback сразу, а не при следующем задании
+            task = Task();
+            continue;
+        }
+
+        if(worker.overflowSize > 0)
+        {
+            runOverflow(worker);
+            continue;
+        }
+
+        if(m_stopped)
+        {
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(worker.mutex);
+        worker.sleeping = true;
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        //Проверяем очередь ещё раз уже под мьютексом, таймаут - страховка от потерянного пробуждения
+        if(worker.queue.size() == 0 && worker.overflowSize == 0 && !m_stopped)
+        {
+            worker.condition.wait_for(lock, std::chrono::milliseconds(50));
+        }
+
+        worker.sleeping = false;
+    }
+}
+
+void DiskWriteStage::runOverflow(Worker& worker)
+{
+    std::deque<Task> tasks;
+
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        tasks.swap(worker.overflow);
+    }
+
+    //Задания, попавшие в основную очередь до того, как она переполнилась, должны выполниться раньше отложенных
+    Task task;
+    while(worker.queue.tryPop(task))
+    {
+        task.writer->execute(task);
+        task = Task();
+    }
+
+    size_t count = tasks.size();
+
+    while(!tasks.empty())
+    {
+        tasks.front().writer->execute(tasks.front());
+        tasks.pop_front();
+    }
+
+    //Пока счётчик не обнулится, новые задания идут в запасную очередь, а не обгоняют отложенные
+    worker.overflowSize -= count;
+}
+
+void DiskWriteStage::releaseBuffer(char* buffer)
+{
+    m_buffersInUse--;
+
+    if(!m_freeBuffers.tryPush(buffer))
+    {
+        delete[] buffer;
+        m_buffersAllocated--;
+    }
+}
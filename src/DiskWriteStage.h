@@ -0,0 +1,131 @@
+#ifndef DISK_WRITE_STAGE_H
+#define DISK_WRITE_STAGE_H
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+#include "BoundedQueue.h"
+
+
+class AsyncFileWriter;
+
+//Стадия записи на диск: сетевые потоки складывают задания в ограниченные неблокирующие очереди,
+//отдельные дисковые потоки их выполняют. Все задания одного AsyncFileWriter попадают в одну очередь,
+//поэтому выполняются по порядку. Сетевой поток никогда не ждёт места: задания, не поместившиеся в очередь,
+//дисковый поток выполняет из запасной очереди, а соединение перестаёт читать, пока она не разгрузится
+class DiskWriteStage
+{
+public:
+    //Задание дисковому потоку
+    struct Task
+    {
+        enum Type : uint8_t
+        {
+            Open,
+            Reopen,
+            Preallocate,
+            Write,
+            Close,
+            Notify
+        };
+
+        AsyncFileWriter* writer;
+        Type type;
+
+        std::shared_ptr<char> buffer;   //Держит буфер, пока данные не записаны
+        const char* data;
+        size_t size;            //Для Preallocate - сколько зарезервировать, для Reopen - смещение
+        bool keepSize;          //Для Preallocate - не менять размер файла
+
+        std::string path;
+        std::string finalPath;
+        std::string blobPath;   //Для Close - сохранить файл по содержимому
+
+        std::function<void(bool)> callback;
+
+        bool overflow;          //Основная очередь была заполнена, задание ждало в запасной
+    };
+
+    //Наблюдаемое состояние стадии
+    struct Statistics
+    {
+        size_t threads;
+        size_t queueDepth;          //Заданий в очередях
+        size_t queueCapacity;       //Суммарная ёмкость очередей
+        uint64_t queueFullWaits;    //Сколько заданий ушло в запасную очередь, потому что основная заполнена
+        uint64_t stalls;            //Сколько раз соединения переставали читать из сокета
+        uint64_t stallTimeUs;       //Суммарное время таких остановок
+        size_t bufferSize;
+        size_t buffersAllocated;    //Выделено промежуточных буферов
+        size_t buffersInUse;        //Из них заняты данными, ещё не записанными на диск
+        uint64_t bytesPending;      //Байт в очередях
+        uint64_t bytesWritten;
+    };
+
+    DiskWriteStage(size_t threadCount, size_t queueCapacity, size_t bufferSize);
+    ~DiskWriteStage();
+
+    size_t bufferSize() const;
+    std::shared_ptr<char> acquireBuffer();
+
+    //Очередь для нового писателя, выбирается по кругу
+    size_t nextQueue();
+
+    //Не блокирует. false - очередь заполнена и задание отложено в запасную, task.overflow тогда true
+    bool push(size_t queue, Task& task);
+
+    Statistics statistics() const;
+
+    //Учёт для статистики, вызывается из AsyncFileWriter
+    void addPending(int64_t bytes);
+    void addWritten(uint64_t bytes);
+    void addStall(uint64_t durationUs);
+
+private:
+    struct Worker
+    {
+        Worker(size_t queueCapacity);
+
+        BoundedQueue<Task> queue;
+
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::atomic<bool> sleeping;         //Поток ждёт новых заданий
+
+        //Задания, не поместившиеся в queue. Пока она не пуста, новые задания тоже идут сюда,
+        //иначе задание писателя могло бы обогнать его же более раннее
+        std::deque<Task> overflow;          //Под mutex
+        std::atomic<size_t> overflowSize;
+
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::atomic<bool> m_stopped;
+    std::atomic<size_t> m_nextQueue;
+
+    size_t m_bufferSize;
+    BoundedQueue<char*> m_freeBuffers;
+    std::atomic<size_t> m_buffersAllocated;
+    std::atomic<size_t> m_buffersInUse;
+
+    std::atomic<uint64_t> m_queueFullWaits;
+    std::atomic<uint64_t> m_stalls;
+    std::atomic<uint64_t> m_stallTimeUs;
+    std::atomic<int64_t> m_bytesPending;
+    std::atomic<uint64_t> m_bytesWritten;
+
+    void run(Worker& worker);
+    void runOverflow(Worker& worker);
+    void releaseBuffer(char* buffer);
+};
+
+#endif //DISK_WRITE_STAGE_H
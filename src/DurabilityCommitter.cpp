@@ -0,0 +1,232 @@
+#include "DurabilityCommitter.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+DurabilityCommitter::DurabilityCommitter(Mode mode, std::chrono::microseconds window, size_t maxBatch) :
+                     m_mode(mode),
+                     m_window(window),
+                     m_maxBatch(std::max<size_t>(1, maxBatch)),
+                     m_pendingFiles(0),
+                     m_stop(false)
+{
+    if(m_mode == GroupCommit)
+    {
+        m_thread = std::thread([this]() { run(); });
+    }
+}
+
+DurabilityCommitter::~DurabilityCommitter()
+{
+    if(!m_thread.joinable())
+    {
+        return;
+    }
+
+    //Уже принятые запросы фоновый поток сбросит перед выходом
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_condition.notify_all();
+    }
+
+    m_thread.join();
+}
+
+DurabilityCommitter::Mode DurabilityCommitter::mode() const
+{
+    return m_mode;
+}
+
+void DurabilityCommitter::setMetrics(std::shared_ptr<Metrics> metrics)
+{
+    m_metrics = metrics;
+}
+
+void DurabilityCommitter::commit(std::vector<std::string> paths, std::vector<std::string> directories,
+                                 std::function<bool()> publish, std::function<void(bool)> callback)
+{
+    if(m_mode == None || paths.empty())
+    {
+        callback(publish());
+        return;
+    }
+
+    if(m_mode == PerFile)
+    {
+        std::vector<Request> batch(1);
+        batch[0].paths = std::move(paths);
+        batch[0].directories = std::move(directories);
+        batch[0].publish = std::move(publish);
+
+        sync(batch);
+        callback(batch[0].synced);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_pendingFiles += paths.size();
+    m_pending.push_back({std::move(paths), std::move(directories), std::move(publish), std::move(callback), false});
+    m_condition.notify_one();
+}
+
+std::string DurabilityCommitter::modeName(Mode mode)
+{
+    switch(mode)
+    {
+        case None:
+        {
+            return "none";
+        }
+        case PerFile:
+        {
+            return "per-file fdatasync";
+        }
+        case GroupCommit:
+        {
+            return "group commit";
+        }
+        default:
+        {
+            return "unknown";
+        }
+    }
+}
+
+void DurabilityCommitter::run()
+{
+    std::vector<Request> batch;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while(true)
+    {
+        m_condition.wait(lock, [this]() { return m_stop || !m_pending.empty(); });
+
+        if(m_pending.empty())
+        {
+            return;
+        }
+
+        //Первый запрос пачки ждёт другие не дольше окна. Пока идёт сброс, новые запросы копятся в следующую пачку
+        auto deadline = std::chrono::steady_clock::now() + m_window;
+        m_condition.wait_until(lock, deadline, [this]() { return m_stop || m_pendingFiles >= m_maxBatch; });
+
+        batch.swap(m_pending);
+        m_pendingFiles = 0;
+
+        lock.unlock();
+
+        sync(batch);
+
+        for(Request& request : batch)
+        {
+            request.callback(request.synced);
+        }
+
+        batch.clear();
+
+        lock.lock();
+    }
+}
+
+void DurabilityCommitter::sync(std::vector<Request>& batch)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    struct File
+    {
+        int fd;
+        size_t request;
+    };
+
+    std::vector<File> files;
+    std::vector<std::string> directories;
+
+    for(size_t r = 0; r < batch.size(); r++)
+    {
+        batch[r].synced = true;
+
+        for(const std::string& path : batch[r].paths)
+        {
+            //Писатель файл уже закрыл, сбрасываем по новому дескриптору - fdatasync действует на файл, а не на дескриптор
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if(fd < 0)
+            {
+                batch[r].synced = false;
+                continue;
+            }
+
+            files.push_back({fd, r});
+        }
+    }
+
+    //Запускаем запись всех файлов сразу, чтобы диск получил их одной очередью, а не по одному после каждого fdatasync
+    if(files.size() > 1)
+    {
+        for(const File& file : files)
+        {
+            sync_file_range(file.fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+        }
+    }
+
+    for(const File& file : files)
+    {
+        if(fdatasync(file.fd) != 0)
+        {
+            batch[file.request].synced = false;
+        }
+
+        ::close(file.fd);
+    }
+
+    //Данные на диске - теперь файлы можно переносить на место. Не сброшенный файл остаётся под временным именем
+    for(Request& request : batch)
+    {
+        if(request.synced)
+        {
+            request.synced = request.publish();
+        }
+
+        if(request.synced)
+        {
+            directories.insert(directories.end(), request.directories.begin(), request.directories.end());
+        }
+    }
+
+    //Новые имена файлов (rename, жёсткие ссылки) живут в каталогах, каждый каталог сбрасываем один раз
+    std::sort(directories.begin(), directories.end());
+    directories.erase(std::unique(directories.begin(), directories.end()), directories.end());
+
+    bool directoriesSynced = true;
+
+    for(const std::string& directory : directories)
+    {
+        int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if(fd < 0 || fsync(fd) != 0)
+        {
+            directoriesSynced = false;
+        }
+
+        if(fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+
+    if(!directoriesSynced)
+    {
+        for(Request& request : batch)
+        {
+            request.synced = false;
+        }
+    }
+
+    if(m_metrics)
+    {
+        m_metrics->synced(files.size(), std::chrono::steady_clock::now() - start);
+    }
+}
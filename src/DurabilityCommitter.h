@@ -0,0 +1,84 @@
+#ifndef DURABILITY_COMMITTER_H
+#define DURABILITY_COMMITTER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+
+#include "Metrics.h"
+
+
+//Долговечность сохранённых файлов: ответ на загрузку отправляется, когда её файлы и их записи в каталогах
+//сброшены на диск. fsync на каждый файл дорог, поэтому в режиме GroupCommit фоновый поток собирает файлы
+//всех запросов, закрытых в пределах короткого окна, и сбрасывает их одной пачкой: сначала запускает запись
+//всех файлов сразу (sync_file_range), затем fdatasync каждого и fsync каждого каталога один раз на пачку.
+//Журнал файловой системы при этом фиксируется один раз на всю пачку, а не на каждый файл.
+//Файлы сбрасываются под временными именами и переносятся на место только после этого, поэтому после сбоя
+//под постоянным именем не может оказаться файл с незаписанными данными
+class DurabilityCommitter
+{
+public:
+    enum Mode : uint8_t
+    {
+        None,           //Не ждать диска, данные могут пропасть при сбое питания
+        PerFile,        //fdatasync каждого файла в потоке, который его записал
+        GroupCommit     //Общий сброс файлов нескольких запросов в фоновом потоке
+    };
+
+    //window - сколько первый файл пачки ждёт остальные. Пачка закрывается раньше, если в ней maxBatch файлов
+    DurabilityCommitter(Mode mode, std::chrono::microseconds window, size_t maxBatch);
+    ~DurabilityCommitter();
+
+    DurabilityCommitter(const DurabilityCommitter&) = delete;
+    DurabilityCommitter& operator=(const DurabilityCommitter&) = delete;
+
+    Mode mode() const;
+
+    void setMetrics(std::shared_ptr<Metrics> metrics);
+
+    //Сбрасывает на диск данные временных файлов paths, затем publish переносит их на место (rename, link),
+    //затем сбрасываются каталоги directories с новыми записями и вызывается callback.
+    //false - данные сбросить не удалось (publish тогда не вызывается), publish вернул false или не сброшен каталог.
+    //None - publish и callback вызываются сразу, PerFile - после fdatasync в вызывающем потоке, GroupCommit - из фонового потока
+    void commit(std::vector<std::string> paths, std::vector<std::string> directories,
+                std::function<bool()> publish, std::function<void(bool)> callback);
+
+    static std::string modeName(Mode mode);
+
+private:
+    struct Request
+    {
+        std::vector<std::string> paths;
+        std::vector<std::string> directories;
+        std::function<bool()> publish;
+        std::function<void(bool)> callback;
+        bool synced;
+    };
+
+    Mode m_mode;
+    std::chrono::microseconds m_window;
+    size_t m_maxBatch;
+
+    std::shared_ptr<Metrics> m_metrics;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::vector<Request> m_pending;
+    size_t m_pendingFiles;
+    bool m_stop;
+
+    std::thread m_thread;
+
+    void run();
+
+    //Сбрасывает и переносит на место файлы всех запросов пачки, результат каждого запроса - в его synced
+    void sync(std::vector<Request>& batch);
+};
+
+#endif //DURABILITY_COMMITTER_H
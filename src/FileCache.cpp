@@ -0,0 +1,71 @@
+#include "FileCache.h"
+
+
+FileCache::FileCache(size_t capacity, size_t maxFileSize) :
+           m_capacity(capacity),
+           m_maxFileSize(maxFileSize),
+           m_size(0)
+{
+}
+
+std::shared_ptr<const std::string> FileCache::find(const std::string& path, const struct stat& info)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto found = m_index.find(path);
+    if(found == m_index.end())
+    {
+        return nullptr;
+    }
+
+    auto it = found->second;
+
+    //Файл перезаписали - старое содержимое больше не нужно
+    if(it->inode != info.st_ino || it->size != info.st_size ||
+       it->mtime.tv_sec != info.st_mtim.tv_sec || it->mtime.tv_nsec != info.st_mtim.tv_nsec)
+    {
+        erase(it);
+        return nullptr;
+    }
+
+    m_entries.splice(m_entries.begin(), m_entries, it);
+
+    return it->data;
+}
+
+void FileCache::insert(const std::string& path, const struct stat& info, std::shared_ptr<const std::string> data)
+{
+    if(!fits(data->size()))
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto found = m_index.find(path);
+    if(found != m_index.end())
+    {
+        erase(found->second);
+    }
+
+    m_entries.push_front({path, info.st_ino, info.st_size, info.st_mtim, data});
+    m_index[path] = m_entries.begin();
+    m_size += data->size();
+
+    while(m_size > m_capacity && !m_entries.empty())
+    {
+        erase(std::prev(m_entries.end()));
+    }
+}
+
+bool FileCache::fits(unsigned long long size) const
+{
+    return size <= m_maxFileSize && size <= m_capacity;
+}
+
+void FileCache::erase(std::list<Entry>::iterator it)
+{
+    m_size -= it->data->size();
+    m_index.erase(it->path);
+    m_entries.erase(it);
+}
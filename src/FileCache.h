@@ -0,0 +1,48 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <sys/stat.h>
+
+
+//Кэш содержимого небольших файлов в памяти с вытеснением давно не запрошенных (LRU).
+//Запись действительна, пока у файла те же inode, размер и время изменения
+class FileCache
+{
+public:
+    //capacity - общий объём кэша, файлы больше maxFileSize не кэшируются
+    FileCache(size_t capacity, size_t maxFileSize);
+
+    //Содержимое файла, если оно в кэше и файл с тех пор не менялся (info - результат stat), иначе nullptr
+    std::shared_ptr<const std::string> find(const std::string& path, const struct stat& info);
+
+    void insert(const std::string& path, const struct stat& info, std::shared_ptr<const std::string> data);
+
+    bool fits(unsigned long long size) const;
+
+private:
+    struct Entry
+    {
+        std::string path;
+        ino_t inode;
+        off_t size;
+        struct timespec mtime;
+        std::shared_ptr<const std::string> data;
+    };
+
+    const size_t m_capacity;
+    const size_t m_maxFileSize;
+
+    std::mutex m_mutex;
+    std::list<Entry> m_entries;     //В начале - запрошенные последними
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+    size_t m_size;
+
+    void erase(std::list<Entry>::iterator it);
+};
+
+#endif //FILE_CACHE_H
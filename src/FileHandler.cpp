@@ -0,0 +1,197 @@
+#include "FileHandler.h"
+
+#include "ResponseCache.h"
+
+#include <ctime>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+FileHandler::FileHandler(std::string dir, std::shared_ptr<FileCache> cache) :
+             FileHandler(std::vector<std::string>{dir}, cache)
+{
+}
+
+FileHandler::FileHandler(std::vector<std::string> dirs, std::shared_ptr<FileCache> cache) :
+             m_dirs(dirs),
+             m_cache(cache)
+{
+}
+
+std::shared_ptr<HttpServer::FileResponse> FileHandler::operator()(std::shared_ptr<HttpServer::Request> request) const
+{
+    std::string name = SimpleWeb::Percent::decode(request->path_match[1].str());
+
+    if(name.empty() || name[0] == '.' || name.find('/') != std::string::npos || name.find('\0') != std::string::npos)
+    {
+        return makeTextResponse(SimpleWeb::StatusCode::client_error_not_found, "Файл не найден");
+    }
+
+    //Сначала stat: для файла из кэша открывать его не нужно
+    std::string path;
+    struct stat info;
+    bool found = false;
+
+    for(const std::string& dir : m_dirs)
+    {
+        path = dir + "/" + name;
+
+        if(stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+        {
+            found = true;
+            break;
+        }
+    }
+
+    if(!found)
+    {
+        return makeTextResponse(SimpleWeb::StatusCode::client_error_not_found, "Файл не найден");
+    }
+
+    std::shared_ptr<const std::string> cached;
+    int fd = -1;
+
+    if(m_cache && m_cache->fits(info.st_size))
+    {
+        cached = m_cache->find(path, info);
+    }
+
+    if(!cached)
+    {
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        //Размер и время берём у открытого файла - они должны соответствовать отправляемому содержимому
+        if(fd < 0 || fstat(fd, &info) != 0)
+        {
+            if(fd >= 0)
+            {
+                ::close(fd);
+            }
+            return makeTextResponse(SimpleWeb::StatusCode::client_error_not_found, "Файл не найден");
+        }
+
+        if(m_cache && m_cache->fits(info.st_size))
+        {
+            cached = readFile(fd, info.st_size);
+            ::close(fd);
+            fd = -1;
+
+            if(!cached)
+            {
+                return makeTextResponse(SimpleWeb::StatusCode::server_error_internal_server_error, "Ошибка чтения файла");
+            }
+
+            m_cache->insert(path, info, cached);
+        }
+    }
+
+    //Дескриптор закроется вместе с ответом или здесь, если ответ без тела
+    HttpServer::FilePart file(fd, 0, static_cast<unsigned long long>(info.st_size));
+
+    unsigned long long total = info.st_size;
+
+    uint64_t stamp = ResponseCache::combine(0, info.st_ino);
+    stamp = ResponseCache::combine(stamp, info.st_size);
+    stamp = ResponseCache::combine(stamp, info.st_mtim.tv_sec * 1000000000ULL + info.st_mtim.tv_nsec);
+
+    std::string etag = ResponseCache::makeETag(stamp);
+    std::string lastModified = httpDate(info.st_mtim.tv_sec);
+
+    auto response = std::make_shared<HttpServer::FileResponse>();
+    response->header.emplace("Content-Type", "application/octet-stream");
+    response->header.emplace("Accept-Ranges", "bytes");
+    response->header.emplace("ETag", etag);
+    response->header.emplace("Last-Modified", lastModified);
+
+    if(ResponseCache::matches(request->header, etag))
+    {
+        response->status = SimpleWeb::StatusCode::redirection_not_modified;
+        return response;
+    }
+
+    unsigned long long begin = 0;
+    unsigned long long end = total;
+
+    //If-Range: участок отдаём, только если файл не изменился с прошлой загрузки, иначе - весь файл заново
+    auto rangeHeader = request->header.find("Range");
+    auto ifRange = request->header.find("If-Range");
+
+    bool useRange = rangeHeader != request->header.end() &&
+                    (ifRange == request->header.end() || ifRange->second == etag || ifRange->second == lastModified);
+
+    if(useRange)
+    {
+        if(!HttpServer::parseRange(rangeHeader->second, total, begin, end))
+        {
+            response = makeTextResponse(SimpleWeb::StatusCode::client_error_range_not_satisfiable, "");
+            response->header.emplace("Content-Range", "bytes */" + std::to_string(total));
+            return response;
+        }
+
+        response->status = SimpleWeb::StatusCode::success_partial_content;
+        response->header.emplace("Content-Range", "bytes " + std::to_string(begin) + "-" + std::to_string(end - 1) + "/" + std::to_string(total));
+    }
+
+    if(cached)
+    {
+        response->memory = cached;
+        response->memoryOffset = begin;
+        response->memoryLength = end - begin;
+    }
+    else
+    {
+        file.offset = begin;
+        file.length = end - begin;
+        response->files.push_back(std::move(file));
+    }
+
+    return response;
+}
+
+std::shared_ptr<HttpServer::FileResponse> FileHandler::makeTextResponse(SimpleWeb::StatusCode status, const std::string& text)
+{
+    auto response = std::make_shared<HttpServer::FileResponse>();
+    response->status = status;
+    response->header.emplace("Content-Type", "text/plain; charset=utf-8");
+    response->content = text;
+
+    return response;
+}
+
+std::string FileHandler::httpDate(time_t time)
+{
+    struct tm tm;
+    gmtime_r(&time, &tm);
+
+    char date[64];
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+    return date;
+}
+
+std::shared_ptr<const std::string> FileHandler::readFile(int fd, unsigned long long size)
+{
+    auto data = std::make_shared<std::string>(size, '\0');
+    size_t done = 0;
+
+    while(done < size)
+    {
+        ssize_t count = pread(fd, &(*data)[done], size - done, done);
+
+        if(count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        //Файл укоротили во время чтения
+        if(count <= 0)
+        {
+            return nullptr;
+        }
+
+        done += count;
+    }
+
+    return data;
+}
@@ -0,0 +1,34 @@
+#ifndef FILE_HANDLER_H
+#define FILE_HANDLER_H
+
+#include <string>
+#include <memory>
+#include <vector>
+
+#include "StreamingServer.h"
+#include "FileCache.h"
+
+
+//Отдаёт загруженные файлы по GET /files/<имя>. Большие файлы уходят через sendfile, небольшие - из FileCache.
+//Поддерживает Range и If-Range для докачки и загрузки частями, If-None-Match, отдаёт ETag и Last-Modified.
+//Скрытые файлы (временные .part, каталоги .blobs и .resumable) не отдаются
+class FileHandler
+{
+public:
+    FileHandler(std::string dir, std::shared_ptr<FileCache> cache);
+
+    //Файлы разложены по нескольким каталогам (UploadStorage), отдаётся первый найденный
+    FileHandler(std::vector<std::string> dirs, std::shared_ptr<FileCache> cache);
+
+    std::shared_ptr<HttpServer::FileResponse> operator()(std::shared_ptr<HttpServer::Request> request) const;
+
+private:
+    std::vector<std::string> m_dirs;
+    std::shared_ptr<FileCache> m_cache;
+
+    static std::shared_ptr<HttpServer::FileResponse> makeTextResponse(SimpleWeb::StatusCode status, const std::string& text);
+    static std::string httpDate(time_t time);
+    static std::shared_ptr<const std::string> readFile(int fd, unsigned long long size);
+};
+
+#endif //FILE_HANDLER_H
@@ -1,8 +1,20 @@
 #include "FileSaver.h"
 
 #include "FileSaver.h"
+#include "AsyncFileWriter.h"
 #include <ctime>
 #include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <atomic>
+#include <limits>
+#include <future>
+#include <chrono>
+#include <cerrno>
+#include <sys/statvfs.h>
+#include <sys/stat.h>
 
 #define WRITE_TO_LOGGER(a) \
 if(m_logger) \
@@ -10,11 +22,38 @@ if(m_logger) \
     m_logger->trace(a); \
 }
 
+//Номер для имён временных файлов, общий для всех FileSaver
+static std::atomic<uint64_t> tempFileCounter(0);
+
+//Минимальный размер окна, в него должна помещаться любая строка заголовков части
+const size_t minWindowSize = 4 * 1024;
+
 FileSaver::FileSaver() :
            m_state(WaitingRequestHeader),
-           m_fileSize(0)
+           m_target(0),
+           m_boundaryPending(false),
+           m_fileSize(0),
+           m_contentLength(0),
+           m_bodyReceived(0),
+           m_bodyOffset(0),
+           m_notEnoughSpace(false),
+           m_unsupportedEncoding(false),
+           m_maxDecodedSize(0),
+           m_freeSpace(std::numeric_limits<uint64_t>::max()),
+           m_windowSize(64 * 1024),
+           m_writer(nullptr),
+           m_writerBackend(FileWriter::Stream),
+           m_writerBufferSize(1024 * 1024),
+           m_maxPendingBytes(0),
+           m_contentAddressed(false),
+           m_sha256(false),
+           m_uploadedCount(0)
 {
-    descriptionUploadedFiles = json::array();
+    m_window.reserve(m_windowSize);
+
+    m_writers.push_back(FileWriter::create(FileWriter::Stream));
+    m_writer = m_writers[0].get();
+    m_writerUsed.assign(1, false);
 }
 
 void FileSaver::setRequestHeader(const CaseInsensitiveMultimap& headers)
@@ -26,8 +65,43 @@ void FileSaver::setRequestHeader(const CaseInsensitiveMultimap& headers)
     m_boundary.clear();
     m_boundaryExtended.clear();
     m_boundaryEnd.clear();
-    descriptionUploadedFiles.clear();
+    m_uploadedCount = 0;
+    m_writerUsed.assign(m_writers.size(), false);
+    m_window.clear();
+    m_boundaryPending = false;
+    m_contentLength = 0;
+    m_bodyReceived = 0;
+    m_bodyOffset = 0;
+    m_notEnoughSpace = false;
+    m_unsupportedEncoding = false;
+    m_freeSpace = std::numeric_limits<uint64_t>::max();
+    m_decodedQuota = nullptr;
+
+    //Размер тела нужен для проверки свободного места и резервирования места под файлы
+    auto contentLength = headers.find("Content-Length");
+    if(contentLength != headers.end())
+    {
+        try
+        {
+            m_contentLength = std::stoull(contentLength->second);
+        }
+        catch(const std::exception&)
+        {
+            m_contentLength = 0;
+        }
+    }
+
+    //Сжатое тело распаковывается перед разбором, Content-Length тогда - размер сжатого тела
+    auto contentEncoding = headers.find("Content-Encoding");
+    BodyDecoder::Encoding encoding = contentEncoding != headers.end() ? BodyDecoder::parse(contentEncoding->second) : BodyDecoder::Identity;
 
+    if(!m_decoder.reset(encoding, m_maxDecodedSize))
+    {
+        m_unsupportedEncoding = true;
+        setState(ErrorState);
+        setLastError("Unsupported Content-Encoding: " + contentEncoding->second);
+        return;
+    }
 
     //Ищем заголовок Content-Type с boundary=
     auto it = headers.find("Content-Type");
@@ -63,7 +137,13 @@ void FileSaver::setRequestHeader(const CaseInsensitiveMultimap& headers)
                 m_boundaryExtended = "--" + m_boundary;
                 m_boundaryEnd = m_boundaryExtended + "--";
 
+                //Данные файла заканчиваются переводом строки перед boundary
+                m_scanner.setPattern("\r\n" + m_boundaryExtended);
+
                 setState(WaitingBoundary);
+
+                //Загрузку, которая заведомо не поместится на диск, отклоняем до чтения тела
+                checkFreeSpace();
                 return;
             }
         }
@@ -74,87 +154,391 @@ void FileSaver::setRequestHeader(const CaseInsensitiveMultimap& headers)
     setLastError("Content-Type with boundary not found in request headers");
 }
 
-json FileSaver::processStream(std::istream& stream)
+FileSaver::Admission FileSaver::admission() const
+{
+    if(m_state != ErrorState)
+    {
+        return Accepted;
+    }
+
+    if(m_unsupportedEncoding)
+    {
+        return UnsupportedEncoding;
+    }
+
+    return m_notEnoughSpace ? NotEnoughSpace : InvalidHeader;
+}
+
+std::string FileSaver::processStream(std::istream& stream)
 {
-    std::string line;
+    std::vector<char> buffer(m_windowSize);
 
-    while(true)
+    //Читаем поток порциями размером с окно, как если бы они приходили из сокета
+    while(m_state != FinishedRead && m_state != ErrorState)
     {
-        //Читаем строку из буфера
-        if(!readLineFromBuffer(stream, line))
+        stream.read(buffer.data(), buffer.size());
+
+        std::streamsize count = stream.gcount();
+        if(count <= 0)
         {
-            //Не удалось считать
+            break;
+        }
 
-            //Завершаем текущий файл если он открыт
-            closeFileAndResetValues();
+        processChunk(buffer.data(), count);
+    }
 
-            if(m_state != FinishedRead)
-            {
-                setLastError("The file was finished read in unexpected state: " + std::to_string(m_state));
+    return finishStream();
+}
 
-                json result = {
-                                  {"status", "error"},
-                                  {"description", m_lastError}
-                              };
+bool FileSaver::processChunk(const char* data, size_t size)
+{
+    if(m_metrics)
+    {
+        m_metrics->bytesReceived(size);
+    }
+
+    if(m_decoder.encoding() == BodyDecoder::Identity)
+    {
+        return parseChunk(data, size);
+    }
+
+    if(m_state == ErrorState)
+    {
+        return false;
+    }
+
+    //Распаковываем и после завершающего boundary: конец сжатого потока и его контрольная сумма - в самом конце тела.
+    //Одна порция сети может распаковаться в много данных, разбор получает их кусками размером с выходной буфер
+    if(!m_decoder.decode(data, size, [this](const char* decoded, size_t decodedSize) { return chargeDecoded() && parseChunk(decoded, decodedSize); }) &&
+       m_state != ErrorState)
+    {
+        setState(ErrorState);
+        setLastError(m_decoder.lastError());
+    }
+
+    return m_state != ErrorState;
+}
+
+bool FileSaver::parseChunk(const char* data, size_t size)
+{
+    m_bodyOffset = m_bodyReceived;
+    m_bodyReceived += size;
+
+    while(size > 0)
+    {
+        //Данные после завершающего boundary игнорируем
+        if(m_state == FinishedRead)
+        {
+            return true;
+        }
 
-                return result;
+        if(m_state == ErrorState)
+        {
+            return false;
+        }
+
+        if(m_window.empty())
+        {
+            //Окно пусто - разбираем данные прямо из буфера вызывающего, без копирования
+            size_t consumed = processBuffer(data, size);
+            data += consumed;
+            size -= consumed;
+
+            if(m_state == FinishedRead || m_state == ErrorState || size == 0)
+            {
+                continue;
             }
 
-            json result = {
-                              {"status", "success"},
-                              {"uploadedFiles", descriptionUploadedFiles}
-                          };
+            //Неразобранный остаток - неполная строка или возможное начало разделителя, сохраняем его в окне
+            if(size > m_windowSize)
+            {
+                setState(ErrorState);
+                setLastError("Line is longer than window size " + std::to_string(m_windowSize));
+                return false;
+            }
 
-            return result;
+            m_window.assign(data, size);
+            return true;
         }
 
+        //В окне остаток предыдущей порции. Внутри данных файла он короче разделителя,
+        //поэтому дописываем немного, чтобы поскорее вернуться к разбору без копирования
+        size_t portion = m_windowSize - m_window.size();
+        if(isDataState() && !m_boundaryPending)
+        {
+            portion = std::min(portion, m_scanner.size());
+        }
 
-        //Определяем тип текущей строки
-        TypeLine lineType = getLineType(line);
+        portion = std::min(portion, size);
+        m_window.append(data, portion);
+        data += portion;
+        size -= portion;
 
-        //Выполняем переход состояния
-        FileSaverState newState = m_transitionTable[m_state][lineType];
-        setState(newState);
+        size_t consumed = processBuffer(m_window.data(), m_window.size());
+        m_window.erase(0, consumed);
 
-        //Анализируем содержимое линии исходя из состояния
-        if(!analyzeLine(line))
+        if(m_window.size() >= m_windowSize && m_state != ErrorState)
         {
-            //Если одно из состояний вернуло false, значит произошла ошибка
-            json result = {
-                              {"status", "error"},
-                              {"description", m_lastError}
-                          };
+            setState(ErrorState);
+            setLastError("Line is longer than window size " + std::to_string(m_windowSize));
+        }
+    }
 
-            return result;
+    return m_state != ErrorState;
+}
+
+std::string FileSaver::finishStream()
+{
+    std::promise<std::string> result;
+    std::future<std::string> future = result.get_future();
+
+    finishStream([this, &result]()
+                 {
+                     result.set_value(makeResult());
+                 });
+
+    return future.get();
+}
+
+void FileSaver::finishStream(std::function<void()> callback)
+{
+    if(m_decoder.encoding() != BodyDecoder::Identity)
+    {
+        //Без конца сжатого потока последние данные потеряны, а контрольная сумма не проверена
+        if(!m_decoder.finished() && m_state != ErrorState)
+        {
+            setState(ErrorState);
+            setLastError("Compressed body is truncated");
         }
 
-        // Если достигли конечного состояния, завершаем обработку
-        if(m_state == FinishedRead || m_state == ErrorState)
+        if(m_metrics)
         {
-            break;
+            m_metrics->decompressed(m_decoder.compressedBytes(), m_decoder.decodedBytes(), m_decoder.cpuTime());
         }
+
+        WRITE_TO_LOGGER("Decompressed " + BodyDecoder::encodingName(m_decoder.encoding()) + " body: " +
+                        std::to_string(m_decoder.compressedBytes()) + " -> " + std::to_string(m_decoder.decodedBytes()) + " bytes, " +
+                        std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(m_decoder.cpuTime()).count()) + " us CPU");
     }
 
-    if(m_state == FinishedRead)
+    //Последняя строка тела может не заканчиваться переводом строки
+    if(!m_window.empty() && m_state != FinishedRead && m_state != ErrorState)
     {
-        json result = {
-                          {"status", "success"},
-                          {"uploadedFiles", descriptionUploadedFiles}
-                      };
+        m_window.push_back('\n');
+        processBuffer(m_window.data(), m_window.size());
+    }
 
-        return result;
+    m_window.clear();
+    m_boundaryPending = false;
+
+    //Завершаем текущий файл если он открыт
+    closeFileAndResetValues();
+
+    if(m_state != FinishedRead && m_state != ErrorState)
+    {
+        setLastError("The file was finished read in unexpected state: " + std::to_string(m_state));
     }
-    else
+
+    //Ответ можно отдавать только после того, как данные действительно записаны во всех каталогах запроса.
+    //Писатели разных каталогов отвечают из своих дисковых потоков, callback вызывает последний
+    size_t waiting = 0;
+    for(size_t i = 0; i < m_writers.size(); i++)
     {
-        json result = {
-                          {"status", "error"},
-                          {"description", m_lastError}
-                      };
+        waiting += m_writerUsed[i];
+    }
 
-        return result;
+    if(waiting == 0)
+    {
+        m_writerUsed[m_target] = true;
+        waiting = 1;
+    }
+
+    auto remaining = std::make_shared<std::atomic<size_t>>(waiting);
+    auto failed = std::make_shared<std::atomic<bool>>(false);
+
+    for(size_t i = 0; i < m_writers.size(); i++)
+    {
+        if(!m_writerUsed[i])
+        {
+            continue;
+        }
+
+        m_writers[i]->whenWritten([this, callback, remaining, failed](bool written)
+                                  {
+                                      if(!written)
+                                      {
+                                          failed->store(true);
+                                      }
+
+                                      if(remaining->fetch_sub(1) != 1)
+                                      {
+                                          return;
+                                      }
+
+                                      if(failed->load())
+                                      {
+                                          failUpload("Error while writing files to disk");
+                                          discardFiles();
+                                          callback();
+                                          return;
+                                      }
+
+                                      commitFiles(callback);
+                                  });
+    }
+}
+
+void FileSaver::abortStream(std::function<void()> callback)
+{
+    if(m_state != ErrorState)
+    {
+        setState(ErrorState);
+        setLastError("Upload aborted");
+    }
+
+    finishStream(std::move(callback));
+}
+
+void FileSaver::commitFiles(std::function<void()> callback)
+{
+    if(!m_committer || m_committer->mode() == DurabilityCommitter::None || m_state != FinishedRead || m_uploadedCount == 0)
+    {
+        publishFiles();
+        callback();
+        return;
+    }
+
+    //Сбрасываются временные файлы: на место они переносятся, только когда их данные уже на диске
+    std::vector<std::string> paths;
+    std::vector<std::string> directories;
+    paths.reserve(m_uploadedCount);
+
+    for(size_t i = 0; i < m_uploadedCount; i++)
+    {
+        const UploadedFile& file = m_uploadedFiles[i];
+        std::string dir = file.location.empty() ? m_dir : file.location;
+
+        if(!file.tempPath.empty())
+        {
+            paths.push_back(file.tempPath);
+        }
+
+        directories.push_back(dir);
+
+        //Запись о blob в .blobs тоже должна пережить сбой, сам blob - тот же файл
+        if(m_contentAddressed)
+        {
+            directories.push_back(dir + "/.blobs");
+        }
+    }
+
+    m_committer->commit(std::move(paths), std::move(directories), [this]() { return publishFiles(); },
+                        [this, callback](bool synced)
+                        {
+                            //Ошибку переноса publishFiles уже записал сам
+                            if(!synced && m_state != ErrorState)
+                            {
+                                failUpload("Error while syncing files to disk");
+                            }
+
+                            if(!synced)
+                            {
+                                discardFiles();
+                            }
+
+                            callback();
+                        });
+}
+
+void FileSaver::failUpload(const std::string& error)
+{
+    setState(ErrorState);
+    setLastError(error);
+
+    //Какой именно файл не сохранился, неизвестно - из индекса убираем все файлы запроса.
+    //Файлы, которые ещё не перенесены на своё место, в индекс не попадали, а запись с их именем - от прежней загрузки
+    if(m_uploadIndex)
+    {
+        for(size_t i = 0; i < m_uploadedCount; i++)
+        {
+            if(m_uploadedFiles[i].published)
+            {
+                m_uploadIndex->remove(m_uploadedFiles[i].filename);
+            }
+        }
     }
 }
 
+bool FileSaver::publishFiles()
+{
+    //Тело оборвано, не разобрано или сжатый поток повреждён - ни один файл запроса не заменяет существующий
+    if(m_state != FinishedRead)
+    {
+        discardFiles();
+        return false;
+    }
+
+    for(size_t i = 0; i < m_uploadedCount; i++)
+    {
+        UploadedFile& file = m_uploadedFiles[i];
+        if(file.published)
+        {
+            continue;
+        }
+
+        std::string path = (file.location.empty() ? m_dir : file.location) + "/" + file.filename;
+
+        if(!file.tempPath.empty() && !FileWriter::publish(file.tempPath, file.blobPath, path))
+        {
+            WRITE_TO_LOGGER("Error while storing file " + file.tempPath + " as " + path);
+
+            failUpload("Error while storing file " + file.filename);
+            discardFiles();
+            return false;
+        }
+
+        file.tempPath.clear();
+        file.published = true;
+
+        if(m_uploadIndex)
+        {
+            UploadIndex::Entry entry;
+            entry.name = file.filename;
+            entry.size = file.size;
+            entry.time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            entry.digest = m_sha256 ? file.sha256 : file.xxh64;
+
+            m_uploadIndex->put(entry);
+        }
+
+        if(m_metrics)
+        {
+            m_metrics->fileSaved();
+        }
+    }
+
+    return true;
+}
+
+void FileSaver::discardFiles()
+{
+    for(size_t i = 0; i < m_uploadedCount; i++)
+    {
+        UploadedFile& file = m_uploadedFiles[i];
+
+        if(!file.published && !file.tempPath.empty())
+        {
+            std::remove(file.tempPath.c_str());
+            file.tempPath.clear();
+        }
+    }
+}
+
+bool FileSaver::ready(std::function<void()> resume)
+{
+    return m_writer->ready(std::move(resume));
+}
+
 void FileSaver::setLogger(std::shared_ptr<spdlog::logger> newLogger)
 {
     m_logger = newLogger;
@@ -165,13 +549,225 @@ void FileSaver::setDir(std::string newDir)
     m_dir = newDir;
 }
 
-void FileSaver::addFileToDescriptionUploadedFiles(json& newDescriptionFile)
+void FileSaver::setWriterBackend(FileWriter::Backend backend, size_t bufferSize)
+{
+    m_writerBackend = backend;
+    m_writerBufferSize = bufferSize;
+    createWriter();
+}
+
+void FileSaver::setDiskWriteStage(std::shared_ptr<DiskWriteStage> stage, size_t maxPendingBytes)
+{
+    m_diskWriteStage = stage;
+    m_maxPendingBytes = maxPendingBytes;
+    createWriter();
+}
+
+bool FileSaver::checkFreeSpace()
+{
+    //Для сжатого тела свободное место запоминаем и без Content-Length: с ним сравнивается распакованный размер
+    if(m_contentLength == 0 && m_decoder.encoding() == BodyDecoder::Identity)
+    {
+        return true;
+    }
+
+    uint64_t available = 0;
+    std::string dir = m_dir;
+
+    if(m_storage)
+    {
+        //Файл целиком пишется в один каталог, поэтому сравниваем с самым свободным
+        for(size_t i = 0; i < m_storage->size(); i++)
+        {
+            uint64_t targetAvailable = m_storage->available(i);
+            if(i == 0 || targetAvailable > available)
+            {
+                available = targetAvailable;
+                dir = m_storage->target(i).dir;
+            }
+        }
+    }
+    else
+    {
+        struct statvfs info;
+        if(statvfs(m_dir.c_str(), &info) != 0)
+        {
+            //Не смогли узнать - не мешаем загрузке, при нехватке места ошибку даст запись
+            return true;
+        }
+
+        available = static_cast<uint64_t>(info.f_bavail) * info.f_frsize;
+    }
+
+    m_freeSpace = available;
+
+    if(available < m_contentLength)
+    {
+        m_notEnoughSpace = true;
+        setState(ErrorState);
+        setLastError("Not enough free space in " + dir + ": " + std::to_string(m_contentLength) +
+                     " bytes required, " + std::to_string(available) + " available");
+        return false;
+    }
+
+    return true;
+}
+
+void FileSaver::setMetrics(std::shared_ptr<Metrics> metrics)
+{
+    m_metrics = metrics;
+}
+
+void FileSaver::setContentAddressed(bool enabled, bool sha256)
+{
+    m_contentAddressed = enabled;
+    m_sha256 = sha256;
+
+    createBlobDirectories();
+}
+
+void FileSaver::setUploadIndex(std::shared_ptr<UploadIndex> uploadIndex)
+{
+    m_uploadIndex = uploadIndex;
+}
+
+void FileSaver::setStorage(std::shared_ptr<UploadStorage> storage)
+{
+    m_storage = storage;
+    createWriter();
+    createBlobDirectories();
+}
+
+void FileSaver::setDurability(std::shared_ptr<DurabilityCommitter> committer)
+{
+    m_committer = committer;
+}
+
+void FileSaver::setMaxDecodedSize(uint64_t maxDecodedSize)
+{
+    m_maxDecodedSize = maxDecodedSize;
+}
+
+void FileSaver::setDecodedQuota(std::function<bool(uint64_t)> charge)
+{
+    m_decodedQuota = std::move(charge);
+}
+
+bool FileSaver::chargeDecoded()
+{
+    //Content-Length сжатого тела ничего не говорит о том, сколько места займут файлы.
+    //Распакованные байты проверяем по мере распаковки, до записи на диск
+    uint64_t decoded = m_decoder.decodedBytes();
+
+    if(decoded > m_freeSpace)
+    {
+        setState(ErrorState);
+        setLastError("Not enough free space for decompressed body: " + std::to_string(decoded) +
+                     " bytes decompressed, " + std::to_string(m_freeSpace) + " available");
+        return false;
+    }
+
+    if(m_decodedQuota && !m_decodedQuota(decoded))
+    {
+        setState(ErrorState);
+        setLastError("Upload quota exceeded by decompressed body");
+        return false;
+    }
+
+    return true;
+}
+
+void FileSaver::createBlobDirectories()
 {
-    descriptionUploadedFiles.push_back(newDescriptionFile);
+    if(!m_contentAddressed)
+    {
+        return;
+    }
+
+    //Жёсткая ссылка возможна только в пределах файловой системы, у каждого каталога свой .blobs
+    size_t count = m_storage ? m_storage->size() : 1;
+    for(size_t i = 0; i < count; i++)
+    {
+        std::string blobs = (m_storage ? m_storage->target(i).dir : m_dir) + "/.blobs";
+
+        if(mkdir(blobs.c_str(), 0755) != 0 && errno != EEXIST)
+        {
+            WRITE_TO_LOGGER("Cannot create directory: " + blobs);
+        }
+    }
+}
+
+void FileSaver::createWriter()
+{
+    closeFileAndResetValues();
+
+    //Старые писатели дожидаются в деструкторе своих заданий в дисковых потоках
+    m_writer = nullptr;
+    m_writers.clear();
+
+    size_t count = m_storage ? m_storage->size() : 1;
+
+    for(size_t i = 0; i < count; i++)
+    {
+        std::unique_ptr<FileWriter> writer = FileWriter::create(m_writerBackend, m_writerBufferSize);
+
+        if(i == 0 && writer->backend() != m_writerBackend)
+        {
+            WRITE_TO_LOGGER("Writer " + FileWriter::backendName(m_writerBackend) + " is not available, using " + FileWriter::backendName(writer->backend()));
+        }
+
+        std::shared_ptr<DiskWriteStage> stage = m_storage ? m_storage->target(i).stage : m_diskWriteStage;
+        if(stage)
+        {
+            writer.reset(new AsyncFileWriter(stage, std::move(writer), m_maxPendingBytes));
+        }
+
+        m_writers.push_back(std::move(writer));
+    }
+
+    m_target = 0;
+    m_writer = m_writers[0].get();
+    m_writerUsed.assign(count, false);
+}
+
+void FileSaver::selectTarget()
+{
+    m_target = m_storage ? m_storage->choose(m_filename) : 0;
+    m_targetDir = m_storage ? m_storage->target(m_target).dir : m_dir;
+
+    m_writer = m_writers[m_target].get();
+    m_writerUsed[m_target] = true;
+}
+
+void FileSaver::setWindowSize(size_t newWindowSize)
+{
+    m_windowSize = std::max(newWindowSize, minWindowSize);
+    m_window.reserve(m_windowSize);
+}
+
+FileSaver::UploadedFile& FileSaver::addUploadedFile()
+{
+    if(m_uploadedCount == m_uploadedFiles.size())
+    {
+        m_uploadedFiles.emplace_back();
+    }
+
+    UploadedFile& file = m_uploadedFiles[m_uploadedCount++];
+    file.size = 0;
+    file.xxh64.clear();
+    file.sha256.clear();
+
+    return file;
 }
 
 void FileSaver::setState(FileSaverState newState)
 {
+    //Считаем ошибку по состоянию, в котором она произошла
+    if(m_metrics && newState == ErrorState && m_state != ErrorState)
+    {
+        m_metrics->parserError(m_state);
+    }
+
     m_state = newState;
 }
 
@@ -224,21 +820,41 @@ bool FileSaver::wasReadContentDisposition(std::string& line)
     m_filename = extractFilenameFromContentDisposition(line);
 
     //Открываем файл
-    if(!m_file.is_open())
+    if(!m_writer->isOpen())
     {
         if(m_filename.empty())
         {
             m_filename = "upload_" + std::to_string(std::time(nullptr)) + ".dat";
         }
 
-        m_file.open(m_dir + "/" + m_filename, std::ios::binary);
-        if(!m_file.is_open())
+        //Каталог выбирается для каждого файла, когда известно его имя
+        selectTarget();
+
+        //Пишем во временный файл, чтобы параллельные загрузки с одинаковым именем не писали в один файл.
+        //Под своим именем файл появится в publishFiles, только если всё тело разобрано без ошибок
+        m_tempPath = m_targetDir + "/." + m_filename + "." + std::to_string(tempFileCounter++) + ".part";
+
+        if(!m_writer->open(m_tempPath))
+        {
+            setLastError("Cannot open file: " + m_tempPath);
+            return false;
+        }
+
+        //Файл не больше оставшейся части тела. Резервируем её целиком, лишнее обрежется при закрытии.
+        //Размер распакованного тела заранее неизвестен, для сжатого тела не резервируем
+        if(m_decoder.encoding() == BodyDecoder::Identity && m_contentLength > m_bodyOffset &&
+           !m_writer->preallocate(m_contentLength - m_bodyOffset, false))
         {
-            setLastError("Cannot open file: " + m_dir + "/" + m_filename);
+            setLastError("Not enough free space in " + m_targetDir + " for file: " + m_filename);
             return false;
         }
 
         m_fileSize = 0;
+
+        if(m_contentAddressed)
+        {
+            m_hash.reset(true);
+        }
     }
 
     //После чтения Content-Disposition переходим к ожиданию новой строки
@@ -264,33 +880,9 @@ bool FileSaver::waitingData(std::string& line)
     return false;
 }
 
-bool FileSaver::wasReadData(std::string& line)
+bool FileSaver::wasReadData(const char* data, size_t size)
 {
-    if(!m_newline.empty())
-    {
-        bool result = writeLineToFile(m_newline);
-
-        m_newline.clear();
-
-        if(!result)
-        {
-            return result;
-        }
-    }
-
-
-    if(line.size() >= 2)
-    {
-        if(line[line.size() - 2] == '\r' && line[line.size() - 1] == '\n')
-        {
-            line.resize(line.size() - 2);
-
-            m_newline = "\r\n";
-        }
-    }
-
-
-    bool result = writeLineToFile(line);
+    bool result = writeDataToFile(data, size);
 
     if(!result)
     {
@@ -377,7 +969,7 @@ bool FileSaver::analyzeLine(std::string& line)
         }
         case WasReadData:
         {
-            return wasReadData(line);
+            return wasReadData(line.data(), line.size());
         }
         case WaitingBoundaryEnd:
         {
@@ -401,54 +993,253 @@ bool FileSaver::analyzeLine(std::string& line)
     }
 }
 
-bool FileSaver::readLineFromBuffer(std::istream& stream, std::string& line)
+bool FileSaver::analyzeData(const char* data, size_t size)
 {
-    line.clear();
+    //Участок данных файла допустим только после заголовков части
+    if(m_state == WasReadData)
+    {
+        return wasReadData(data, size);
+    }
 
-    if(std::getline(stream, line))
+    setLastError("Unexpected data in state: " + std::to_string(m_state));
+    return false;
+}
+
+bool FileSaver::processLine(std::string& line)
+{
+    //Определяем тип текущей строки
+    TypeLine lineType = getLineType(line);
+
+    //Выполняем переход состояния
+    FileSaverState newState = m_transitionTable[m_state][lineType];
+    setState(newState);
+
+    //Анализируем содержимое линии исходя из состояния
+    if(!analyzeLine(line))
     {
-        //Добавляем символ новой строки, так как он был удалён при getline
-        line.push_back('\n');
+        //Если одно из состояний вернуло false, значит произошла ошибка
+        setState(ErrorState);
+        return false;
+    }
 
-        return true;
+    return true;
+}
+
+bool FileSaver::processData(const char* data, size_t size)
+{
+    //Непрерывный участок данных файла проходит через ту же таблицу переходов, что и строки
+    FileSaverState newState = m_transitionTable[m_state][Data];
+    setState(newState);
+
+    //Анализируем участок данных исходя из состояния
+    if(!analyzeData(data, size))
+    {
+        setState(ErrorState);
+        return false;
     }
 
-    return false;
+    return true;
 }
 
-bool FileSaver::writeLineToFile(std::string& line)
+size_t FileSaver::processBuffer(const char* data, size_t size)
 {
-    if(!m_file.is_open())
+    size_t begin = 0;
+
+    while(begin < size && m_state != FinishedRead && m_state != ErrorState)
     {
-        setLastError("File" + m_dir + "/" + m_filename + " not open");
+        if(isDataState() && !m_boundaryPending)
+        {
+            //Всё до разделителя "\r\n--boundary" - данные текущего файла
+            size_t found = m_scanner.find(data + begin, size - begin);
+
+            if(found == std::string::npos)
+            {
+                //Хвост может оказаться началом разделителя, он останется до следующей порции
+                size_t length = m_scanner.safeLength(data + begin, size - begin);
+
+                if(length > 0 && processData(data + begin, length))
+                {
+                    begin += length;
+                }
+
+                break;
+            }
+
+            if(found > 0 && !processData(data + begin, found))
+            {
+                break;
+            }
+
+            //Пропускаем "\r\n" разделителя, дальше идёт строка boundary
+            begin += found + 2;
+            m_boundaryPending = true;
+            continue;
+        }
+
+        //Заголовки частей и boundary разбираем построчно
+        const char* end = static_cast<const char*>(std::memchr(data + begin, '\n', size - begin));
+        if(!end)
+        {
+            break;
+        }
+
+        size_t length = end - (data + begin) + 1;
+        m_line.assign(data + begin, length);
+        begin += length;
+
+        m_boundaryPending = false;
+        processLine(m_line);
+    }
+
+    return begin;
+}
+
+bool FileSaver::isDataState()
+{
+    return m_state == WaitingData || m_state == WaitingBoundaryEnd;
+}
+
+std::string FileSaver::makeResult() const
+{
+    std::string text;
+    JsonWriter writer(text);
+    writeResult(writer);
+
+    return text;
+}
+
+void FileSaver::writeResult(JsonWriter& writer) const
+{
+    writer.beginObject();
+
+    if(m_state != FinishedRead)
+    {
+        writer.field("status", "error")
+              .field("description", m_lastError)
+              .endObject();
+        return;
+    }
+
+    writer.field("status", "success")
+          .key("uploadedFiles")
+          .beginArray();
+
+    for(size_t i = 0; i < m_uploadedCount; i++)
+    {
+        const UploadedFile& file = m_uploadedFiles[i];
+
+        writer.beginObject()
+              .field("filename", file.filename)
+              .field("size", file.size);
+
+        if(!file.xxh64.empty())
+        {
+            writer.field("xxh64", file.xxh64);
+        }
+
+        if(!file.sha256.empty())
+        {
+            writer.field("sha256", file.sha256);
+        }
+
+        if(!file.location.empty())
+        {
+            writer.field("location", file.location);
+        }
+
+        writer.endObject();
+    }
+
+    writer.endArray();
+
+    if(m_decoder.encoding() != BodyDecoder::Identity)
+    {
+        uint64_t compressed = m_decoder.compressedBytes();
+        uint64_t decoded = m_decoder.decodedBytes();
+
+        writer.key("contentEncoding")
+              .beginObject()
+              .field("encoding", BodyDecoder::encodingName(m_decoder.encoding()))
+              .field("compressedBytes", compressed)
+              .field("decodedBytes", decoded)
+              .field("ratio", compressed > 0 ? static_cast<double>(decoded) / compressed : 0.0)
+              .field("cpuTimeUs", std::chrono::duration_cast<std::chrono::microseconds>(m_decoder.cpuTime()).count())
+              .endObject();
+    }
+
+    writer.endObject();
+}
+
+bool FileSaver::writeDataToFile(const char* data, size_t size)
+{
+    if(!m_writer->isOpen())
+    {
+        setLastError("File " + m_targetDir + "/" + m_filename + " not open");
+        return false;
+    }
+
+    //Хэш считаем, пока участок ещё в кэше процессора
+    if(m_contentAddressed)
+    {
+        m_hash.update(data, size);
+    }
+
+    //Записываем непрерывный участок данных целиком
+    if(!m_writer->write(data, size))
+    {
+        setLastError("Cannot write file: " + m_tempPath);
         return false;
     }
 
-    //Записываем данные с переводом строки
-    m_file << line;
-    m_fileSize += line.size();
+    m_fileSize += size;
+
+    if(m_metrics)
+    {
+        m_metrics->bytesWritten(size);
+    }
 
     return true;
 }
 
 void FileSaver::closeFileAndResetValues()
 {
-    if(m_file.is_open())
+    if(m_writer->isOpen())
     {
-        m_file.close();
+        UploadedFile& file = addUploadedFile();
+        file.filename = m_filename;
+        file.size = m_fileSize;
+        file.location = m_storage ? m_targetDir : std::string();
+        file.blobPath.clear();
+        file.published = false;
+
+        //У писателя Null файла нет, переносить нечего
+        file.tempPath = m_writer->backend() != FileWriter::Null ? m_tempPath : std::string();
 
-        json descriptionFile = {
-                                   {"filename", m_filename},
-                                   {"size", m_fileSize}
-                               };
+        if(m_contentAddressed)
+        {
+            file.xxh64 = m_hash.xxh64Digest();
+            file.sha256 = m_hash.sha256Digest();
+
+            file.blobPath = m_targetDir + "/.blobs/" + file.sha256;
+        }
 
-        addFileToDescriptionUploadedFiles(descriptionFile);
+        //На место файл переносит publishFiles, когда тело разобрано до конца и записано: оборванная
+        //или ошибочная загрузка не должна заменить прежний файл с тем же именем. У сжатого тела контрольная
+        //сумма проверяется только в конце потока, уже после последнего boundary.
+        //Асинхронный писатель закроет файл в дисковом потоке, ошибку сообщит whenWritten
+        if(!m_writer->close())
+        {
+            WRITE_TO_LOGGER("Error while writing file " + m_tempPath);
+
+            setState(ErrorState);
+            setLastError("Cannot write file: " + m_filename);
+        }
 
-        WRITE_TO_LOGGER("Was saved file: " + m_filename + ", size: " + std::to_string(m_fileSize));
+        WRITE_TO_LOGGER("Was received file: " + m_filename + ", size: " + std::to_string(m_fileSize));
 
         //Сбрасываем для следующего файла
-        m_newline.clear();
         m_filename.clear();
+        m_tempPath.clear();
         m_fileSize = 0;
     }
 }
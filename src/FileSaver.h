@@ -3,19 +3,28 @@
 
 #include <string>
 #include <list>
+#include <vector>
 #include <cstdint>
-
-#include <nlohmann/json.hpp>
-
-#include <fstream>
+#include <memory>
+#include <functional>
 #include <unordered_map>
 
 #include "utility.hpp"
 
+#include "BoundaryScanner.h"
+#include "ContentHash.h"
+#include "FileWriter.h"
+#include "DiskWriteStage.h"
+#include "Metrics.h"
+#include "UploadIndex.h"
+#include "UploadStorage.h"
+#include "DurabilityCommitter.h"
+#include "BodyDecoder.h"
+#include "JsonWriter.h"
+
 #include "spdlog/logger.h"
 
 
-using json = nlohmann::json;
 using namespace SimpleWeb;
 
 class FileSaver
@@ -52,33 +61,153 @@ public:
         QuantityTypeLine     //Количество типов
     };
 
+    //Результат проверки заголовков запроса, известен до чтения тела
+    enum Admission : uint8_t
+    {
+        Accepted,
+        InvalidHeader,      //Нет Content-Type multipart/form-data с boundary
+        NotEnoughSpace,     //Тело по Content-Length не поместится на диск
+        UnsupportedEncoding //Content-Encoding, который эта сборка не умеет распаковывать
+    };
+
     FileSaver();
 
     void setRequestHeader(const CaseInsensitiveMultimap& headers);
-    json processStream(std::istream& stream);
+
+    //Можно ли читать тело после setRequestHeader. Если нет, причину вернёт finishStream
+    Admission admission() const;
+    //Синхронный разбор, возвращает JSON ответа /upload
+    std::string processStream(std::istream& stream);
+
+    //Потоковый режим: тело запроса подаётся порциями по мере чтения из сокета.
+    //Тело с Content-Encoding gzip или zstd распаковывается здесь же, перед разбором
+    bool processChunk(const char* data, size_t size);
+    std::string finishStream();
+
+    //Асинхронное завершение: callback вызывается, когда все файлы записаны на диск (возможно, из дискового потока).
+    //Результат внутри callback записывается через writeResult
+    void finishStream(std::function<void()> callback);
+
+    //Завершение оборванного запроса: файлы запроса удаляются, даже если тело успело разобраться целиком
+    void abortStream(std::function<void()> callback);
+
+    //Результат загрузки: {"status": "success", "uploadedFiles": [...]} или {"status": "error", "description": ...}.
+    //Пишется сразу в буфер ответа, без дерева json
+    void writeResult(JsonWriter& writer) const;
+
+    //Можно ли подавать следующую порцию. При false FileSaver вызовет resume, когда запись на диск догонит сеть
+    bool ready(std::function<void()> resume);
 
     void setLogger(std::shared_ptr<spdlog::logger> newLogger);
 
     void setDir(std::string newDir);
 
+    //Размер окна - максимальный объём тела запроса, который хранится в памяти
+    void setWindowSize(size_t newWindowSize);
+
+    //Способ записи файлов на диск. bufferSize - память писателя под открытый файл, см. FileWriter::create
+    void setWriterBackend(FileWriter::Backend backend, size_t bufferSize = 1024 * 1024);
+
+    //Запись на диск в отдельных потоках. Не больше maxPendingBytes данных ждут записи, дальше ready() вернёт false
+    void setDiskWriteStage(std::shared_ptr<DiskWriteStage> stage, size_t maxPendingBytes);
+
+    void setMetrics(std::shared_ptr<Metrics> metrics);
+
+    //Хранение по содержимому: файл сохраняется в .blobs под своим SHA-256, а имя из запроса становится
+    //жёсткой ссылкой на него, одинаковые файлы хранятся один раз. Хэш считается по мере записи.
+    //Ключ blob - только SHA-256: при совпадении ключа новое содержимое заменяется старым без сравнения,
+    //а для XXH64 коллизию можно подобрать. XXH64 считается всегда и возвращается как быстрый дайджест.
+    //sha256 - записывать в индекс SHA-256 вместо XXH64. Вызывать после setDir
+    void setContentAddressed(bool enabled, bool sha256);
+
+    //Индекс, в который записывается каждый сохранённый файл
+    void setUploadIndex(std::shared_ptr<UploadIndex> uploadIndex);
+
+    //Файлы расходятся по каталогам хранилища, в каждый пишет свой писатель через дисковые потоки каталога.
+    //Каталог файла попадает в результат как "location". Без хранилища все файлы пишутся в каталог setDir
+    void setStorage(std::shared_ptr<UploadStorage> storage);
+
+    //Ответ (callback finishStream) ждёт, пока файлы запроса не будут сброшены на диск
+    void setDurability(std::shared_ptr<DurabilityCommitter> committer);
+
+    //Сжатое тело не может распаковаться больше чем в maxDecodedSize байт, 0 - без ограничения
+    void setMaxDecodedSize(uint64_t maxDecodedSize);
+
+    //Квота на распакованные байты текущего запроса: charge получает, сколько всего байт распаковано,
+    //до разбора каждого куска. false - загрузка прерывается. Сбрасывается следующим setRequestHeader
+    void setDecodedQuota(std::function<bool(uint64_t)> charge);
+
 private:
     std::string m_dir;
     FileSaverState m_state;
     std::string m_filename;
-    std::ofstream m_file;
+    std::string m_tempPath;
+    size_t m_target;            //Номер каталога текущего файла в хранилище
+    std::string m_targetDir;    //Каталог текущего файла
     std::string m_boundary;
     std::string m_boundaryExtended;
     std::string m_boundaryEnd;
-    std::string m_newline;
+
+    BoundaryScanner m_scanner;  //Поиск "\r\n--boundary" в данных файла
+    bool m_boundaryPending;     //Разделитель найден, следующая строка - boundary
 
     size_t m_fileSize;
 
+    uint64_t m_contentLength;   //Content-Length запроса, 0 - неизвестен
+    uint64_t m_bodyReceived;    //Получено байт тела
+    uint64_t m_bodyOffset;      //Смещение в теле начала текущей порции
+    bool m_notEnoughSpace;      //Загрузку отклонила проверка свободного места
+    bool m_unsupportedEncoding;
+
+    BodyDecoder m_decoder;      //Распаковка тела перед разбором
+    uint64_t m_maxDecodedSize;
+    uint64_t m_freeSpace;       //Свободно в каталоге загрузки по проверке перед чтением тела
+    std::function<bool(uint64_t)> m_decodedQuota;
+
+    size_t m_windowSize;
+    std::string m_window;       //Ещё не разобранные байты тела запроса
+    std::string m_line;
+
+    std::vector<std::unique_ptr<FileWriter>> m_writers;    //По одному на каталог хранилища
+    FileWriter* m_writer;                                  //Писатель каталога текущего файла
+    std::vector<bool> m_writerUsed;                        //В каталог писались файлы этого запроса
+    FileWriter::Backend m_writerBackend;
+    size_t m_writerBufferSize;
+    std::shared_ptr<DiskWriteStage> m_diskWriteStage;
+    size_t m_maxPendingBytes;
+
     std::shared_ptr<spdlog::logger> m_logger;
+    std::shared_ptr<Metrics> m_metrics;
+
+    bool m_contentAddressed;
+    bool m_sha256;
+    ContentHash m_hash;
+
+    std::shared_ptr<UploadIndex> m_uploadIndex;
+    std::shared_ptr<UploadStorage> m_storage;
+    std::shared_ptr<DurabilityCommitter> m_committer;
 
     std::string m_lastError;
 
-    json descriptionUploadedFiles;
-    void addFileToDescriptionUploadedFiles(json& newDescriptionFile);
+    //Описания сохранённых файлов запроса. Записи переиспользуются следующими запросами вместе с памятью строк,
+    //действительны первые m_uploadedCount
+    struct UploadedFile
+    {
+        std::string filename;
+        uint64_t size;
+        std::string xxh64;
+        std::string sha256;
+        std::string location;   //Каталог хранилища
+
+        //До конца тела файл лежит во временном tempPath и в индекс не попадает
+        std::string tempPath;
+        std::string blobPath;
+        bool published;         //Перенесён на своё место и записан в индекс
+    };
+
+    std::vector<UploadedFile> m_uploadedFiles;
+    size_t m_uploadedCount;
+    UploadedFile& addUploadedFile();
 
     void setState(FileSaverState newState);
     void setLastError(std::string newLastError);
@@ -112,17 +241,32 @@ private:
     bool waitingNewLine(std::string& line);
     bool wasReadNewLine(std::string& line);
     bool waitingData(std::string& line);
-    bool wasReadData(std::string& line);
+    bool wasReadData(const char* data, size_t size);
     bool waitingBoundaryEnd(std::string& line);
     bool wasReadBoundaryEnd(std::string& line);
     bool finishedRead(std::string& line);
     bool errorState(std::string& line);
 
     bool analyzeLine(std::string& line);
+    bool analyzeData(const char* data, size_t size);
+    bool processLine(std::string& line);
+    bool processData(const char* data, size_t size);
+    bool parseChunk(const char* data, size_t size);
+    size_t processBuffer(const char* data, size_t size);
+    bool isDataState();
 
-    bool readLineFromBuffer(std::istream& stream, std::string& line);
+    std::string makeResult() const;
 
-    bool writeLineToFile(std::string& line);
+    void createWriter();
+    void createBlobDirectories();
+    void selectTarget();
+    void commitFiles(std::function<void()> callback);
+    void failUpload(const std::string& error);
+    bool publishFiles();
+    void discardFiles();
+    bool checkFreeSpace();
+    bool chargeDecoded();
+    bool writeDataToFile(const char* data, size_t size);
     void closeFileAndResetValues();
 
     TypeLine getLineType(std::string& line);
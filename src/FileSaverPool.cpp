@@ -0,0 +1,152 @@
+#include "FileSaverPool.h"
+
+
+FileSaverPool::FileSaverPool(std::string dir, size_t windowSize, FileWriter::Backend writerBackend,
+                             std::shared_ptr<spdlog::logger> logger, size_t maxIdle) :
+               m_dir(dir),
+               m_windowSize(windowSize),
+               m_writerBackend(writerBackend),
+               m_writerBufferSize(1024 * 1024),
+               m_logger(logger),
+               m_maxIdle(maxIdle),
+               m_maxPendingBytes(0),
+               m_contentAddressed(false),
+               m_sha256(false),
+               m_maxDecodedSize(0)
+{
+}
+
+void FileSaverPool::setDiskWriteStage(std::shared_ptr<DiskWriteStage> stage, size_t maxPendingBytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_diskWriteStage = stage;
+    m_maxPendingBytes = maxPendingBytes;
+
+    //Простаивающие FileSaver созданы со старыми настройками
+    m_idle.clear();
+}
+
+void FileSaverPool::setMetrics(std::shared_ptr<Metrics> metrics)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_metrics = metrics;
+    m_idle.clear();
+}
+
+void FileSaverPool::setWriterBufferSize(size_t bufferSize)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_writerBufferSize = bufferSize;
+    m_idle.clear();
+}
+
+void FileSaverPool::setContentAddressed(bool enabled, bool sha256)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_contentAddressed = enabled;
+    m_sha256 = sha256;
+    m_idle.clear();
+}
+
+void FileSaverPool::setUploadIndex(std::shared_ptr<UploadIndex> uploadIndex)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_uploadIndex = uploadIndex;
+    m_idle.clear();
+}
+
+void FileSaverPool::setStorage(std::shared_ptr<UploadStorage> storage)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_storage = storage;
+    m_idle.clear();
+}
+
+void FileSaverPool::setMaxDecodedSize(uint64_t maxDecodedSize)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_maxDecodedSize = maxDecodedSize;
+    m_idle.clear();
+}
+
+void FileSaverPool::setDurability(std::shared_ptr<DurabilityCommitter> committer)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_committer = committer;
+    m_idle.clear();
+}
+
+std::shared_ptr<FileSaver> FileSaverPool::acquire()
+{
+    std::unique_ptr<FileSaver> fileSaver;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if(!m_idle.empty())
+        {
+            fileSaver = std::move(m_idle.back());
+            m_idle.pop_back();
+        }
+    }
+
+    if(!fileSaver)
+    {
+        fileSaver.reset(new FileSaver());
+        fileSaver->setLogger(m_logger);
+        fileSaver->setDir(m_dir);
+        fileSaver->setWindowSize(m_windowSize);
+        fileSaver->setWriterBackend(m_writerBackend, m_writerBufferSize);
+
+        if(m_diskWriteStage)
+        {
+            fileSaver->setDiskWriteStage(m_diskWriteStage, m_maxPendingBytes);
+        }
+
+        if(m_storage)
+        {
+            fileSaver->setStorage(m_storage);
+        }
+
+        fileSaver->setMetrics(m_metrics);
+        fileSaver->setContentAddressed(m_contentAddressed, m_sha256);
+        fileSaver->setUploadIndex(m_uploadIndex);
+        fileSaver->setDurability(m_committer);
+        fileSaver->setMaxDecodedSize(m_maxDecodedSize);
+    }
+
+    //Пул может быть уничтожен раньше, чем закончится запрос, поэтому держим на него weak_ptr
+    std::weak_ptr<FileSaverPool> pool = shared_from_this();
+
+    return std::shared_ptr<FileSaver>(fileSaver.release(), [pool](FileSaver* fileSaver)
+                                      {
+                                          if(auto owner = pool.lock())
+                                          {
+                                              owner->release(fileSaver);
+                                          }
+                                          else
+                                          {
+                                              delete fileSaver;
+                                          }
+                                      });
+}
+
+void FileSaverPool::release(FileSaver* fileSaver)
+{
+    std::unique_ptr<FileSaver> released(fileSaver);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if(m_idle.size() < m_maxIdle)
+    {
+        m_idle.push_back(std::move(released));
+    }
+}
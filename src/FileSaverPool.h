@@ -0,0 +1,72 @@
+#ifndef FILE_SAVER_POOL_H
+#define FILE_SAVER_POOL_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "FileSaver.h"
+
+
+//Пул FileSaver: каждый запрос /upload получает собственный FileSaver, после запроса он возвращается в пул.
+//Повторное использование сохраняет уже выделенные окно и буферы
+class FileSaverPool : public std::enable_shared_from_this<FileSaverPool>
+{
+public:
+    FileSaverPool(std::string dir, size_t windowSize, FileWriter::Backend writerBackend,
+                  std::shared_ptr<spdlog::logger> logger, size_t maxIdle);
+
+    //Запись файлов в дисковых потоках. Без стадии FileSaver пишет синхронно
+    void setDiskWriteStage(std::shared_ptr<DiskWriteStage> stage, size_t maxPendingBytes);
+
+    void setMetrics(std::shared_ptr<Metrics> metrics);
+
+    //Память писателя под открытый файл, см. FileWriter::create
+    void setWriterBufferSize(size_t bufferSize);
+
+    //Хранение файлов по содержимому, см. FileSaver::setContentAddressed
+    void setContentAddressed(bool enabled, bool sha256);
+
+    void setUploadIndex(std::shared_ptr<UploadIndex> uploadIndex);
+
+    //Раскладка файлов по нескольким каталогам, см. FileSaver::setStorage
+    void setStorage(std::shared_ptr<UploadStorage> storage);
+
+    //Сброс файлов на диск перед ответом, см. FileSaver::setDurability
+    void setDurability(std::shared_ptr<DurabilityCommitter> committer);
+
+    //Предел распакованного тела сжатой загрузки, см. FileSaver::setMaxDecodedSize
+    void setMaxDecodedSize(uint64_t maxDecodedSize);
+
+    //FileSaver вернётся в пул, когда освободится последний shared_ptr на него
+    std::shared_ptr<FileSaver> acquire();
+
+private:
+    std::string m_dir;
+    size_t m_windowSize;
+    FileWriter::Backend m_writerBackend;
+    size_t m_writerBufferSize;
+    std::shared_ptr<spdlog::logger> m_logger;
+    size_t m_maxIdle;
+
+    std::shared_ptr<DiskWriteStage> m_diskWriteStage;
+    size_t m_maxPendingBytes;
+
+    std::shared_ptr<Metrics> m_metrics;
+
+    bool m_contentAddressed;
+    bool m_sha256;
+
+    std::shared_ptr<UploadIndex> m_uploadIndex;
+    std::shared_ptr<UploadStorage> m_storage;
+    std::shared_ptr<DurabilityCommitter> m_committer;
+    uint64_t m_maxDecodedSize;
+
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<FileSaver>> m_idle;
+
+    void release(FileSaver* fileSaver);
+};
+
+#endif //FILE_SAVER_POOL_H
@@ -0,0 +1,150 @@
+#include "FileWriter.h"
+
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "StreamFileWriter.h"
+#include "PwritevFileWriter.h"
+#include "IoUringFileWriter.h"
+#include "NullFileWriter.h"
+
+
+std::unique_ptr<FileWriter> FileWriter::create(Backend backend, size_t bufferSize)
+{
+    switch(backend)
+    {
+        case IoUring:
+        {
+            if(IoUringFileWriter::isSupported())
+            {
+                return std::unique_ptr<FileWriter>(new IoUringFileWriter(bufferSize));
+            }
+
+            return std::unique_ptr<FileWriter>(new PwritevFileWriter(bufferSize));
+        }
+        case Pwritev:
+        {
+            return std::unique_ptr<FileWriter>(new PwritevFileWriter(bufferSize));
+        }
+        case Null:
+        {
+            return std::unique_ptr<FileWriter>(new NullFileWriter());
+        }
+        case Stream:
+        default:
+        {
+            return std::unique_ptr<FileWriter>(new StreamFileWriter());
+        }
+    }
+}
+
+std::string FileWriter::backendName(Backend backend)
+{
+    switch(backend)
+    {
+        case Stream:
+        {
+            return "ofstream";
+        }
+        case Pwritev:
+        {
+            return "pwritev";
+        }
+        case IoUring:
+        {
+            return "io_uring";
+        }
+        case Null:
+        {
+            return "null";
+        }
+        default:
+            return "unknown";
+    }
+}
+
+bool FileWriter::closeAndRename(const std::string& path, const std::string& newPath)
+{
+    return closeAndLink(path, "", newPath);
+}
+
+bool FileWriter::closeAndLink(const std::string& path, const std::string& blobPath, const std::string& newPath)
+{
+    //Недописанный файл не должен заменить прежний newPath
+    if(!close())
+    {
+        std::remove(path.c_str());
+        return false;
+    }
+
+    return publish(path, blobPath, newPath);
+}
+
+bool FileWriter::publish(const std::string& path, const std::string& blobPath, const std::string& newPath)
+{
+    if(blobPath.empty())
+    {
+        return std::rename(path.c_str(), newPath.c_str()) == 0;
+    }
+
+    if(link(path.c_str(), blobPath.c_str()) != 0)
+    {
+        if(errno != EEXIST)
+        {
+            std::remove(path.c_str());
+            return false;
+        }
+
+        //Такое содержимое уже хранится - новую копию заменяем ссылкой на blob
+        if(std::remove(path.c_str()) != 0 || link(blobPath.c_str(), path.c_str()) != 0)
+        {
+            return false;
+        }
+    }
+
+    //path и blob - один и тот же файл, переименование заменит существующий newPath атомарно
+    return std::rename(path.c_str(), newPath.c_str()) == 0;
+}
+
+bool FileWriter::preallocate(uint64_t /*size*/, bool /*keepSize*/)
+{
+    return true;
+}
+
+bool FileWriter::allocateSpace(int fd, off_t offset, uint64_t size, bool keepSize, bool& allocated)
+{
+    allocated = false;
+
+    if(fd < 0 || size == 0)
+    {
+        return true;
+    }
+
+    //posix_fallocate не подходит: там, где fallocate не поддерживается, он пишет нули во весь размер
+    int result;
+    do
+    {
+        result = fallocate(fd, keepSize ? FALLOC_FL_KEEP_SIZE : 0, offset, static_cast<off_t>(size));
+    }
+    while(result != 0 && errno == EINTR);
+
+    if(result == 0)
+    {
+        allocated = !keepSize;
+        return true;
+    }
+
+    return errno != ENOSPC && errno != EFBIG;
+}
+
+bool FileWriter::ready(std::function<void()> /*resume*/)
+{
+    return true;
+}
+
+void FileWriter::whenWritten(std::function<void(bool)> callback)
+{
+    callback(true);
+}
@@ -0,0 +1,74 @@
+#ifndef FILE_WRITER_H
+#define FILE_WRITER_H
+
+#include <string>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <sys/types.h>
+
+
+//Запись на диск файла, который сохраняет FileSaver
+class FileWriter
+{
+public:
+    //Способы записи
+    enum Backend : uint8_t
+    {
+        Stream,         //std::ofstream, базовый вариант для сравнения
+        Pwritev,        //Крупный выровненный буфер, запись через pwritev
+        IoUring,        //Асинхронная запись пачками через io_uring
+        Null,           //Ничего не пишет, для измерения разбора без диска
+        QuantityBackend //Количество способов
+    };
+
+    virtual ~FileWriter() = default;
+
+    virtual bool open(const std::string& path) = 0;
+
+    //Открывает ранее начатый файл и продолжает запись с offset, всё после offset отбрасывается
+    virtual bool reopen(const std::string& path, uint64_t offset) = 0;
+
+    virtual bool write(const char* data, size_t size) = 0;
+
+    //Дописывает накопленные данные и закрывает файл. false - часть данных записать не удалось
+    virtual bool close() = 0;
+
+    //Резервирует место под size байт после текущей позиции, при закрытии файл обрезается до записанного.
+    //keepSize - размер файла не меняется, место резервируется за его концом: размер файла тогда всегда равен
+    //записанному, даже если процесс упал до закрытия.
+    //false - на диске не хватает места. Если способ записи или файловая система не умеют резервировать, ничего не делает
+    virtual bool preallocate(uint64_t size, bool keepSize);
+
+    //Закрывает файл и переименовывает path в newPath. Если дописать файл не удалось, path удаляется, newPath не меняется
+    virtual bool closeAndRename(const std::string& path, const std::string& newPath);
+
+    //Закрывает файл и сохраняет его как blobPath, если такого blob ещё нет, иначе path удаляется.
+    //newPath становится жёсткой ссылкой на blob
+    virtual bool closeAndLink(const std::string& path, const std::string& blobPath, const std::string& newPath);
+
+    //Переносит уже закрытый файл path в newPath, как closeAndRename, или через blobPath, как closeAndLink.
+    //blobPath пустой - простое переименование
+    static bool publish(const std::string& path, const std::string& blobPath, const std::string& newPath);
+
+    //Можно ли принимать новые данные. Синхронная запись готова всегда,
+    //асинхронная при false вызовет resume, когда разгрузит очередь
+    virtual bool ready(std::function<void()> resume);
+
+    //Вызывает callback, когда всё переданное ранее записано на диск. false - была ошибка записи
+    virtual void whenWritten(std::function<void(bool)> callback);
+
+    virtual bool isOpen() const = 0;
+    virtual Backend backend() const = 0;
+
+    //Если io_uring недоступен в ядре, вместо него создаётся Pwritev.
+    //bufferSize - память под данные одного открытого файла, выделяется только пока файл открыт
+    static std::unique_ptr<FileWriter> create(Backend backend, size_t bufferSize = 1024 * 1024);
+    static std::string backendName(Backend backend);
+
+protected:
+    //fallocate без эмуляции записью нулей. allocated - место действительно зарезервировано и файл расширен, при keepSize не расширяется никогда
+    static bool allocateSpace(int fd, off_t offset, uint64_t size, bool keepSize, bool& allocated);
+};
+
+#endif //FILE_WRITER_H
@@ -0,0 +1,494 @@
+#include "IoUringFileWriter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+
+//Выравнивание буферов по странице
+const size_t bufferAlignment = 4096;
+
+IoUringFileWriter::IoUringFileWriter(size_t bufferSize, unsigned bufferCount) :
+                   m_ringFd(-1),
+                   m_sqRing(nullptr),
+                   m_sqRingSize(0),
+                   m_cqRing(nullptr),
+                   m_cqRingSize(0),
+                   m_sqes(nullptr),
+                   m_sqesSize(0),
+                   m_sqTail(nullptr),
+                   m_sqMask(nullptr),
+                   m_sqArray(nullptr),
+                   m_cqHead(nullptr),
+                   m_cqTail(nullptr),
+                   m_cqMask(nullptr),
+                   m_cqes(nullptr),
+                   m_unsubmitted(0),
+                   m_inFlight(0),
+                   m_bufferCount(std::max(1u, bufferCount)),
+                   m_current(0),
+                   m_fd(-1),
+                   m_offset(0),
+                   m_failed(false),
+                   m_allocated(false)
+{
+    //Каждый буфер - целое число страниц
+    m_bufferSize = bufferSize / m_bufferCount;
+    m_bufferSize = std::max(bufferAlignment, (m_bufferSize + bufferAlignment - 1) / bufferAlignment * bufferAlignment);
+}
+
+IoUringFileWriter::~IoUringFileWriter()
+{
+    close();
+    releaseBuffers();
+    destroyRing();
+}
+
+bool IoUringFileWriter::isSupported()
+{
+    static const bool supported = []()
+    {
+        struct io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+
+        int ringFd = static_cast<int>(syscall(__NR_io_uring_setup, 1, &params));
+        if(ringFd < 0)
+        {
+            return false;
+        }
+
+        ::close(ringFd);
+        return true;
+    }();
+
+    return supported;
+}
+
+bool IoUringFileWriter::open(const std::string& path)
+{
+    close();
+
+    if(!prepare())
+    {
+        return false;
+    }
+
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    m_offset = 0;
+    m_failed = false;
+    m_allocated = false;
+    m_current = 0;
+    m_buffers[m_current].used = 0;
+
+    return m_fd >= 0;
+}
+
+bool IoUringFileWriter::reopen(const std::string& path, uint64_t offset)
+{
+    close();
+
+    if(!prepare())
+    {
+        return false;
+    }
+
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    m_offset = offset;
+    m_failed = false;
+    m_allocated = false;
+    m_current = 0;
+    m_buffers[m_current].used = 0;
+
+    if(m_fd < 0)
+    {
+        return false;
+    }
+
+    if(ftruncate(m_fd, m_offset) != 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+bool IoUringFileWriter::write(const char* data, size_t size)
+{
+    if(m_fd < 0 || m_failed)
+    {
+        return false;
+    }
+
+    while(size > 0)
+    {
+        Buffer& buffer = m_buffers[m_current];
+
+        size_t portion = std::min(size, m_bufferSize - buffer.used);
+        std::memcpy(buffer.data + buffer.used, data, portion);
+        buffer.used += portion;
+
+        data += portion;
+        size -= portion;
+
+        if(buffer.used == m_bufferSize)
+        {
+            queueCurrentBuffer();
+
+            //Накопилась пачка - отдаём её ядру, не дожидаясь завершения
+            if(m_unsubmitted >= std::max<size_t>(1, m_buffers.size() / 2) && !submit(0))
+            {
+                return false;
+            }
+
+            if(!selectFreeBuffer())
+            {
+                return false;
+            }
+        }
+    }
+
+    return !m_failed;
+}
+
+bool IoUringFileWriter::close()
+{
+    if(m_fd < 0)
+    {
+        return true;
+    }
+
+    if(m_buffers[m_current].used > 0)
+    {
+        queueCurrentBuffer();
+    }
+
+    //Дожидаемся завершения всех записей
+    while(m_unsubmitted > 0 || m_inFlight > 0)
+    {
+        if(!submit(1))
+        {
+            break;
+        }
+    }
+
+    //Отдаём неиспользованный остаток зарезервированного места
+    if(m_allocated && ftruncate(m_fd, m_offset) != 0)
+    {
+        m_failed = true;
+    }
+
+    if(::close(m_fd) != 0)
+    {
+        m_failed = true;
+    }
+
+    m_fd = -1;
+    m_current = 0;
+
+    //Все записи завершены или кольцо сломано, ядро буферы больше не читает
+    if(m_inFlight == 0)
+    {
+        releaseBuffers();
+    }
+
+    return !m_failed;
+}
+
+bool IoUringFileWriter::preallocate(uint64_t size, bool keepSize)
+{
+    if(m_fd < 0)
+    {
+        return true;
+    }
+
+    bool allocated = false;
+    bool result = allocateSpace(m_fd, m_offset + m_buffers[m_current].used, size, keepSize, allocated);
+    m_allocated = m_allocated || allocated;
+
+    return result;
+}
+
+bool IoUringFileWriter::isOpen() const
+{
+    return m_fd >= 0;
+}
+
+FileWriter::Backend IoUringFileWriter::backend() const
+{
+    return IoUring;
+}
+
+bool IoUringFileWriter::setupRing(unsigned entries)
+{
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    m_ringFd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if(m_ringFd < 0)
+    {
+        m_ringFd = -1;
+        return false;
+    }
+
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    //Новые ядра отображают кольца отправки и завершения одним mmap
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if(singleMmap)
+    {
+        m_sqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+        m_cqRingSize = m_sqRingSize;
+    }
+
+    void* sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+    if(sqRing == MAP_FAILED)
+    {
+        destroyRing();
+        return false;
+    }
+
+    m_sqRing = sqRing;
+
+    if(singleMmap)
+    {
+        m_cqRing = m_sqRing;
+    }
+    else
+    {
+        void* cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING);
+        if(cqRing == MAP_FAILED)
+        {
+            destroyRing();
+            return false;
+        }
+
+        m_cqRing = cqRing;
+    }
+
+    m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED)
+    {
+        destroyRing();
+        return false;
+    }
+
+    m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(m_sqRing);
+    m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    m_sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    char* cq = static_cast<char*>(m_cqRing);
+    m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    m_cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+void IoUringFileWriter::destroyRing()
+{
+    if(m_sqes)
+    {
+        munmap(m_sqes, m_sqesSize);
+    }
+
+    if(m_cqRing && m_cqRing != m_sqRing)
+    {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+
+    if(m_sqRing)
+    {
+        munmap(m_sqRing, m_sqRingSize);
+    }
+
+    if(m_ringFd >= 0)
+    {
+        ::close(m_ringFd);
+    }
+
+    m_ringFd = -1;
+    m_sqRing = nullptr;
+    m_cqRing = nullptr;
+    m_sqes = nullptr;
+}
+
+bool IoUringFileWriter::prepare()
+{
+    if(m_ringFd < 0 && !setupRing(m_bufferCount))
+    {
+        return false;
+    }
+
+    while(m_buffers.size() < m_bufferCount)
+    {
+        void* data = nullptr;
+
+        if(posix_memalign(&data, bufferAlignment, m_bufferSize) != 0)
+        {
+            releaseBuffers();
+            return false;
+        }
+
+        m_buffers.push_back({static_cast<char*>(data), 0, 0, false, {}});
+    }
+
+    return true;
+}
+
+void IoUringFileWriter::releaseBuffers()
+{
+    for(Buffer& buffer : m_buffers)
+    {
+        std::free(buffer.data);
+    }
+
+    m_buffers.clear();
+}
+
+void IoUringFileWriter::queueCurrentBuffer()
+{
+    Buffer& buffer = m_buffers[m_current];
+
+    buffer.offset = m_offset;
+    buffer.busy = true;
+    m_offset += buffer.used;
+
+    unsigned tail = *m_sqTail;
+    unsigned index = tail & *m_sqMask;
+
+    //Буферов не больше, чем мест в кольце, поэтому свободное место в нём всегда есть
+    //IORING_OP_WRITEV вместо IORING_OP_WRITE, чтобы работать и на ядрах до 5.6
+    buffer.iov.iov_base = buffer.data;
+    buffer.iov.iov_len = buffer.used;
+
+    io_uring_sqe* sqe = &m_sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = m_fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&buffer.iov);
+    sqe->len = 1;
+    sqe->off = static_cast<uint64_t>(buffer.offset);
+    sqe->user_data = m_current;
+
+    m_sqArray[index] = index;
+    __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    m_unsubmitted++;
+}
+
+bool IoUringFileWriter::submit(unsigned waitCount)
+{
+    unsigned flags = (waitCount > 0) ? IORING_ENTER_GETEVENTS : 0;
+
+    while(true)
+    {
+        int result = static_cast<int>(syscall(__NR_io_uring_enter, m_ringFd, m_unsubmitted, waitCount, flags, nullptr, 0));
+
+        if(result < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            m_failed = true;
+            return false;
+        }
+
+        m_unsubmitted -= static_cast<unsigned>(result);
+        m_inFlight += static_cast<unsigned>(result);
+        break;
+    }
+
+    reapCompletions();
+    return true;
+}
+
+void IoUringFileWriter::reapCompletions()
+{
+    unsigned head = *m_cqHead;
+    unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+
+    while(head != tail)
+    {
+        const io_uring_cqe& cqe = m_cqes[head & *m_cqMask];
+        Buffer& buffer = m_buffers[cqe.user_data];
+
+        if(cqe.res < 0)
+        {
+            m_failed = true;
+        }
+        else
+        {
+            //Короткая запись - остаток дописываем синхронно
+            size_t done = static_cast<size_t>(cqe.res);
+
+            while(done < buffer.used)
+            {
+                ssize_t written = pwrite(m_fd, buffer.data + done, buffer.used - done, buffer.offset + done);
+
+                if(written < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+
+                if(written <= 0)
+                {
+                    m_failed = true;
+                    break;
+                }
+
+                done += static_cast<size_t>(written);
+            }
+        }
+
+        buffer.busy = false;
+        buffer.used = 0;
+        m_inFlight--;
+        head++;
+    }
+
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+}
+
+bool IoUringFileWriter::selectFreeBuffer()
+{
+    while(true)
+    {
+        reapCompletions();
+
+        for(size_t i = 1; i <= m_buffers.size(); i++)
+        {
+            size_t index = (m_current + i) % m_buffers.size();
+
+            if(!m_buffers[index].busy)
+            {
+                m_current = index;
+                m_buffers[index].used = 0;
+                return true;
+            }
+        }
+
+        //Все буферы у ядра - отправляем накопленное и ждём хотя бы одно завершение
+        if(!submit(1))
+        {
+            return false;
+        }
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef IO_URING_FILE_WRITER_H
+#define IO_URING_FILE_WRITER_H
+
+#include <vector>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "FileWriter.h"
+
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+//Асинхронная запись через io_uring. Данные копируются в один из нескольких выровненных буферов,
+//заполненные буферы копятся в очереди отправки и уходят в ядро одним вызовом io_uring_enter,
+//когда свободных буферов не осталось или файл закрывается.
+//Кольцо создаётся при первом открытии файла, буферы выделяются при открытии и освобождаются при закрытии,
+//поэтому простаивающий писатель памяти под данные не держит
+class IoUringFileWriter : public FileWriter
+{
+public:
+    //bufferSize - сколько памяти под данные на один открытый файл, она делится на bufferCount буферов
+    IoUringFileWriter(size_t bufferSize = 1024 * 1024, unsigned bufferCount = 4);
+    ~IoUringFileWriter();
+
+    //false - ядро не поддерживает io_uring или он запрещён
+    static bool isSupported();
+
+    bool open(const std::string& path) override;
+    bool reopen(const std::string& path, uint64_t offset) override;
+    bool write(const char* data, size_t size) override;
+    bool close() override;
+    bool preallocate(uint64_t size, bool keepSize) override;
+    bool isOpen() const override;
+    Backend backend() const override;
+
+private:
+    struct Buffer
+    {
+        char* data;
+        size_t used;
+        off_t offset;
+        bool busy;      //Отдан ядру, ждём завершения записи
+        iovec iov;
+    };
+
+    int m_ringFd;
+    void* m_sqRing;
+    size_t m_sqRingSize;
+    void* m_cqRing;
+    size_t m_cqRingSize;
+    io_uring_sqe* m_sqes;
+    size_t m_sqesSize;
+
+    unsigned* m_sqTail;
+    unsigned* m_sqMask;
+    unsigned* m_sqArray;
+    unsigned* m_cqHead;
+    unsigned* m_cqTail;
+    unsigned* m_cqMask;
+    io_uring_cqe* m_cqes;
+
+    unsigned m_unsubmitted;     //Подготовлено, но ещё не отдано ядру
+    unsigned m_inFlight;        //Отдано ядру, завершение ещё не получено
+
+    std::vector<Buffer> m_buffers;
+    size_t m_bufferSize;
+    unsigned m_bufferCount;
+    size_t m_current;
+
+    int m_fd;
+    off_t m_offset;
+    bool m_failed;
+    bool m_allocated;   //Файл расширен fallocate, при закрытии его нужно обрезать
+
+    bool setupRing(unsigned entries);
+    void destroyRing();
+
+    //Кольцо и буферы для очередного файла
+    bool prepare();
+    void releaseBuffers();
+
+    void queueCurrentBuffer();
+    bool submit(unsigned waitCount);
+    void reapCompletions();
+    bool selectFreeBuffer();
+};
+
+#endif //IO_URING_FILE_WRITER_H
@@ -0,0 +1,134 @@
+#include "JsonResponse.h"
+
+#include <charconv>
+#include <cstring>
+#include <vector>
+
+
+//Буфер потока, который переиспользуется ответами. Больше этого размера после ответа не держим
+static const size_t maxRetainedBuffer = 1024 * 1024;
+
+struct ThreadBuffer
+{
+    std::string buffer;
+    bool inUse = false;
+};
+
+static thread_local ThreadBuffer threadBuffer;
+
+//Готовые начала заголовка "HTTP/1.1 <код>\r\nContent-Type: application/json\r\n" для всех кодов
+static const std::string& headerPrefix(SimpleWeb::StatusCode status)
+{
+    static const std::vector<std::string> prefixes = []()
+                                                     {
+                                                         std::vector<std::string> result(600);
+                                                         for(size_t code = 100; code < result.size(); code++)
+                                                         {
+                                                             result[code] = "HTTP/1.1 " + SimpleWeb::status_code(static_cast<SimpleWeb::StatusCode>(code)) +
+                                                                            "\r\nContent-Type: application/json\r\n";
+                                                         }
+                                                         return result;
+                                                     }();
+
+    size_t code = static_cast<size_t>(status);
+    return prefixes[code < prefixes.size() ? code : static_cast<size_t>(SimpleWeb::StatusCode::server_error_internal_server_error)];
+}
+
+JsonResponse::JsonResponse(SimpleWeb::StatusCode status, const std::string& headers) :
+              m_buffer(acquireBuffer()),
+              m_borrowed(m_buffer != nullptr),
+              m_headerSize(0),
+              m_bodyOffset(0),
+              m_begin(0),
+              m_writer(m_buffer ? *m_buffer : m_own)
+{
+    if(!m_buffer)
+    {
+        m_buffer = &m_own;
+    }
+
+    m_buffer->clear();
+    m_buffer->append(headerPrefix(status));
+    m_buffer->append(headers);
+    m_buffer->append("Content-Length: ");
+    m_headerSize = m_buffer->size();
+
+    //Место под число и пустую строку после заголовка
+    m_buffer->append(lengthDigits + 4, ' ');
+    m_bodyOffset = m_buffer->size();
+}
+
+JsonResponse::~JsonResponse()
+{
+    if(!m_borrowed)
+    {
+        return;
+    }
+
+    if(m_buffer->capacity() > maxRetainedBuffer)
+    {
+        std::string().swap(*m_buffer);
+    }
+
+    threadBuffer.inUse = false;
+}
+
+JsonWriter& JsonResponse::body()
+{
+    return m_writer;
+}
+
+void JsonResponse::finalize()
+{
+    char digits[lengthDigits];
+    char* end = std::to_chars(digits, digits + sizeof(digits), m_buffer->size() - m_bodyOffset).ptr;
+    size_t count = end - digits;
+
+    //Сдвигаем заголовок вплотную к телу, чтобы число встало без пробелов
+    m_begin = lengthDigits - count;
+
+    char* data = &(*m_buffer)[0];
+    std::memmove(data + m_begin, data, m_headerSize);
+    std::memcpy(data + m_begin + m_headerSize, digits, count);
+    std::memcpy(data + m_begin + m_headerSize + count, "\r\n\r\n", 4);
+}
+
+const char* JsonResponse::data() const
+{
+    return m_buffer->data() + m_begin;
+}
+
+size_t JsonResponse::size() const
+{
+    return m_buffer->size() - m_begin;
+}
+
+void JsonResponse::send(const std::shared_ptr<HttpServer::Response>& response)
+{
+    finalize();
+    response->write(data(), static_cast<std::streamsize>(size()));
+}
+
+void JsonResponse::sendError(const std::shared_ptr<HttpServer::Response>& response, SimpleWeb::StatusCode status,
+                             const std::string& description, const std::string& headers)
+{
+    JsonResponse result(status, headers);
+
+    result.body().beginObject()
+                 .field("status", "error")
+                 .field("description", description)
+                 .endObject();
+
+    result.send(response);
+}
+
+std::string* JsonResponse::acquireBuffer()
+{
+    if(threadBuffer.inUse)
+    {
+        return nullptr;
+    }
+
+    threadBuffer.inUse = true;
+    return &threadBuffer.buffer;
+}
@@ -0,0 +1,56 @@
+#ifndef JSON_RESPONSE_H
+#define JSON_RESPONSE_H
+
+#include <string>
+#include <memory>
+
+#include "StreamingServer.h"
+#include "JsonWriter.h"
+
+
+//HTTP ответ с телом JSON. Заголовок и тело собираются в одном буфере потока, который переиспользуется
+//от ответа к ответу, поэтому в установившемся режиме ответ не выделяет память. Под Content-Length
+//место резервируется заранее, длина вписывается, когда тело записано.
+//Объект живёт в пределах одного обработчика и не передаётся между потоками
+class JsonResponse
+{
+public:
+    //headers - дополнительные строки заголовка, каждая заканчивается "\r\n"
+    explicit JsonResponse(SimpleWeb::StatusCode status, const std::string& headers = std::string());
+    ~JsonResponse();
+
+    JsonResponse(const JsonResponse&) = delete;
+    JsonResponse& operator=(const JsonResponse&) = delete;
+
+    //Сюда пишется тело
+    JsonWriter& body();
+
+    //Вписывает Content-Length. После этого готовый ответ доступен через data и size
+    void finalize();
+    const char* data() const;
+    size_t size() const;
+
+    //finalize и запись в response
+    void send(const std::shared_ptr<HttpServer::Response>& response);
+
+    //Ответ {"status": "error", "description": description}
+    static void sendError(const std::shared_ptr<HttpServer::Response>& response, SimpleWeb::StatusCode status,
+                          const std::string& description, const std::string& headers = std::string());
+
+private:
+    static const size_t lengthDigits = 20;
+
+    std::string m_own;          //Если буфер потока уже занят вложенным ответом
+    std::string* m_buffer;
+    bool m_borrowed;
+
+    size_t m_headerSize;        //Заголовок до числа Content-Length
+    size_t m_bodyOffset;
+    size_t m_begin;             //Начало готового ответа в буфере
+
+    JsonWriter m_writer;
+
+    static std::string* acquireBuffer();
+};
+
+#endif //JSON_RESPONSE_H
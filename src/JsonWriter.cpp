@@ -0,0 +1,284 @@
+#include "JsonWriter.h"
+
+#include <charconv>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+
+
+//Длина корректной последовательности UTF-8 в начале text, 0 - байты не складываются в символ.
+//Как в RFC 3629: без избыточных форм, суррогатов и символов после U+10FFFF
+static size_t utf8SequenceLength(const unsigned char* text, size_t size)
+{
+    unsigned char c = text[0];
+    size_t length;
+    unsigned char low = 0x80;
+    unsigned char high = 0xbf;
+
+    if(c >= 0xc2 && c <= 0xdf)
+    {
+        length = 2;
+    }
+    else if(c >= 0xe0 && c <= 0xef)
+    {
+        length = 3;
+        low = c == 0xe0 ? 0xa0 : 0x80;
+        high = c == 0xed ? 0x9f : 0xbf;
+    }
+    else if(c >= 0xf0 && c <= 0xf4)
+    {
+        length = 4;
+        low = c == 0xf0 ? 0x90 : 0x80;
+        high = c == 0xf4 ? 0x8f : 0xbf;
+    }
+    else
+    {
+        return 0;
+    }
+
+    if(size < length || text[1] < low || text[1] > high)
+    {
+        return 0;
+    }
+
+    for(size_t i = 2; i < length; i++)
+    {
+        if(text[i] < 0x80 || text[i] > 0xbf)
+        {
+            return 0;
+        }
+    }
+
+    return length;
+}
+
+JsonWriter::JsonWriter(std::string& buffer) :
+            m_buffer(buffer),
+            m_empty(0),
+            m_depth(0),
+            m_afterKey(false)
+{
+}
+
+JsonWriter& JsonWriter::beginObject()
+{
+    open('{');
+    return *this;
+}
+
+JsonWriter& JsonWriter::endObject()
+{
+    close('}');
+    return *this;
+}
+
+JsonWriter& JsonWriter::beginArray()
+{
+    open('[');
+    return *this;
+}
+
+JsonWriter& JsonWriter::endArray()
+{
+    close(']');
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(const char* name, size_t size)
+{
+    separator();
+
+    m_buffer.push_back('"');
+    appendEscaped(name, size);
+    m_buffer.append("\":", 2);
+
+    m_afterKey = true;
+
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(const std::string& name)
+{
+    return key(name.data(), name.size());
+}
+
+JsonWriter& JsonWriter::key(const char* name)
+{
+    return key(name, std::strlen(name));
+}
+
+JsonWriter& JsonWriter::value(const char* text, size_t size)
+{
+    separator();
+
+    m_buffer.push_back('"');
+    appendEscaped(text, size);
+    m_buffer.push_back('"');
+
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(const std::string& text)
+{
+    return value(text.data(), text.size());
+}
+
+JsonWriter& JsonWriter::value(const char* text)
+{
+    return value(text, std::strlen(text));
+}
+
+JsonWriter& JsonWriter::value(bool flag)
+{
+    separator();
+
+    if(flag)
+    {
+        m_buffer.append("true", 4);
+    }
+    else
+    {
+        m_buffer.append("false", 5);
+    }
+
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(double number)
+{
+    separator();
+
+    if(!std::isfinite(number))
+    {
+        m_buffer.append("null", 4);
+        return *this;
+    }
+
+    char digits[32];
+    int size = std::snprintf(digits, sizeof(digits), "%.6g", number);
+    m_buffer.append(digits, size);
+
+    return *this;
+}
+
+JsonWriter& JsonWriter::signedValue(int64_t number)
+{
+    separator();
+
+    char digits[24];
+    char* end = std::to_chars(digits, digits + sizeof(digits), number).ptr;
+    m_buffer.append(digits, end - digits);
+
+    return *this;
+}
+
+JsonWriter& JsonWriter::unsignedValue(uint64_t number)
+{
+    separator();
+
+    char digits[24];
+    char* end = std::to_chars(digits, digits + sizeof(digits), number).ptr;
+    m_buffer.append(digits, end - digits);
+
+    return *this;
+}
+
+void JsonWriter::separator()
+{
+    if(m_afterKey)
+    {
+        m_afterKey = false;
+        return;
+    }
+
+    if(m_depth == 0)
+    {
+        return;
+    }
+
+    uint64_t bit = 1ULL << ((m_depth - 1) % maxDepth);
+
+    if(m_empty & bit)
+    {
+        m_empty &= ~bit;
+    }
+    else
+    {
+        m_buffer.push_back(',');
+    }
+}
+
+void JsonWriter::open(char bracket)
+{
+    separator();
+
+    m_buffer.push_back(bracket);
+    m_depth++;
+    m_empty |= 1ULL << ((m_depth - 1) % maxDepth);
+}
+
+void JsonWriter::close(char bracket)
+{
+    m_buffer.push_back(bracket);
+
+    if(m_depth > 0)
+    {
+        m_depth--;
+    }
+}
+
+void JsonWriter::appendEscaped(const char* text, size_t size)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    //Участки без спецсимволов копируем целиком
+    size_t begin = 0;
+
+    for(size_t i = 0; i < size; i++)
+    {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+
+        if(c >= 0x80)
+        {
+            size_t length = utf8SequenceLength(reinterpret_cast<const unsigned char*>(text) + i, size - i);
+            if(length > 0)
+            {
+                i += length - 1;
+                continue;
+            }
+
+            //Такую строку не разобрал бы ни один клиент - байт заменяем символом замены
+            m_buffer.append(text + begin, i - begin);
+            m_buffer.append("\\ufffd", 6);
+            begin = i + 1;
+            continue;
+        }
+
+        if(c >= 0x20 && c != '"' && c != '\\')
+        {
+            continue;
+        }
+
+        m_buffer.append(text + begin, i - begin);
+        begin = i + 1;
+
+        switch(c)
+        {
+            case '"':  m_buffer.append("\\\"", 2); break;
+            case '\\': m_buffer.append("\\\\", 2); break;
+            case '\n': m_buffer.append("\\n", 2); break;
+            case '\r': m_buffer.append("\\r", 2); break;
+            case '\t': m_buffer.append("\\t", 2); break;
+            case '\b': m_buffer.append("\\b", 2); break;
+            case '\f': m_buffer.append("\\f", 2); break;
+            default:
+            {
+                char escaped[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0f]};
+                m_buffer.append(escaped, sizeof(escaped));
+                break;
+            }
+        }
+    }
+
+    m_buffer.append(text + begin, size - begin);
+}
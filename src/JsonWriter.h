@@ -0,0 +1,69 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <string>
+#include <type_traits>
+#include <cstdint>
+
+
+//Потоковая запись JSON прямо в строку-буфер, без промежуточного дерева nlohmann::json.
+//Запятые между элементами расставляются сами. Строки экранируются, корректный UTF-8 передаётся как есть,
+//а байты, которые не складываются в UTF-8 (имя файла из запроса может быть в любой кодировке), заменяются на U+FFFD.
+//Буфер не очищается, запись дописывается в конец: ёмкость буфера, который переиспользуется, не теряется
+class JsonWriter
+{
+public:
+    static const size_t maxDepth = 64;
+
+    explicit JsonWriter(std::string& buffer);
+
+    JsonWriter& beginObject();
+    JsonWriter& endObject();
+    JsonWriter& beginArray();
+    JsonWriter& endArray();
+
+    //Ключ следующего значения объекта
+    JsonWriter& key(const char* name, size_t size);
+    JsonWriter& key(const std::string& name);
+    JsonWriter& key(const char* name);
+
+    JsonWriter& value(const char* text, size_t size);
+    JsonWriter& value(const std::string& text);
+    JsonWriter& value(const char* text);
+    JsonWriter& value(bool flag);
+
+    //Не больше 6 значащих цифр, бесконечность и NaN записываются как null
+    JsonWriter& value(double number);
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, JsonWriter&>::type value(T number)
+    {
+        return std::is_signed<T>::value ? signedValue(static_cast<int64_t>(number)) : unsignedValue(static_cast<uint64_t>(number));
+    }
+
+    //Пара ключ - значение объекта
+    template <typename T>
+    JsonWriter& field(const char* name, const T& fieldValue)
+    {
+        key(name);
+        return value(fieldValue);
+    }
+
+private:
+    std::string& m_buffer;
+
+    uint64_t m_empty;   //Бит на уровень вложенности: в контейнере ещё нет элементов
+    size_t m_depth;
+    bool m_afterKey;
+
+    JsonWriter& signedValue(int64_t number);
+    JsonWriter& unsignedValue(uint64_t number);
+
+    //Запятая перед очередным элементом, если он не первый
+    void separator();
+    void open(char bracket);
+    void close(char bracket);
+    void appendEscaped(const char* text, size_t size);
+};
+
+#endif //JSON_WRITER_H
@@ -0,0 +1,212 @@
+#include "LogHandler.h"
+
+#include "ResponseCache.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+LogHandler::LogHandler(std::vector<std::string> files, std::shared_ptr<LogRingSink> ring) :
+            m_files(files),
+            m_ring(ring)
+{
+}
+
+std::shared_ptr<HttpServer::FileResponse> LogHandler::operator()(std::shared_ptr<HttpServer::Request> request) const
+{
+    auto query = request->parse_query_string();
+
+    //Запросы по записям, а не по байтам, обслуживаем из памяти
+    if(m_ring && (query.find("records") != query.end() || query.find("level") != query.end() || query.find("after") != query.end()))
+    {
+        return fromRing(query);
+    }
+
+    //Открываем все файлы сразу: размеры и содержимое должны соответствовать друг другу, даже если лог сейчас ротируется
+    std::vector<HttpServer::FilePart> parts;
+    unsigned long long total = 0;
+    uint64_t stamp = 0;
+
+    for(const std::string& path : m_files)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0)
+        {
+            continue;
+        }
+
+        struct stat info;
+        if(fstat(fd, &info) != 0)
+        {
+            ::close(fd);
+            continue;
+        }
+
+        //offset пока хранит начало файла в склеенном логе
+        parts.emplace_back(fd, total, static_cast<unsigned long long>(info.st_size));
+        total += info.st_size;
+
+        //Версия логов - размеры и время изменения файлов
+        stamp = ResponseCache::combine(stamp, info.st_ino);
+        stamp = ResponseCache::combine(stamp, info.st_size);
+        stamp = ResponseCache::combine(stamp, info.st_mtim.tv_sec * 1000000000ULL + info.st_mtim.tv_nsec);
+    }
+
+    //Логи не менялись с прошлого опроса - содержимое не отправляем
+    std::string etag = ResponseCache::makeETag(stamp);
+    if(ResponseCache::matches(request->header, etag))
+    {
+        auto notModified = std::make_shared<HttpServer::FileResponse>();
+        notModified->status = SimpleWeb::StatusCode::redirection_not_modified;
+        notModified->header.emplace("ETag", etag);
+        return notModified;
+    }
+
+    auto rangeHeader = request->header.find("Range");
+
+    bool plainRequest = query.find("since") == query.end() && query.find("tail") == query.end() && rangeHeader == request->header.end();
+
+    //Без параметров отвечаем как раньше, понятным текстом
+    if(plainRequest && parts.empty())
+    {
+        return makeTextResponse(SimpleWeb::StatusCode::success_ok, "Файл логов отсутствует");
+    }
+
+    if(plainRequest && total == 0)
+    {
+        return makeTextResponse(SimpleWeb::StatusCode::success_ok, "Файл логов существует, но пуст");
+    }
+
+    unsigned long long begin = 0;
+    unsigned long long end = total;
+
+    auto response = std::make_shared<HttpServer::FileResponse>();
+
+    try
+    {
+        auto since = query.find("since");
+        if(since != query.end())
+        {
+            begin = std::stoull(since->second);
+
+            //Смещение больше размера - лог ротировали, отдаём всё с начала
+            if(begin > total)
+            {
+                begin = 0;
+            }
+        }
+
+        auto tail = query.find("tail");
+        if(tail != query.end())
+        {
+            unsigned long long count = std::stoull(tail->second);
+            begin = std::max(begin, total - std::min(count, total));
+        }
+    }
+    catch(const std::exception&)
+    {
+        return makeTextResponse(SimpleWeb::StatusCode::client_error_bad_request, "Ошибка: параметры since и tail должны быть числами");
+    }
+
+    //Range задаёт участок всего лога и имеет приоритет над since и tail
+    if(rangeHeader != request->header.end())
+    {
+        if(!HttpServer::parseRange(rangeHeader->second, total, begin, end))
+        {
+            response = makeTextResponse(SimpleWeb::StatusCode::client_error_range_not_satisfiable, "");
+            response->header.emplace("Content-Range", "bytes */" + std::to_string(total));
+            return response;
+        }
+
+        response->status = SimpleWeb::StatusCode::success_partial_content;
+        response->header.emplace("Content-Range", "bytes " + std::to_string(begin) + "-" + std::to_string(end - 1) + "/" + std::to_string(total));
+    }
+
+    response->header.emplace("Content-Type", "text/plain; charset=utf-8");
+    response->header.emplace("Accept-Ranges", "bytes");
+    response->header.emplace("X-Log-Size", std::to_string(total));
+    response->header.emplace("ETag", etag);
+
+    //Оставляем только пересечения файлов с [begin, end)
+    for(auto& part : parts)
+    {
+        unsigned long long fileBegin = part.offset;
+        unsigned long long fileEnd = part.offset + part.length;
+
+        unsigned long long from = std::max(begin, fileBegin);
+        unsigned long long to = std::min(end, fileEnd);
+
+        if(from >= to)
+        {
+            continue;
+        }
+
+        part.offset = from - fileBegin;
+        part.length = to - from;
+        response->files.push_back(std::move(part));
+    }
+
+    return response;
+}
+
+std::shared_ptr<HttpServer::FileResponse> LogHandler::fromRing(const SimpleWeb::CaseInsensitiveMultimap& query) const
+{
+    size_t count = m_ring->capacity();
+    spdlog::level::level_enum minLevel = spdlog::level::trace;
+    spdlog::log_clock::time_point since;
+
+    try
+    {
+        auto records = query.find("records");
+        if(records != query.end())
+        {
+            count = std::stoull(records->second);
+        }
+
+        auto after = query.find("after");
+        if(after != query.end())
+        {
+            since = spdlog::log_clock::time_point(std::chrono::milliseconds(std::stoll(after->second)));
+        }
+    }
+    catch(const std::exception&)
+    {
+        return makeTextResponse(SimpleWeb::StatusCode::client_error_bad_request, "Ошибка: параметры records и after должны быть числами");
+    }
+
+    auto level = query.find("level");
+    if(level != query.end())
+    {
+        minLevel = spdlog::level::from_str(level->second);
+
+        if(minLevel == spdlog::level::off && level->second != "off")
+        {
+            return makeTextResponse(SimpleWeb::StatusCode::client_error_bad_request, "Ошибка: неизвестный уровень лога: " + level->second);
+        }
+    }
+
+    std::vector<LogRingSink::Record> records = m_ring->records(count, minLevel, since);
+
+    auto response = makeTextResponse(SimpleWeb::StatusCode::success_ok, m_ring->format(records));
+
+    //Время последней записи - его можно передать в after при следующем опросе
+    if(!records.empty())
+    {
+        auto lastTime = std::chrono::duration_cast<std::chrono::milliseconds>(records.back().time.time_since_epoch()).count();
+        response->header.emplace("X-Log-Last-Time", std::to_string(lastTime));
+    }
+
+    return response;
+}
+
+std::shared_ptr<HttpServer::FileResponse> LogHandler::makeTextResponse(SimpleWeb::StatusCode status, const std::string& text)
+{
+    auto response = std::make_shared<HttpServer::FileResponse>();
+    response->status = status;
+    response->header.emplace("Content-Type", "text/plain; charset=utf-8");
+    response->content = text;
+
+    return response;
+}
@@ -0,0 +1,32 @@
+#ifndef LOG_HANDLER_H
+#define LOG_HANDLER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "StreamingServer.h"
+#include "LogRingSink.h"
+
+
+//Отдаёт файлы логов, склеенные по порядку, через sendfile прямо из page cache.
+//Поддерживает Range: bytes=..., а также ?tail=N (последние N байт) и ?since=<смещение> (только новые байты).
+//Заголовок X-Log-Size содержит общий размер логов - его можно передать в since при следующем опросе.
+//Параметры ?records=N, ?level=warn и ?after=<Unix-время в мс> отвечают из кольца последних записей в памяти, без диска
+class LogHandler
+{
+public:
+    LogHandler(std::vector<std::string> files, std::shared_ptr<LogRingSink> ring);
+
+    std::shared_ptr<HttpServer::FileResponse> operator()(std::shared_ptr<HttpServer::Request> request) const;
+
+private:
+    std::vector<std::string> m_files;
+    std::shared_ptr<LogRingSink> m_ring;
+
+    std::shared_ptr<HttpServer::FileResponse> fromRing(const SimpleWeb::CaseInsensitiveMultimap& query) const;
+
+    static std::shared_ptr<HttpServer::FileResponse> makeTextResponse(SimpleWeb::StatusCode status, const std::string& text);
+};
+
+#endif //LOG_HANDLER_H
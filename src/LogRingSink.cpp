@@ -0,0 +1,165 @@
+#include "LogRingSink.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "spdlog/pattern_formatter.h"
+
+
+LogRingSink::LogRingSink(size_t capacity, size_t recordSize) :
+             m_capacity(2),
+             m_recordSize(std::max<size_t>(recordSize, 64)),
+             m_head(0),
+             m_dropped(0),
+             m_formatter(new spdlog::pattern_formatter())
+{
+    //Ёмкость - степень двойки, чтобы номер слота считался маской
+    while(m_capacity < capacity)
+    {
+        m_capacity <<= 1;
+    }
+
+    m_mask = m_capacity - 1;
+
+    m_slots.reset(new Slot[m_capacity]);
+    m_text.reset(new char[m_capacity * m_recordSize]);
+
+    for(size_t i = 0; i < m_capacity; i++)
+    {
+        m_slots[i].sequence.store(0, std::memory_order_relaxed);
+    }
+}
+
+void LogRingSink::log(const spdlog::details::log_msg& msg)
+{
+    uint64_t position = m_head.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = m_slots[position & m_mask];
+
+    //Слот ещё пишет писатель, отставший на целый круг. Ждать его нельзя - теряем запись
+    uint64_t current = slot.sequence.load(std::memory_order_relaxed);
+    if((current & 1) || current > 2 * position ||
+       !slot.sequence.compare_exchange_strong(current, 2 * position + 1, std::memory_order_acquire))
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    std::atomic_thread_fence(std::memory_order_release);
+
+    char* text = m_text.get() + (position & m_mask) * m_recordSize;
+
+    size_t nameSize = std::min<size_t>(msg.logger_name.size(), m_recordSize / 4);
+    size_t messageSize = std::min<size_t>(msg.payload.size(), m_recordSize - nameSize);
+
+    std::memcpy(text, msg.logger_name.data(), nameSize);
+    std::memcpy(text + nameSize, msg.payload.data(), messageSize);
+
+    slot.time = std::chrono::duration_cast<std::chrono::nanoseconds>(msg.time.time_since_epoch()).count();
+    slot.level = msg.level;
+    slot.threadId = msg.thread_id;
+    slot.nameSize = static_cast<uint16_t>(nameSize);
+    slot.messageSize = static_cast<uint16_t>(messageSize);
+
+    slot.sequence.store(2 * position + 2, std::memory_order_release);
+}
+
+void LogRingSink::flush()
+{
+}
+
+void LogRingSink::set_pattern(const std::string& pattern)
+{
+    set_formatter(std::unique_ptr<spdlog::formatter>(new spdlog::pattern_formatter(pattern)));
+}
+
+void LogRingSink::set_formatter(std::unique_ptr<spdlog::formatter> sinkFormatter)
+{
+    std::lock_guard<std::mutex> lock(m_formatterMutex);
+    m_formatter = std::move(sinkFormatter);
+}
+
+std::vector<LogRingSink::Record> LogRingSink::records(size_t count, spdlog::level::level_enum minLevel, spdlog::log_clock::time_point since) const
+{
+    std::vector<Record> result;
+
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    uint64_t begin = (head > m_capacity) ? head - m_capacity : 0;
+
+    //Идём от новых записей к старым, пока не наберём count подходящих
+    for(uint64_t position = head; position > begin && result.size() < count; position--)
+    {
+        const Slot& slot = m_slots[(position - 1) & m_mask];
+
+        uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if(sequence != 2 * position)
+        {
+            //Запись ещё не закончена или слот уже занят более новой записью
+            continue;
+        }
+
+        Record record;
+        record.time = spdlog::log_clock::time_point(std::chrono::duration_cast<spdlog::log_clock::duration>(std::chrono::nanoseconds(slot.time)));
+        record.level = slot.level;
+        record.threadId = slot.threadId;
+
+        size_t nameSize = std::min<size_t>(slot.nameSize, m_recordSize);
+        size_t messageSize = std::min<size_t>(slot.messageSize, m_recordSize - nameSize);
+
+        const char* text = m_text.get() + ((position - 1) & m_mask) * m_recordSize;
+        record.loggerName.assign(text, nameSize);
+        record.message.assign(text + nameSize, messageSize);
+
+        //Писатель мог перезаписать слот, пока мы копировали
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(slot.sequence.load(std::memory_order_relaxed) != sequence)
+        {
+            continue;
+        }
+
+        if(record.level < minLevel || record.time < since)
+        {
+            continue;
+        }
+
+        result.push_back(std::move(record));
+    }
+
+    std::reverse(result.begin(), result.end());
+
+    return result;
+}
+
+std::string LogRingSink::format(const std::vector<Record>& records) const
+{
+    std::unique_ptr<spdlog::formatter> formatter;
+
+    {
+        std::lock_guard<std::mutex> lock(m_formatterMutex);
+        formatter = m_formatter->clone();
+    }
+
+    std::string result;
+    spdlog::memory_buf_t buffer;
+
+    for(const Record& record : records)
+    {
+        spdlog::details::log_msg msg(record.time, spdlog::source_loc{}, record.loggerName, record.level, record.message);
+        msg.thread_id = record.threadId;
+
+        buffer.clear();
+        formatter->format(msg, buffer);
+        result.append(buffer.data(), buffer.size());
+    }
+
+    return result;
+}
+
+size_t LogRingSink::capacity() const
+{
+    return m_capacity;
+}
+
+uint64_t LogRingSink::dropped() const
+{
+    return m_dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,73 @@
+#ifndef LOG_RING_SINK_H
+#define LOG_RING_SINK_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#include "spdlog/sinks/sink.h"
+#include "spdlog/formatter.h"
+
+
+//Sink spdlog, который хранит последние записи лога в памяти, в кольце фиксированного размера.
+//Запись не блокируется: писатели занимают слоты атомарным счётчиком, читатели проверяют номер слота до и после
+//копирования (seqlock) и пропускают перезаписанные. Длинные сообщения обрезаются до recordSize байт
+class LogRingSink : public spdlog::sinks::sink
+{
+public:
+    struct Record
+    {
+        spdlog::log_clock::time_point time;
+        spdlog::level::level_enum level;
+        size_t threadId;
+        std::string loggerName;
+        std::string message;
+    };
+
+    LogRingSink(size_t capacity, size_t recordSize = 512);
+
+    void log(const spdlog::details::log_msg& msg) override;
+    void flush() override;
+    void set_pattern(const std::string& pattern) override;
+    void set_formatter(std::unique_ptr<spdlog::formatter> sinkFormatter) override;
+
+    //Не более count последних записей уровня не ниже minLevel, сделанных не раньше since. В порядке записи
+    std::vector<Record> records(size_t count, spdlog::level::level_enum minLevel, spdlog::log_clock::time_point since) const;
+
+    //Записи в том же виде, что и в файле лога
+    std::string format(const std::vector<Record>& records) const;
+
+    size_t capacity() const;
+
+    //Записи, потерянные из-за того, что писатель отстал от других на целый круг кольца
+    uint64_t dropped() const;
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> sequence;    //2 * (номер + 1) - запись готова, нечётное - идёт запись
+        int64_t time;
+        spdlog::level::level_enum level;
+        size_t threadId;
+        uint16_t nameSize;
+        uint16_t messageSize;
+    };
+
+    size_t m_capacity;
+    size_t m_mask;
+    size_t m_recordSize;
+
+    std::unique_ptr<Slot[]> m_slots;
+    std::unique_ptr<char[]> m_text;     //Имя логгера и текст записи, recordSize байт на слот
+
+    alignas(64) std::atomic<uint64_t> m_head;
+    std::atomic<uint64_t> m_dropped;
+
+    mutable std::mutex m_formatterMutex;
+    std::unique_ptr<spdlog::formatter> m_formatter;
+};
+
+#endif //LOG_RING_SINK_H
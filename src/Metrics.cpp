@@ -0,0 +1,447 @@
+#include "Metrics.h"
+
+#include <sstream>
+#include <algorithm>
+
+#include "FileSaver.h"
+#include "DiskWriteStage.h"
+
+
+const std::vector<int> Metrics::statusCodes = {200, 206, 304, 400, 404, 411, 413, 416, 429, 500, 503};
+
+//Границы корзин гистограммы Prometheus в секундах, точные значения дают квантили
+static const double histogramBounds[] = {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 300};
+
+static const char* stateNames[] =
+{
+    "WaitingRequestHeader",
+    "WasReadRequestHeader",
+    "WaitingBoundary",
+    "WasReadBoundary",
+    "WaitingContentDisposition",
+    "WasReadContentDisposition",
+    "WaitingNewLine",
+    "WasReadNewLine",
+    "WaitingData",
+    "WasReadData",
+    "WaitingBoundaryEnd",
+    "WasReadBoundaryEnd",
+    "FinishedRead",
+    "ErrorState"
+};
+
+Metrics::Metrics() :
+         m_shards(new Shard[shardCount]),
+         m_nextShard(0)
+{
+    static_assert(sizeof(stateNames) / sizeof(stateNames[0]) == FileSaver::QuantityParserState, "stateNames must match FileSaverState");
+    static_assert(FileSaver::QuantityParserState <= maxStates, "maxStates is too small");
+
+    for(size_t s = 0; s < shardCount; s++)
+    {
+        Shard& shard = m_shards[s];
+
+        for(RouteCounters& route : shard.routes)
+        {
+            route.requests = 0;
+            route.latencySumUs = 0;
+
+            for(auto& status : route.statuses)
+            {
+                status = 0;
+            }
+
+            for(auto& bucket : route.latencyBuckets)
+            {
+                bucket = 0;
+            }
+        }
+
+        shard.bytesReceived = 0;
+        shard.bytesWritten = 0;
+        shard.filesSaved = 0;
+
+        for(auto& errors : shard.parserErrors)
+        {
+            errors = 0;
+        }
+
+        for(auto& limited : shard.limited)
+        {
+            limited = 0;
+        }
+
+        shard.throttledUs = 0;
+        shard.syncBatches = 0;
+        shard.syncedFiles = 0;
+        shard.syncUs = 0;
+        shard.compressedBytes = 0;
+        shard.decompressedBytes = 0;
+        shard.decompressUs = 0;
+    }
+}
+
+bool Metrics::addRoute(const std::string& path)
+{
+    if(routeIndex(path) != maxRoutes)
+    {
+        return true;
+    }
+
+    if(m_routes.size() == maxRoutes)
+    {
+        return false;
+    }
+
+    m_routes.push_back(path);
+    return true;
+}
+
+void Metrics::response(const std::string& path, int status, std::chrono::nanoseconds latency)
+{
+    RouteCounters& route = shard().routes[routeIndex(path)];
+
+    size_t statusIndex = std::find(statusCodes.begin(), statusCodes.end(), status) - statusCodes.begin();
+
+    uint64_t us = static_cast<uint64_t>(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(latency).count()));
+
+    route.requests.fetch_add(1, std::memory_order_relaxed);
+    route.statuses[statusIndex].fetch_add(1, std::memory_order_relaxed);
+    route.latencySumUs.fetch_add(us, std::memory_order_relaxed);
+    route.latencyBuckets[bucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::bytesReceived(uint64_t bytes)
+{
+    shard().bytesReceived.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void Metrics::bytesWritten(uint64_t bytes)
+{
+    shard().bytesWritten.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void Metrics::fileSaved()
+{
+    shard().filesSaved.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::parserError(uint8_t state)
+{
+    shard().parserErrors[std::min<size_t>(state, maxStates - 1)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::limited(LimitReason reason)
+{
+    shard().limited[reason].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::throttled(std::chrono::nanoseconds pause)
+{
+    shard().throttledUs.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(pause).count(), std::memory_order_relaxed);
+}
+
+void Metrics::synced(size_t files, std::chrono::nanoseconds time)
+{
+    Shard& current = shard();
+
+    current.syncBatches.fetch_add(1, std::memory_order_relaxed);
+    current.syncedFiles.fetch_add(files, std::memory_order_relaxed);
+    current.syncUs.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(time).count(), std::memory_order_relaxed);
+}
+
+void Metrics::decompressed(uint64_t compressed, uint64_t decoded, std::chrono::nanoseconds cpuTime)
+{
+    Shard& current = shard();
+
+    current.compressedBytes.fetch_add(compressed, std::memory_order_relaxed);
+    current.decompressedBytes.fetch_add(decoded, std::memory_order_relaxed);
+    current.decompressUs.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(cpuTime).count(), std::memory_order_relaxed);
+}
+
+void Metrics::setActiveConnections(std::function<size_t()> activeConnections)
+{
+    m_activeConnections = activeConnections;
+}
+
+void Metrics::setDiskWriteStage(std::shared_ptr<DiskWriteStage> stage)
+{
+    m_diskWriteStage = stage;
+}
+
+std::string Metrics::render() const
+{
+    std::ostringstream out;
+
+    size_t routeCount = m_routes.size() + 1;
+
+    auto routeName = [this](size_t index) { return index < m_routes.size() ? m_routes[index] : std::string("other"); };
+
+    //Суммируем шарды
+    std::vector<uint64_t> requests(routeCount, 0);
+    std::vector<uint64_t> latencySumUs(routeCount, 0);
+    std::vector<std::vector<uint64_t>> statuses(routeCount, std::vector<uint64_t>(statusCodes.size() + 1, 0));
+    std::vector<std::vector<uint64_t>> buckets(routeCount, std::vector<uint64_t>(bucketCount, 0));
+
+    uint64_t bytesReceived = 0;
+    uint64_t bytesWritten = 0;
+    uint64_t filesSaved = 0;
+    std::vector<uint64_t> parserErrors(FileSaver::QuantityParserState, 0);
+    uint64_t limited[LimitReasonCount] = {};
+    uint64_t throttledUs = 0;
+    uint64_t syncBatches = 0;
+    uint64_t syncedFiles = 0;
+    uint64_t syncUs = 0;
+    uint64_t compressedBytes = 0;
+    uint64_t decompressedBytes = 0;
+    uint64_t decompressUs = 0;
+
+    for(size_t s = 0; s < shardCount; s++)
+    {
+        const Shard& shard = m_shards[s];
+
+        for(size_t r = 0; r < routeCount; r++)
+        {
+            const RouteCounters& route = shard.routes[r < m_routes.size() ? r : maxRoutes];
+
+            requests[r] += route.requests.load(std::memory_order_relaxed);
+            latencySumUs[r] += route.latencySumUs.load(std::memory_order_relaxed);
+
+            for(size_t i = 0; i <= statusCodes.size(); i++)
+            {
+                statuses[r][i] += route.statuses[i].load(std::memory_order_relaxed);
+            }
+
+            for(size_t i = 0; i < bucketCount; i++)
+            {
+                buckets[r][i] += route.latencyBuckets[i].load(std::memory_order_relaxed);
+            }
+        }
+
+        bytesReceived += shard.bytesReceived.load(std::memory_order_relaxed);
+        bytesWritten += shard.bytesWritten.load(std::memory_order_relaxed);
+        filesSaved += shard.filesSaved.load(std::memory_order_relaxed);
+
+        for(size_t i = 0; i < parserErrors.size(); i++)
+        {
+            parserErrors[i] += shard.parserErrors[i].load(std::memory_order_relaxed);
+        }
+
+        for(size_t i = 0; i < LimitReasonCount; i++)
+        {
+            limited[i] += shard.limited[i].load(std::memory_order_relaxed);
+        }
+
+        throttledUs += shard.throttledUs.load(std::memory_order_relaxed);
+        syncBatches += shard.syncBatches.load(std::memory_order_relaxed);
+        syncedFiles += shard.syncedFiles.load(std::memory_order_relaxed);
+        syncUs += shard.syncUs.load(std::memory_order_relaxed);
+        compressedBytes += shard.compressedBytes.load(std::memory_order_relaxed);
+        decompressedBytes += shard.decompressedBytes.load(std::memory_order_relaxed);
+        decompressUs += shard.decompressUs.load(std::memory_order_relaxed);
+    }
+
+    out << "# HELP http_requests_total Responses sent, by route\n"
+        << "# TYPE http_requests_total counter\n";
+    for(size_t r = 0; r < routeCount; r++)
+    {
+        out << "http_requests_total{route=\"" << routeName(r) << "\"} " << requests[r] << "\n";
+    }
+
+    out << "# HELP http_responses_total Responses sent, by route and status code\n"
+        << "# TYPE http_responses_total counter\n";
+    for(size_t r = 0; r < routeCount; r++)
+    {
+        for(size_t i = 0; i <= statusCodes.size(); i++)
+        {
+            if(statuses[r][i] == 0)
+            {
+                continue;
+            }
+
+            std::string code = i < statusCodes.size() ? std::to_string(statusCodes[i]) : "other";
+            out << "http_responses_total{route=\"" << routeName(r) << "\",code=\"" << code << "\"} " << statuses[r][i] << "\n";
+        }
+    }
+
+    out << "# HELP http_request_duration_seconds Time from reading the request header to sending the response\n"
+        << "# TYPE http_request_duration_seconds histogram\n";
+    for(size_t r = 0; r < routeCount; r++)
+    {
+        size_t bucket = 0;
+        uint64_t cumulative = 0;
+
+        for(double bound : histogramBounds)
+        {
+            uint64_t boundUs = static_cast<uint64_t>(bound * 1000000);
+
+            while(bucket < bucketCount && bucketUpperBound(bucket) <= boundUs)
+            {
+                cumulative += buckets[r][bucket++];
+            }
+
+            out << "http_request_duration_seconds_bucket{route=\"" << routeName(r) << "\",le=\"" << bound << "\"} " << cumulative << "\n";
+        }
+
+        out << "http_request_duration_seconds_bucket{route=\"" << routeName(r) << "\",le=\"+Inf\"} " << requests[r] << "\n"
+            << "http_request_duration_seconds_sum{route=\"" << routeName(r) << "\"} " << latencySumUs[r] / 1000000.0 << "\n"
+            << "http_request_duration_seconds_count{route=\"" << routeName(r) << "\"} " << requests[r] << "\n";
+    }
+
+    //Квантили по точной гистограмме, без потерь на грубых границах корзин Prometheus
+    out << "# HELP http_request_duration_quantile_seconds Latency quantiles since start\n"
+        << "# TYPE http_request_duration_quantile_seconds gauge\n";
+    for(size_t r = 0; r < routeCount; r++)
+    {
+        uint64_t total = 0;
+        for(uint64_t count : buckets[r])
+        {
+            total += count;
+        }
+
+        if(total == 0)
+        {
+            continue;
+        }
+
+        for(double quantile : {0.5, 0.9, 0.99, 0.999})
+        {
+            uint64_t rank = static_cast<uint64_t>(quantile * total);
+            uint64_t seen = 0;
+            size_t bucket = 0;
+
+            while(bucket < bucketCount - 1 && seen + buckets[r][bucket] <= rank)
+            {
+                seen += buckets[r][bucket++];
+            }
+
+            out << "http_request_duration_quantile_seconds{route=\"" << routeName(r) << "\",quantile=\"" << quantile << "\"} "
+                << bucketUpperBound(bucket) / 1000000.0 << "\n";
+        }
+    }
+
+    out << "# HELP upload_bytes_received_total Request body bytes passed to FileSaver\n"
+        << "# TYPE upload_bytes_received_total counter\n"
+        << "upload_bytes_received_total " << bytesReceived << "\n"
+        << "# HELP upload_bytes_written_total File bytes written by FileSaver\n"
+        << "# TYPE upload_bytes_written_total counter\n"
+        << "upload_bytes_written_total " << bytesWritten << "\n"
+        << "# HELP upload_files_saved_total Files saved by FileSaver\n"
+        << "# TYPE upload_files_saved_total counter\n"
+        << "upload_files_saved_total " << filesSaved << "\n";
+
+    out << "# HELP upload_parser_errors_total Multipart parser errors, by the state the error happened in\n"
+        << "# TYPE upload_parser_errors_total counter\n";
+    for(size_t i = 0; i < parserErrors.size(); i++)
+    {
+        if(parserErrors[i] > 0)
+        {
+            out << "upload_parser_errors_total{state=\"" << stateNames[i] << "\"} " << parserErrors[i] << "\n";
+        }
+    }
+
+    out << "# HELP http_rate_limited_total Requests rejected by the rate limiter before routing\n"
+        << "# TYPE http_rate_limited_total counter\n"
+        << "http_rate_limited_total{reason=\"request_rate\"} " << limited[RequestRate] << "\n"
+        << "http_rate_limited_total{reason=\"concurrency\"} " << limited[Concurrency] << "\n"
+        << "# HELP http_body_throttle_seconds_total Time request body reading was paused to hold clients to their byte rate\n"
+        << "# TYPE http_body_throttle_seconds_total counter\n"
+        << "http_body_throttle_seconds_total " << throttledUs / 1000000.0 << "\n";
+
+    out << "# HELP upload_sync_batches_total Batches of uploaded files flushed to disk before answering\n"
+        << "# TYPE upload_sync_batches_total counter\n"
+        << "upload_sync_batches_total " << syncBatches << "\n"
+        << "# HELP upload_synced_files_total Uploaded files flushed to disk before answering\n"
+        << "# TYPE upload_synced_files_total counter\n"
+        << "upload_synced_files_total " << syncedFiles << "\n"
+        << "# HELP upload_sync_seconds_total Time spent flushing uploaded files to disk\n"
+        << "# TYPE upload_sync_seconds_total counter\n"
+        << "upload_sync_seconds_total " << syncUs / 1000000.0 << "\n";
+
+    out << "# HELP upload_compressed_bytes_total Bytes of gzip/zstd upload bodies received\n"
+        << "# TYPE upload_compressed_bytes_total counter\n"
+        << "upload_compressed_bytes_total " << compressedBytes << "\n"
+        << "# HELP upload_decompressed_bytes_total Bytes those bodies decompressed to\n"
+        << "# TYPE upload_decompressed_bytes_total counter\n"
+        << "upload_decompressed_bytes_total " << decompressedBytes << "\n"
+        << "# HELP upload_decompress_cpu_seconds_total CPU time spent decompressing upload bodies\n"
+        << "# TYPE upload_decompress_cpu_seconds_total counter\n"
+        << "upload_decompress_cpu_seconds_total " << decompressUs / 1000000.0 << "\n";
+
+    if(m_activeConnections)
+    {
+        out << "# HELP http_active_connections Open client connections\n"
+            << "# TYPE http_active_connections gauge\n"
+            << "http_active_connections " << m_activeConnections() << "\n";
+    }
+
+    if(m_diskWriteStage)
+    {
+        DiskWriteStage::Statistics statistics = m_diskWriteStage->statistics();
+
+        out << "# TYPE disk_write_queue_depth gauge\n"
+            << "disk_write_queue_depth " << statistics.queueDepth << "\n"
+            << "# TYPE disk_write_bytes_pending gauge\n"
+            << "disk_write_bytes_pending " << statistics.bytesPending << "\n"
+            << "# TYPE disk_write_buffers_in_use gauge\n"
+            << "disk_write_buffers_in_use " << statistics.buffersInUse << "\n"
+            << "# TYPE disk_write_queue_full_waits_total counter\n"
+            << "disk_write_queue_full_waits_total " << statistics.queueFullWaits << "\n"
+            << "# TYPE disk_write_stalls_total counter\n"
+            << "disk_write_stalls_total " << statistics.stalls << "\n"
+            << "# TYPE disk_write_stall_seconds_total counter\n"
+            << "disk_write_stall_seconds_total " << statistics.stallTimeUs / 1000000.0 << "\n";
+    }
+
+    return out.str();
+}
+
+Metrics::Shard& Metrics::shard()
+{
+    //Поток получает шард один раз. Потоков обычно не больше шардов, иначе соседи делят шард, но не блокировку
+    thread_local size_t index = m_nextShard++ % shardCount;
+
+    return m_shards[index];
+}
+
+size_t Metrics::routeIndex(const std::string& path) const
+{
+    for(size_t i = 0; i < m_routes.size(); i++)
+    {
+        const std::string& route = m_routes[i];
+
+        if(route == path || (!route.empty() && route.back() == '/' && path.compare(0, route.size(), route) == 0))
+        {
+            return i;
+        }
+    }
+
+    return maxRoutes;
+}
+
+size_t Metrics::bucketIndex(uint64_t us)
+{
+    //До 16 мкс корзины по одной микросекунде, дальше 8 корзин на каждую степень двойки
+    if(us < 16)
+    {
+        return us;
+    }
+
+    unsigned shift = 63 - __builtin_clzll(us) - 3;
+    size_t index = shift * 8 + (us >> shift);
+
+    return std::min(index, bucketCount - 1);
+}
+
+uint64_t Metrics::bucketUpperBound(size_t index)
+{
+    if(index < 16)
+    {
+        return index;
+    }
+
+    unsigned shift = index / 8 - 1;
+    uint64_t mantissa = index % 8 + 8;
+
+    return ((mantissa + 1) << shift) - 1;
+}
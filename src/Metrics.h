@@ -0,0 +1,114 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+
+
+class DiskWriteStage;
+
+//Метрики сервера в формате Prometheus. Счётчики разбиты на шарды, поток пишет в свой шард без общих блокировок,
+//суммирование по шардам происходит только при выдаче /metrics.
+//Задержки собираются в логарифмически-линейную гистограмму (как HDR): 8 корзин на каждую степень двойки микросекунд
+class Metrics
+{
+public:
+    static const size_t maxRoutes = 16;
+
+    //Причины отказа RateLimiter
+    enum LimitReason
+    {
+        RequestRate,    //Клиент превысил число запросов в секунду
+        Concurrency,    //Маршрут обрабатывает максимум одновременных запросов
+        LimitReasonCount
+    };
+
+    Metrics();
+
+    //Маршруты регистрируются до запуска сервера. Запросы к остальным путям считаются маршрутом "other".
+    //Маршрут, который заканчивается на '/', включает все пути с этим началом.
+    //false - зарегистрировано уже maxRoutes маршрутов, запросы к path попадут в "other"
+    bool addRoute(const std::string& path);
+
+    //Ответ отправлен. latency - от чтения заголовка запроса до отправки ответа
+    void response(const std::string& path, int status, std::chrono::nanoseconds latency);
+
+    //Счётчики FileSaver
+    void bytesReceived(uint64_t bytes);
+    void bytesWritten(uint64_t bytes);
+    void fileSaved();
+    void parserError(uint8_t state);
+
+    //Решения RateLimiter: отказ в запросе и пауза в чтении тела
+    void limited(LimitReason reason);
+    void throttled(std::chrono::nanoseconds pause);
+
+    //DurabilityCommitter сбросил на диск пачку из files файлов за time
+    void synced(size_t files, std::chrono::nanoseconds time);
+
+    //FileSaver распаковал сжатое тело: compressed байт из сети дали decoded байт за cpuTime процессорного времени
+    void decompressed(uint64_t compressed, uint64_t decoded, std::chrono::nanoseconds cpuTime);
+
+    //Источники значений, которые не копятся счётчиками, а читаются при выдаче
+    void setActiveConnections(std::function<size_t()> activeConnections);
+    void setDiskWriteStage(std::shared_ptr<DiskWriteStage> stage);
+
+    std::string render() const;
+
+private:
+    static const size_t shardCount = 16;
+    static const size_t bucketCount = 312;
+    static const size_t maxStates = 16;
+
+    //Коды ответа, которые считаются отдельно, остальные попадают в "other"
+    static const std::vector<int> statusCodes;
+
+    struct RouteCounters
+    {
+        std::atomic<uint64_t> requests;
+        std::atomic<uint64_t> statuses[16];
+        std::atomic<uint64_t> latencySumUs;
+        std::atomic<uint64_t> latencyBuckets[bucketCount];
+    };
+
+    struct alignas(64) Shard
+    {
+        RouteCounters routes[maxRoutes + 1];
+
+        std::atomic<uint64_t> bytesReceived;
+        std::atomic<uint64_t> bytesWritten;
+        std::atomic<uint64_t> filesSaved;
+        std::atomic<uint64_t> parserErrors[maxStates];
+
+        std::atomic<uint64_t> limited[LimitReasonCount];
+        std::atomic<uint64_t> throttledUs;
+
+        std::atomic<uint64_t> syncBatches;
+        std::atomic<uint64_t> syncedFiles;
+        std::atomic<uint64_t> syncUs;
+
+        std::atomic<uint64_t> compressedBytes;
+        std::atomic<uint64_t> decompressedBytes;
+        std::atomic<uint64_t> decompressUs;
+    };
+
+    std::vector<std::string> m_routes;
+    std::unique_ptr<Shard[]> m_shards;
+    std::atomic<size_t> m_nextShard;
+
+    std::function<size_t()> m_activeConnections;
+    std::shared_ptr<DiskWriteStage> m_diskWriteStage;
+
+    Shard& shard();
+    size_t routeIndex(const std::string& path) const;
+
+    static size_t bucketIndex(uint64_t us);
+    static uint64_t bucketUpperBound(size_t index);
+};
+
+#endif //METRICS_H
@@ -0,0 +1,54 @@
+#include "NullFileWriter.h"
+
+
+NullFileWriter::NullFileWriter() :
+                m_open(false)
+{
+}
+
+bool NullFileWriter::open(const std::string& /*path*/)
+{
+    m_open = true;
+
+    return true;
+}
+
+bool NullFileWriter::reopen(const std::string& /*path*/, uint64_t /*offset*/)
+{
+    m_open = true;
+
+    return true;
+}
+
+bool NullFileWriter::write(const char* /*data*/, size_t /*size*/)
+{
+    return m_open;
+}
+
+bool NullFileWriter::close()
+{
+    m_open = false;
+
+    return true;
+}
+
+bool NullFileWriter::closeAndRename(const std::string& /*path*/, const std::string& /*newPath*/)
+{
+    //Файла нет, переименовывать нечего
+    return close();
+}
+
+bool NullFileWriter::closeAndLink(const std::string& /*path*/, const std::string& /*blobPath*/, const std::string& /*newPath*/)
+{
+    return close();
+}
+
+bool NullFileWriter::isOpen() const
+{
+    return m_open;
+}
+
+FileWriter::Backend NullFileWriter::backend() const
+{
+    return Null;
+}
@@ -0,0 +1,26 @@
+#ifndef NULL_FILE_WRITER_H
+#define NULL_FILE_WRITER_H
+
+#include "FileWriter.h"
+
+
+//Отбрасывает данные. Нужен, чтобы измерять разбор multipart без влияния диска
+class NullFileWriter : public FileWriter
+{
+public:
+    NullFileWriter();
+
+    bool open(const std::string& path) override;
+    bool reopen(const std::string& path, uint64_t offset) override;
+    bool write(const char* data, size_t size) override;
+    bool close() override;
+    bool closeAndRename(const std::string& path, const std::string& newPath) override;
+    bool closeAndLink(const std::string& path, const std::string& blobPath, const std::string& newPath) override;
+    bool isOpen() const override;
+    Backend backend() const override;
+
+private:
+    bool m_open;
+};
+
+#endif //NULL_FILE_WRITER_H
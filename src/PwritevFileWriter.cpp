@@ -0,0 +1,239 @@
+#include "PwritevFileWriter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+//Выравнивание буфера по странице
+const size_t bufferAlignment = 4096;
+
+PwritevFileWriter::PwritevFileWriter(size_t bufferSize) :
+                   m_fd(-1),
+                   m_offset(0),
+                   m_failed(false),
+                   m_allocated(false),
+                   m_buffer(nullptr),
+                   m_bufferSize(bufferSize),
+                   m_used(0)
+{
+}
+
+PwritevFileWriter::~PwritevFileWriter()
+{
+    close();
+
+    std::free(m_buffer);
+}
+
+bool PwritevFileWriter::open(const std::string& path)
+{
+    close();
+
+    if(!allocateBuffer())
+    {
+        return false;
+    }
+
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    m_offset = 0;
+    m_failed = false;
+    m_allocated = false;
+    m_used = 0;
+
+    return m_fd >= 0;
+}
+
+bool PwritevFileWriter::reopen(const std::string& path, uint64_t offset)
+{
+    close();
+
+    if(!allocateBuffer())
+    {
+        return false;
+    }
+
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    m_offset = offset;
+    m_failed = false;
+    m_allocated = false;
+    m_used = 0;
+
+    if(m_fd < 0)
+    {
+        return false;
+    }
+
+    if(ftruncate(m_fd, m_offset) != 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+bool PwritevFileWriter::write(const char* data, size_t size)
+{
+    if(m_fd < 0 || m_failed)
+    {
+        return false;
+    }
+
+    //Крупный участок записываем вместе с буфером, не копируя
+    if(size >= m_bufferSize)
+    {
+        return flush(data, size);
+    }
+
+    //Мелкий участок дописываем в буфер, полный буфер сбрасываем на диск
+    size_t portion = std::min(size, m_bufferSize - m_used);
+    std::memcpy(m_buffer + m_used, data, portion);
+    m_used += portion;
+
+    if(m_used == m_bufferSize)
+    {
+        if(!flush(nullptr, 0))
+        {
+            return false;
+        }
+
+        std::memcpy(m_buffer, data + portion, size - portion);
+        m_used = size - portion;
+    }
+
+    return true;
+}
+
+bool PwritevFileWriter::close()
+{
+    if(m_fd < 0)
+    {
+        return true;
+    }
+
+    flush(nullptr, 0);
+
+    //Отдаём неиспользованный остаток зарезервированного места
+    if(m_allocated && ftruncate(m_fd, m_offset) != 0)
+    {
+        m_failed = true;
+    }
+
+    if(::close(m_fd) != 0)
+    {
+        m_failed = true;
+    }
+
+    m_fd = -1;
+
+    //Простаивающий писатель буфер не держит
+    std::free(m_buffer);
+    m_buffer = nullptr;
+
+    return !m_failed;
+}
+
+bool PwritevFileWriter::preallocate(uint64_t size, bool keepSize)
+{
+    if(m_fd < 0)
+    {
+        return true;
+    }
+
+    //Данные из буфера ещё не на диске, но их место уже учтено в m_offset + m_used
+    bool allocated = false;
+    bool result = allocateSpace(m_fd, m_offset + m_used, size, keepSize, allocated);
+    m_allocated = m_allocated || allocated;
+
+    return result;
+}
+
+bool PwritevFileWriter::isOpen() const
+{
+    return m_fd >= 0;
+}
+
+FileWriter::Backend PwritevFileWriter::backend() const
+{
+    return Pwritev;
+}
+
+bool PwritevFileWriter::allocateBuffer()
+{
+    if(m_buffer)
+    {
+        return true;
+    }
+
+    void* buffer = nullptr;
+
+    if(posix_memalign(&buffer, bufferAlignment, m_bufferSize) != 0)
+    {
+        return false;
+    }
+
+    m_buffer = static_cast<char*>(buffer);
+    return true;
+}
+
+bool PwritevFileWriter::flush(const char* data, size_t size)
+{
+    struct iovec iov[2];
+    int count = 0;
+
+    if(m_used > 0)
+    {
+        iov[count].iov_base = m_buffer;
+        iov[count].iov_len = m_used;
+        count++;
+    }
+
+    if(size > 0)
+    {
+        iov[count].iov_base = const_cast<char*>(data);
+        iov[count].iov_len = size;
+        count++;
+    }
+
+    struct iovec* current = iov;
+
+    while(count > 0)
+    {
+        ssize_t written = pwritev(m_fd, current, count, m_offset);
+
+        if(written < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            m_failed = true;
+            return false;
+        }
+
+        m_offset += written;
+
+        //Частичная запись - пропускаем уже записанное
+        while(count > 0 && static_cast<size_t>(written) >= current->iov_len)
+        {
+            written -= current->iov_len;
+            current++;
+            count--;
+        }
+
+        if(count > 0)
+        {
+            current->iov_base = static_cast<char*>(current->iov_base) + written;
+            current->iov_len -= written;
+        }
+    }
+
+    m_used = 0;
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef PWRITEV_FILE_WRITER_H
+#define PWRITEV_FILE_WRITER_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "FileWriter.h"
+
+
+//Запись через крупный выровненный по странице буфер. Мелкие участки копируются в буфер,
+//крупные уходят на диск вместе с содержимым буфера одним вызовом pwritev без копирования.
+//Буфер выделяется при открытии файла и освобождается при закрытии
+class PwritevFileWriter : public FileWriter
+{
+public:
+    PwritevFileWriter(size_t bufferSize = 1024 * 1024);
+    ~PwritevFileWriter();
+
+    bool open(const std::string& path) override;
+    bool reopen(const std::string& path, uint64_t offset) override;
+    bool write(const char* data, size_t size) override;
+    bool close() override;
+    bool preallocate(uint64_t size, bool keepSize) override;
+    bool isOpen() const override;
+    Backend backend() const override;
+
+private:
+    int m_fd;
+    off_t m_offset;
+    bool m_failed;
+    bool m_allocated;   //Файл расширен fallocate, при закрытии его нужно обрезать
+
+    char* m_buffer;
+    size_t m_bufferSize;
+    size_t m_used;
+
+    bool allocateBuffer();
+    bool flush(const char* data, size_t size);
+};
+
+#endif //PWRITEV_FILE_WRITER_H
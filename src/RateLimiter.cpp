@@ -0,0 +1,244 @@
+#include "RateLimiter.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+#include "Metrics.h"
+
+
+RateLimiter::RateLimiter(double requestsPerSecond, double requestBurst,
+                         double bytesPerSecond, double byteBurst,
+                         size_t capacity,
+                         std::shared_ptr<spdlog::logger> logger) :
+             m_requestInterval(requestsPerSecond > 0 ? static_cast<int64_t>(1e9 / requestsPerSecond) : 0),
+             m_requestTolerance(static_cast<int64_t>(m_requestInterval * std::max(requestBurst, 1.0))),
+             m_byteInterval(bytesPerSecond > 0 ? 1e9 / bytesPerSecond : 0),
+             m_byteTolerance(static_cast<int64_t>(m_byteInterval * std::max(byteBurst, 1.0))),
+             m_shardSize(std::max(capacity / shardCount, maxProbes)),
+             m_slots(new Slot[shardCount * m_shardSize]),
+             m_logger(logger),
+             m_lastLogTime(0),
+             m_suppressed(0)
+{
+    for(size_t i = 0; i < shardCount * m_shardSize; i++)
+    {
+        m_slots[i].key.store(0, std::memory_order_relaxed);
+        m_slots[i].lastSeen.store(0, std::memory_order_relaxed);
+        m_slots[i].requestTat.store(0, std::memory_order_relaxed);
+        m_slots[i].byteTat.store(0, std::memory_order_relaxed);
+    }
+}
+
+void RateLimiter::setMetrics(std::shared_ptr<Metrics> metrics)
+{
+    m_metrics = metrics;
+}
+
+void RateLimiter::addRoute(const std::string& path, size_t maxConcurrent)
+{
+    Route route;
+    route.path = path;
+    route.maxConcurrent = maxConcurrent;
+    route.active.reset(new std::atomic<size_t>(0));
+
+    m_routes.push_back(std::move(route));
+}
+
+std::chrono::nanoseconds RateLimiter::request(const std::string& client)
+{
+    if(m_requestInterval == 0)
+    {
+        return std::chrono::nanoseconds(0);
+    }
+
+    int64_t now = timestamp();
+
+    Slot* slot = findSlot(client, now);
+    if(!slot)
+    {
+        return std::chrono::nanoseconds(0);
+    }
+
+    std::chrono::nanoseconds wait = take(slot->requestTat, now, m_requestInterval, m_requestTolerance, false);
+
+    if(wait.count() > 0)
+    {
+        if(m_metrics)
+        {
+            m_metrics->limited(Metrics::RequestRate);
+        }
+
+        logRejection(client, "request rate exceeded", now);
+    }
+
+    return wait;
+}
+
+std::chrono::nanoseconds RateLimiter::received(const std::string& client, uint64_t bytes)
+{
+    if(m_byteInterval == 0 || bytes == 0)
+    {
+        return std::chrono::nanoseconds(0);
+    }
+
+    int64_t now = timestamp();
+
+    Slot* slot = findSlot(client, now);
+    if(!slot)
+    {
+        return std::chrono::nanoseconds(0);
+    }
+
+    //Байты уже прочитаны, поэтому они списываются всегда, а клиент ждёт, пока ведро снова наполнится
+    std::chrono::nanoseconds wait = take(slot->byteTat, now, static_cast<int64_t>(bytes * m_byteInterval), m_byteTolerance, true);
+
+    if(wait.count() > 0 && m_metrics)
+    {
+        m_metrics->throttled(wait);
+    }
+
+    return wait;
+}
+
+bool RateLimiter::enter(const std::string& client, const std::string& path, std::shared_ptr<void>& ticket)
+{
+    for(Route& route : m_routes)
+    {
+        bool prefix = !route.path.empty() && route.path.back() == '/';
+        bool matches = prefix ? path.compare(0, route.path.size(), route.path) == 0 : path == route.path;
+
+        if(!matches)
+        {
+            continue;
+        }
+
+        std::atomic<size_t>* active = route.active.get();
+
+        if(active->fetch_add(1, std::memory_order_acq_rel) >= route.maxConcurrent)
+        {
+            active->fetch_sub(1, std::memory_order_acq_rel);
+
+            if(m_metrics)
+            {
+                m_metrics->limited(Metrics::Concurrency);
+            }
+
+            logRejection(client, "route " + route.path + " is at its concurrency limit", timestamp());
+            return false;
+        }
+
+        ticket = std::shared_ptr<void>(active, [](std::atomic<size_t>* counter)
+                                               {
+                                                   counter->fetch_sub(1, std::memory_order_acq_rel);
+                                               });
+        return true;
+    }
+
+    return true;
+}
+
+RateLimiter::Slot* RateLimiter::findSlot(const std::string& client, int64_t now)
+{
+    uint64_t key = std::hash<std::string>()(client);
+    if(key == 0)
+    {
+        key = 1;
+    }
+
+    //Младшие биты хэша выбирают шард, остальные - начало поиска внутри шарда
+    Slot* shard = &m_slots[(key % shardCount) * m_shardSize];
+    size_t start = (key / shardCount) % m_shardSize;
+
+    //Свободная запись или запись клиента, который дольше всех не появлялся
+    Slot* candidate = nullptr;
+    uint64_t candidateKey = 0;
+    int64_t candidateSeen = std::numeric_limits<int64_t>::max();
+
+    for(size_t i = 0; i < maxProbes; i++)
+    {
+        Slot& slot = shard[(start + i) % m_shardSize];
+        uint64_t slotKey = slot.key.load(std::memory_order_acquire);
+
+        if(slotKey == key)
+        {
+            slot.lastSeen.store(now, std::memory_order_relaxed);
+            return &slot;
+        }
+
+        int64_t seen = slotKey == 0 ? std::numeric_limits<int64_t>::min() : slot.lastSeen.load(std::memory_order_relaxed);
+        if(seen < candidateSeen)
+        {
+            candidate = &slot;
+            candidateKey = slotKey;
+            candidateSeen = seen;
+        }
+    }
+
+    if(!candidate->key.compare_exchange_strong(candidateKey, key, std::memory_order_acq_rel))
+    {
+        //Запись одновременно занял другой поток. Если для того же клиента - пользуемся ей,
+        //иначе этот запрос пропускаем без ограничения, следующий найдёт себе место
+        return candidateKey == key ? candidate : nullptr;
+    }
+
+    //Ведра нового клиента полные
+    candidate->requestTat.store(0, std::memory_order_relaxed);
+    candidate->byteTat.store(0, std::memory_order_relaxed);
+    candidate->lastSeen.store(now, std::memory_order_relaxed);
+
+    return candidate;
+}
+
+std::chrono::nanoseconds RateLimiter::take(std::atomic<int64_t>& tat, int64_t now, int64_t cost, int64_t tolerance, bool always)
+{
+    int64_t current = tat.load(std::memory_order_relaxed);
+
+    while(true)
+    {
+        //Ведро пустеет со временем: теоретическое время прихода не может отставать от текущего
+        int64_t next = std::max(current, now) + cost;
+        int64_t wait = next - now - tolerance;
+
+        if(wait > 0 && !always)
+        {
+            return std::chrono::nanoseconds(wait);
+        }
+
+        if(tat.compare_exchange_weak(current, next, std::memory_order_relaxed))
+        {
+            return std::chrono::nanoseconds(std::max<int64_t>(wait, 0));
+        }
+    }
+}
+
+void RateLimiter::logRejection(const std::string& client, const std::string& reason, int64_t now)
+{
+    if(!m_logger)
+    {
+        return;
+    }
+
+    int64_t last = m_lastLogTime.load(std::memory_order_relaxed);
+
+    if(now - last < 1000000000 || !m_lastLogTime.compare_exchange_strong(last, now, std::memory_order_relaxed))
+    {
+        m_suppressed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    uint64_t suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+
+    std::string message = "Request from " + client + " rejected: " + reason;
+    if(suppressed > 0)
+    {
+        message += " (" + std::to_string(suppressed) + " more rejections since the previous message)";
+    }
+
+    m_logger->warn(message);
+}
+
+int64_t RateLimiter::timestamp()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
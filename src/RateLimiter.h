@@ -0,0 +1,89 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "spdlog/logger.h"
+
+
+class Metrics;
+
+//Ограничение нагрузки от клиентов. Для каждого IP два ведра токенов: запросы в секунду и байты тела в секунду.
+//Ведро хранится как одно "теоретическое время прихода" (GCRA), поэтому обновляется одним CAS без блокировок.
+//Таблица клиентов фиксированного размера, разбита на шарды с открытой адресацией. Новый клиент занимает свободную запись
+//или запись клиента, который дольше всех не появлялся. Кроме того, ограничивается число одновременных запросов к маршрутам
+class RateLimiter
+{
+public:
+    //Скорость 0 - без ограничения. burst - сколько запросов (байт) можно потратить сразу после простоя
+    RateLimiter(double requestsPerSecond, double requestBurst,
+                double bytesPerSecond, double byteBurst,
+                size_t capacity,
+                std::shared_ptr<spdlog::logger> logger);
+
+    void setMetrics(std::shared_ptr<Metrics> metrics);
+
+    //Не больше maxConcurrent одновременных запросов к маршруту. Маршрут, который заканчивается на '/',
+    //включает все пути с этим началом. Маршруты добавляются до запуска сервера
+    void addRoute(const std::string& path, size_t maxConcurrent);
+
+    //Очередной запрос клиента. 0 - запрос можно обрабатывать, иначе через сколько его стоит повторить
+    std::chrono::nanoseconds request(const std::string& client);
+
+    //От клиента получено bytes байт тела. Возвращает, на сколько нужно приостановить чтение,
+    //чтобы клиент не превышал свою скорость
+    std::chrono::nanoseconds received(const std::string& client, uint64_t bytes);
+
+    //Занимает место в маршруте path. false - маршрут перегружен. Место освобождается вместе с ticket
+    bool enter(const std::string& client, const std::string& path, std::shared_ptr<void>& ticket);
+
+private:
+    static const size_t shardCount = 16;
+    static const size_t maxProbes = 8;
+
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> key;          //Хэш IP, 0 - запись свободна
+        std::atomic<int64_t> lastSeen;      //Время последнего запроса, нс
+        std::atomic<int64_t> requestTat;    //Теоретическое время прихода следующего запроса, нс
+        std::atomic<int64_t> byteTat;       //То же для байт тела
+    };
+
+    struct Route
+    {
+        std::string path;
+        size_t maxConcurrent;
+        std::unique_ptr<std::atomic<size_t>> active;
+    };
+
+    const int64_t m_requestInterval;    //Нс на один запрос
+    const int64_t m_requestTolerance;   //Запас ведра запросов, нс
+    const double m_byteInterval;        //Нс на один байт
+    const int64_t m_byteTolerance;
+
+    size_t m_shardSize;
+    std::unique_ptr<Slot[]> m_slots;
+
+    std::vector<Route> m_routes;
+
+    std::shared_ptr<spdlog::logger> m_logger;
+    std::shared_ptr<Metrics> m_metrics;
+
+    //Отказы пишутся в лог не чаще раза в секунду, остальные только считаются
+    std::atomic<int64_t> m_lastLogTime;
+    std::atomic<uint64_t> m_suppressed;
+
+    Slot* findSlot(const std::string& client, int64_t now);
+    static std::chrono::nanoseconds take(std::atomic<int64_t>& tat, int64_t now, int64_t cost, int64_t tolerance, bool always);
+
+    void logRejection(const std::string& client, const std::string& reason, int64_t now);
+
+    static int64_t timestamp();
+};
+
+#endif //RATE_LIMITER_H
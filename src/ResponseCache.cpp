@@ -0,0 +1,87 @@
+#include "ResponseCache.h"
+
+#include <cstdio>
+
+
+ResponseCache::ResponseCache(std::string contentType, StampFunction stamp, BuildFunction build) :
+               m_contentType(contentType),
+               m_stamp(stamp),
+               m_build(build)
+{
+}
+
+void ResponseCache::write(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request)
+{
+    std::shared_ptr<const Entry> current = entry(m_stamp());
+
+    const std::string& bytes = matches(request->header, current->etag) ? current->notModified : current->full;
+    response->write(bytes.data(), bytes.size());
+}
+
+std::shared_ptr<const ResponseCache::Entry> ResponseCache::entry(uint64_t stamp)
+{
+    std::shared_ptr<const Entry> current = std::atomic_load(&m_entry);
+    if(current && current->stamp == stamp)
+    {
+        return current;
+    }
+
+    //Данные изменились - строим ответ заново. Параллельные запросы могут построить его одновременно,
+    //это дешевле, чем заставлять их ждать друг друга
+    auto built = std::make_shared<Entry>();
+    built->stamp = stamp;
+    built->etag = makeETag(stamp);
+
+    std::string body = m_build();
+
+    built->full = "HTTP/1.1 200 OK\r\n"
+                  "Content-Type: " + m_contentType + "\r\n"
+                  "ETag: " + built->etag + "\r\n"
+                  "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                  "\r\n" + body;
+
+    built->notModified = "HTTP/1.1 304 Not Modified\r\n"
+                         "ETag: " + built->etag + "\r\n"
+                         "\r\n";
+
+    current = built;
+    std::atomic_store(&m_entry, current);
+
+    return current;
+}
+
+std::string ResponseCache::makeETag(uint64_t stamp)
+{
+    char etag[24];
+    std::snprintf(etag, sizeof(etag), "\"%016llx\"", static_cast<unsigned long long>(stamp));
+
+    return etag;
+}
+
+bool ResponseCache::matches(const SimpleWeb::CaseInsensitiveMultimap& header, const std::string& etag)
+{
+    auto range = header.equal_range("If-None-Match");
+
+    for(auto it = range.first; it != range.second; it++)
+    {
+        //Значение - список ETag через запятую, возможно со слабыми W/
+        const std::string& value = it->second;
+
+        if(value == "*" || value.find(etag) != std::string::npos)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint64_t ResponseCache::combine(uint64_t seed, uint64_t value)
+{
+    //Перемешивание splitmix64
+    uint64_t x = seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+
+    return x ^ (x >> 31);
+}
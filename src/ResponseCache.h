@@ -0,0 +1,49 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <string>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+#include "StreamingServer.h"
+
+
+//Кэш ответа маршрута. Ответ целиком (заголовки и тело) сериализуется один раз на каждую версию данных.
+//Версию возвращает stamp - дешёвая функция, которая вызывается на каждый запрос вместо построения ответа.
+//Клиент, приславший If-None-Match с текущим ETag, получает 304 без построения ответа
+class ResponseCache
+{
+public:
+    using StampFunction = std::function<uint64_t()>;
+    using BuildFunction = std::function<std::string()>;
+
+    ResponseCache(std::string contentType, StampFunction stamp, BuildFunction build);
+
+    void write(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
+
+    //Общие части для маршрутов, которые считают версию сами
+    static std::string makeETag(uint64_t stamp);
+    static bool matches(const SimpleWeb::CaseInsensitiveMultimap& header, const std::string& etag);
+    static uint64_t combine(uint64_t seed, uint64_t value);
+
+private:
+    struct Entry
+    {
+        uint64_t stamp;
+        std::string etag;
+        std::string full;           //Ответ 200 целиком
+        std::string notModified;    //Ответ 304 целиком
+    };
+
+    std::string m_contentType;
+    StampFunction m_stamp;
+    BuildFunction m_build;
+
+    //Читается и заменяется через std::atomic_load/atomic_store
+    std::shared_ptr<const Entry> m_entry;
+
+    std::shared_ptr<const Entry> entry(uint64_t stamp);
+};
+
+#endif //RESPONSE_CACHE_H
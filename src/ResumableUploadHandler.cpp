@@ -0,0 +1,241 @@
+#include "ResumableUploadHandler.h"
+#include "JsonResponse.h"
+
+#include <stdexcept>
+
+
+ResumableUploadHandler::ResumableUploadHandler(std::shared_ptr<UploadSessions> sessions, std::shared_ptr<HttpServer::Request> request) :
+                        m_sessions(sessions),
+                        m_acquired(false),
+                        m_status(SimpleWeb::StatusCode::success_ok)
+{
+    std::string id = request->path_match[1].str();
+
+    if(!m_sessions->find(id, m_session))
+    {
+        setError(SimpleWeb::StatusCode::client_error_not_found, "Upload " + id + " not found");
+        return;
+    }
+
+    uint64_t offset = 0;
+    uint64_t contentLength = 0;
+
+    try
+    {
+        auto it = request->header.find("Upload-Offset");
+        if(it == request->header.end())
+        {
+            setError(SimpleWeb::StatusCode::client_error_bad_request, "Upload-Offset header not found");
+            return;
+        }
+        offset = std::stoull(it->second);
+
+        it = request->header.find("Content-Length");
+        if(it != request->header.end())
+        {
+            contentLength = std::stoull(it->second);
+        }
+    }
+    catch(const std::exception&)
+    {
+        setError(SimpleWeb::StatusCode::client_error_bad_request, "Invalid Upload-Offset or Content-Length");
+        return;
+    }
+
+    if(!m_sessions->acquire(id))
+    {
+        setError(SimpleWeb::StatusCode::client_error_conflict, "Upload " + id + " is receiving data");
+        return;
+    }
+    m_acquired = true;
+
+    //Смещение могло измениться, пока сессию дополнял другой запрос
+    if(!m_sessions->find(id, m_session))
+    {
+        setError(SimpleWeb::StatusCode::client_error_not_found, "Upload " + id + " not found");
+        return;
+    }
+
+    if(offset != m_session.offset)
+    {
+        setError(SimpleWeb::StatusCode::client_error_conflict, "Upload-Offset " + std::to_string(offset) +
+                 " does not match current offset " + std::to_string(m_session.offset));
+        return;
+    }
+
+    if(contentLength > m_session.length - m_session.offset)
+    {
+        setError(SimpleWeb::StatusCode::client_error_payload_too_large, "Data exceeds upload length " + std::to_string(m_session.length));
+        return;
+    }
+
+    m_writer = m_sessions->createWriter(m_session);
+
+    if(!m_writer->reopen(m_sessions->partPath(m_session), m_session.offset))
+    {
+        m_writer.reset();
+        setError(SimpleWeb::StatusCode::server_error_internal_server_error, "Cannot open file: " + m_sessions->partPath(m_session));
+        return;
+    }
+
+    m_hash = m_sessions->takeHash(m_session);
+
+    //Размер .part - смещение сессии, поэтому место резервируется за концом файла, не увеличивая его
+    if(contentLength > 0 && !m_writer->preallocate(contentLength, true))
+    {
+        setError(SimpleWeb::StatusCode::client_error_payload_too_large, "Not enough free space for " + std::to_string(contentLength) + " bytes");
+        return;
+    }
+}
+
+ResumableUploadHandler::~ResumableUploadHandler()
+{
+    //Соединение оборвалось до конца тела - принятое остаётся на диске, клиент продолжит с нового смещения
+    closeWriter([](bool /*written*/) {});
+}
+
+bool ResumableUploadHandler::admit(const std::shared_ptr<HttpServer::Request>& /*request*/)
+{
+    //Смещение, размер и сессия проверены в конструкторе, при ошибке тело не читаем
+    return m_status == SimpleWeb::StatusCode::success_ok;
+}
+
+bool ResumableUploadHandler::receive(const char* data, size_t size)
+{
+    if(m_status != SimpleWeb::StatusCode::success_ok)
+    {
+        return false;
+    }
+
+    //Без Content-Length размер заранее не проверить
+    if(size > m_session.length - m_session.offset)
+    {
+        setError(SimpleWeb::StatusCode::client_error_payload_too_large, "Data exceeds upload length " + std::to_string(m_session.length));
+        return false;
+    }
+
+    if(!m_writer->write(data, size))
+    {
+        setError(SimpleWeb::StatusCode::server_error_internal_server_error, "Cannot write file: " + m_sessions->partPath(m_session));
+        return false;
+    }
+
+    if(m_hash)
+    {
+        m_hash->update(data, size);
+    }
+
+    m_session.offset += size;
+
+    return true;
+}
+
+bool ResumableUploadHandler::ready(std::function<void()> resume)
+{
+    if(!m_writer)
+    {
+        return true;
+    }
+
+    return m_writer->ready(std::move(resume));
+}
+
+void ResumableUploadHandler::finish(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> /*request*/)
+{
+    //Отвечаем, когда данные записаны на диск. Смещение в ответе - то, что действительно записано
+    std::shared_ptr<UploadSessions> sessions = m_sessions;
+    std::string id = m_session.id;
+    SimpleWeb::StatusCode status = m_status;
+    std::string lastError = m_lastError;
+
+    closeWriter([sessions, id, status, lastError, response](bool written)
+                {
+                    SimpleWeb::StatusCode responseStatus = status;
+                    std::string description = lastError;
+
+                    if(status == SimpleWeb::StatusCode::success_ok && !written)
+                    {
+                        responseStatus = SimpleWeb::StatusCode::server_error_internal_server_error;
+                        description = "Error while writing file to disk";
+                    }
+
+                    UploadSessions::Session session;
+                    bool found = sessions->find(id, session);
+
+                    std::string offsetHeader;
+                    if(found)
+                    {
+                        offsetHeader = "Upload-Offset: " + std::to_string(session.offset) + "\r\n";
+                    }
+
+                    JsonResponse result(responseStatus, offsetHeader);
+                    JsonWriter& body = result.body();
+
+                    body.beginObject();
+
+                    if(responseStatus == SimpleWeb::StatusCode::success_ok)
+                    {
+                        body.field("status", "success");
+                    }
+                    else
+                    {
+                        body.field("status", "error")
+                            .field("description", description);
+                    }
+
+                    if(found)
+                    {
+                        body.field("id", session.id)
+                            .field("offset", session.offset)
+                            .field("length", session.length);
+                    }
+
+                    body.endObject();
+
+                    result.send(response);
+                });
+}
+
+void ResumableUploadHandler::setError(SimpleWeb::StatusCode status, const std::string& description)
+{
+    m_status = status;
+    m_lastError = description;
+}
+
+void ResumableUploadHandler::closeWriter(std::function<void(bool)> callback)
+{
+    std::shared_ptr<UploadSessions> sessions = m_sessions;
+    std::string id = m_session.id;
+    bool acquired = m_acquired;
+
+    m_acquired = false;
+
+    if(!m_writer)
+    {
+        if(acquired)
+        {
+            sessions->release(id);
+        }
+
+        callback(true);
+        return;
+    }
+
+    std::shared_ptr<FileWriter> writer = std::move(m_writer);
+    std::shared_ptr<ContentHash> hash = std::move(m_hash);
+    uint64_t offset = m_session.offset;
+    bool closed = writer->close();
+
+    //Писатель живёт до конца записи, затем сессию можно дополнять снова.
+    //Хэш годится для следующего запроса, только если всё посчитанное действительно записано
+    writer->whenWritten([writer, sessions, id, hash, offset, closed, callback](bool written)
+                        {
+                            if(written && closed && hash)
+                            {
+                                sessions->storeHash(id, hash, offset);
+                            }
+
+                            sessions->release(id);
+                            callback(written && closed);
+                        });
+}
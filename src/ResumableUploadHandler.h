@@ -0,0 +1,41 @@
+#ifndef RESUMABLE_UPLOAD_HANDLER_H
+#define RESUMABLE_UPLOAD_HANDLER_H
+
+#include <memory>
+#include <string>
+
+#include "UploadSessions.h"
+#include "StreamingServer.h"
+
+
+//Потоковый обработчик PATCH /uploads/<id>: дописывает тело запроса в файл сессии начиная со смещения Upload-Offset.
+//Если соединение оборвётся, принятая часть останется на диске и загрузку можно продолжить с нового смещения
+class ResumableUploadHandler : public HttpServer::StreamHandler
+{
+public:
+    ResumableUploadHandler(std::shared_ptr<UploadSessions> sessions, std::shared_ptr<HttpServer::Request> request);
+    ~ResumableUploadHandler();
+
+    bool admit(const std::shared_ptr<HttpServer::Request>& request) override;
+    bool receive(const char* data, size_t size) override;
+    bool ready(std::function<void()> resume) override;
+    void finish(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request) override;
+
+private:
+    std::shared_ptr<UploadSessions> m_sessions;
+    UploadSessions::Session m_session;
+
+    std::shared_ptr<FileWriter> m_writer;
+    std::shared_ptr<ContentHash> m_hash;    //Хэш принятой части при хранении по содержимому
+    bool m_acquired;    //Сессия захвачена этим запросом, её нужно освободить после записи
+
+    SimpleWeb::StatusCode m_status;
+    std::string m_lastError;
+
+    void setError(SimpleWeb::StatusCode status, const std::string& description);
+
+    //Освобождает сессию, когда всё принятое записано на диск
+    void closeWriter(std::function<void(bool)> callback);
+};
+
+#endif //RESUMABLE_UPLOAD_HANDLER_H
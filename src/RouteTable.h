@@ -0,0 +1,223 @@
+#ifndef ROUTE_TABLE_H
+#define ROUTE_TABLE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <cstddef>
+#include <cctype>
+
+#include "server_http.hpp"
+
+
+//Индекс маршрутов SimpleWeb (регулярное выражение -> метод -> обработчик), чтобы не проверять
+//регулярные выражения по очереди на каждый запрос.
+//Выражение без спецсимволов ("^/info$") попадает в хэш-таблицу точных путей. У остальных берётся литеральное начало:
+//если в нём целиком есть первый сегмент пути ("^/files/([^/]+)$" -> "files"), маршрут лежит в хэш-таблице по сегменту,
+//иначе в общем списке. Регулярное выражение проверяется только у маршрутов из своего сегмента и общего списка,
+//и только если путь начинается с литерального начала.
+//Точный путь проверяется раньше выражений. Для него path_match запроса не заполняется.
+//Индекс строится заново после изменения таблицы маршрутов, обработчики должны оставаться на своих местах
+template <typename Handler>
+class RouteTable
+{
+public:
+    //resources - таблица вида std::map<regex_orderable, std::map<метод, Handler>>
+    template <typename Resources>
+    void build(Resources& resources)
+    {
+        m_methods.clear();
+        m_strings.clear();
+
+        size_t order = 0;
+
+        for(auto& regexMethod : resources)
+        {
+            for(auto& methodHandler : regexMethod.second)
+            {
+                add(methodHandler.first, regexMethod.first.str, regexMethod.first, &methodHandler.second, order++);
+            }
+        }
+    }
+
+    //nullptr - подходящего маршрута нет
+    Handler* find(const std::string& method, const std::string& path, SimpleWeb::regex::smatch& match) const
+    {
+        auto table = m_methods.find(method);
+        if(table == m_methods.end())
+        {
+            return nullptr;
+        }
+
+        auto exact = table->second.exact.find(std::string_view(path));
+        if(exact != table->second.exact.end())
+        {
+            return exact->second;
+        }
+
+        //Маршруты сегмента и общие проверяем в порядке таблицы SimpleWeb
+        static const std::vector<Route> none;
+        const std::vector<Route>* segmentRoutes = &none;
+
+        auto segment = table->second.bySegment.find(firstSegment(path));
+        if(segment != table->second.bySegment.end())
+        {
+            segmentRoutes = &segment->second;
+        }
+
+        const std::vector<Route>& genericRoutes = table->second.generic;
+
+        size_t s = 0;
+        size_t g = 0;
+
+        while(s < segmentRoutes->size() || g < genericRoutes.size())
+        {
+            bool takeSegment = g == genericRoutes.size() ||
+                               (s < segmentRoutes->size() && (*segmentRoutes)[s].order < genericRoutes[g].order);
+
+            const Route& route = takeSegment ? (*segmentRoutes)[s++] : genericRoutes[g++];
+
+            if(path.compare(0, route.prefix.size(), route.prefix) != 0)
+            {
+                continue;
+            }
+
+            if(SimpleWeb::regex::regex_match(path, match, *route.pattern))
+            {
+                return route.handler;
+            }
+        }
+
+        return nullptr;
+    }
+
+    //Литеральное начало выражения. exact - выражение целиком литеральное
+    static std::string literalPrefix(const std::string& pattern, bool& exact)
+    {
+        std::string prefix;
+        exact = false;
+
+        size_t i = 0;
+        if(i < pattern.size() && pattern[i] == '^')
+        {
+            i++;
+        }
+
+        //Альтернатива на любом уровне может начинаться с чего угодно
+        for(size_t k = 0; k < pattern.size(); k++)
+        {
+            if(pattern[k] == '\\')
+            {
+                k++;
+            }
+            else if(pattern[k] == '|')
+            {
+                return prefix;
+            }
+        }
+
+        while(i < pattern.size())
+        {
+            char c = pattern[i];
+            char literal = 0;
+            size_t next = i + 1;
+
+            if(c == '\\' && i + 1 < pattern.size() && std::ispunct(static_cast<unsigned char>(pattern[i + 1])))
+            {
+                literal = pattern[i + 1];
+                next = i + 2;
+            }
+            else if(c == '$' && i + 1 == pattern.size())
+            {
+                exact = true;
+                return prefix;
+            }
+            else if(std::string(".[]{}()*+?|^$\\").find(c) == std::string::npos)
+            {
+                literal = c;
+            }
+
+            if(literal == 0)
+            {
+                return prefix;
+            }
+
+            //Символ с квантификатором не обязателен
+            if(next < pattern.size() && (pattern[next] == '*' || pattern[next] == '?' || pattern[next] == '{' || pattern[next] == '+'))
+            {
+                return prefix;
+            }
+
+            prefix.push_back(literal);
+            i = next;
+        }
+
+        //Без '$' regex_match всё равно требует совпадения всей строки
+        exact = true;
+        return prefix;
+    }
+
+private:
+    struct Route
+    {
+        size_t order;
+        std::string prefix;
+        const SimpleWeb::regex::regex* pattern;
+        Handler* handler;
+    };
+
+    struct Table
+    {
+        std::unordered_map<std::string_view, Handler*> exact;
+        std::unordered_map<std::string_view, std::vector<Route>> bySegment;
+        std::vector<Route> generic;
+    };
+
+    std::unordered_map<std::string, Table> m_methods;
+    std::deque<std::string> m_strings;  //Ключи хэш-таблиц, string_view указывают сюда
+
+    void add(const std::string& method, const std::string& source, const SimpleWeb::regex::regex& pattern, Handler* handler, size_t order)
+    {
+        Table& table = m_methods[method];
+
+        bool exact = false;
+        std::string prefix = literalPrefix(source, exact);
+
+        if(exact)
+        {
+            m_strings.push_back(prefix);
+
+            //При совпадении путей первым остаётся маршрут, который раньше в таблице SimpleWeb
+            table.exact.emplace(std::string_view(m_strings.back()), handler);
+            return;
+        }
+
+        Route route = {order, prefix, &pattern, handler};
+
+        //Сегмент известен, только если после него в литеральном начале уже есть '/'
+        size_t end = prefix.size() > 1 && prefix[0] == '/' ? prefix.find('/', 1) : std::string::npos;
+        if(end == std::string::npos)
+        {
+            table.generic.push_back(route);
+            return;
+        }
+
+        m_strings.push_back(prefix.substr(1, end - 1));
+        table.bySegment[std::string_view(m_strings.back())].push_back(route);
+    }
+
+    static std::string_view firstSegment(const std::string& path)
+    {
+        if(path.empty() || path[0] != '/')
+        {
+            return std::string_view();
+        }
+
+        size_t end = path.find('/', 1);
+        return std::string_view(path).substr(1, end == std::string::npos ? std::string::npos : end - 1);
+    }
+};
+
+#endif //ROUTE_TABLE_H
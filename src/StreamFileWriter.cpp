@@ -0,0 +1,50 @@
+#include "StreamFileWriter.h"
+
+#include <unistd.h>
+
+
+bool StreamFileWriter::open(const std::string& path)
+{
+    m_file.open(path, std::ios::binary);
+
+    return m_file.is_open();
+}
+
+bool StreamFileWriter::reopen(const std::string& path, uint64_t offset)
+{
+    if(::truncate(path.c_str(), offset) != 0)
+    {
+        return false;
+    }
+
+    m_file.open(path, std::ios::binary | std::ios::app);
+
+    return m_file.is_open();
+}
+
+bool StreamFileWriter::write(const char* data, size_t size)
+{
+    m_file.write(data, size);
+
+    return m_file.good();
+}
+
+bool StreamFileWriter::close()
+{
+    m_file.close();
+
+    bool result = !m_file.fail();
+    m_file.clear();
+
+    return result;
+}
+
+bool StreamFileWriter::isOpen() const
+{
+    return m_file.is_open();
+}
+
+FileWriter::Backend StreamFileWriter::backend() const
+{
+    return Stream;
+}
@@ -0,0 +1,24 @@
+#ifndef STREAM_FILE_WRITER_H
+#define STREAM_FILE_WRITER_H
+
+#include <fstream>
+
+#include "FileWriter.h"
+
+
+//Запись через std::ofstream с буферизацией по умолчанию
+class StreamFileWriter : public FileWriter
+{
+public:
+    bool open(const std::string& path) override;
+    bool reopen(const std::string& path, uint64_t offset) override;
+    bool write(const char* data, size_t size) override;
+    bool close() override;
+    bool isOpen() const override;
+    Backend backend() const override;
+
+private:
+    std::ofstream m_file;
+};
+
+#endif //STREAM_FILE_WRITER_H
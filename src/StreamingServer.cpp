@@ -0,0 +1,842 @@
+#include "StreamingServer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/sendfile.h>
+
+
+namespace SimpleWeb
+{
+    Server<StreamingHTTP>::FilePart::FilePart(int fd, unsigned long long offset, unsigned long long length) noexcept :
+                                     fd(fd),
+                                     offset(offset),
+                                     length(length)
+    {
+    }
+
+    Server<StreamingHTTP>::FilePart::FilePart(FilePart&& other) noexcept :
+                                     fd(other.fd),
+                                     offset(other.offset),
+                                     length(other.length)
+    {
+        other.fd = -1;
+    }
+
+    Server<StreamingHTTP>::FilePart::~FilePart()
+    {
+        if(fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+
+    Server<StreamingHTTP>::Server() noexcept :
+                                     ServerBase<StreamingHTTP>::ServerBase(80),
+                                     streamBufferSize(64 * 1024),
+                                     maxStreamBodySize(0)
+    {
+    }
+
+    size_t Server<StreamingHTTP>::activeConnections()
+    {
+        std::lock_guard<std::mutex> lock(*connections_mutex);
+        return connections->size();
+    }
+
+    unsigned short Server<StreamingHTTP>::bindShared()
+    {
+        std::lock_guard<std::mutex> lock(start_stop_mutex);
+
+        asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), config.port);
+        if(!config.address.empty())
+        {
+            endpoint = asio::ip::tcp::endpoint(asio::ip::make_address(config.address), config.port);
+        }
+
+        if(!io_service)
+        {
+            io_service = std::make_shared<io_context>();
+            internal_io_service = true;
+        }
+
+        //Опцию нужно выставить до bind, поэтому ServerBase::bind здесь не подходит
+        acceptor = std::unique_ptr<asio::ip::tcp::acceptor>(new asio::ip::tcp::acceptor(*io_service));
+        acceptor->open(endpoint.protocol());
+        acceptor->set_option(asio::socket_base::reuse_address(config.reuse_address));
+        acceptor->set_option(asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+        acceptor->bind(endpoint);
+
+        after_bind();
+
+        return acceptor->local_endpoint().port();
+    }
+
+    void Server<StreamingHTTP>::after_bind()
+    {
+        m_streamRoutes.build(streamResource);
+        m_fileRoutes.build(fileResource);
+        m_routes.build(resource);
+    }
+
+    void Server<StreamingHTTP>::accept()
+    {
+        auto connection = create_connection(*io_service);
+
+        acceptor->async_accept(*connection->socket, [this, connection](const error_code& ec)
+        {
+            auto lock = connection->handler_runner->continue_lock();
+            if(!lock)
+            {
+                return;
+            }
+
+            //Сразу начинаем принимать следующее соединение (если io_service не остановлен)
+            if(ec != asio::error::operation_aborted)
+            {
+                this->accept();
+            }
+
+            std::shared_ptr<Session> session = std::make_shared<StreamSession>(config.max_request_streambuf_size, connection);
+
+            if(!ec)
+            {
+                asio::ip::tcp::no_delay option(true);
+                error_code optionError;
+                session->connection->socket->set_option(option, optionError);
+
+                readRequest(session);
+            }
+            else if(on_error)
+            {
+                on_error(session->request, ec);
+            }
+        });
+    }
+
+    void Server<StreamingHTTP>::readRequest(const std::shared_ptr<Session>& session)
+    {
+        session->connection->set_timeout(config.timeout_request);
+
+        asio::async_read_until(*session->connection->socket, session->request->streambuf, "\r\n\r\n",
+                               [this, session](const error_code& ec, size_t bytesTransferred)
+        {
+            auto lock = session->connection->handler_runner->continue_lock();
+            if(!lock)
+            {
+                return;
+            }
+
+            session->request->header_read_time = std::chrono::system_clock::now();
+
+            if(ec)
+            {
+                if(on_error)
+                {
+                    on_error(session->request, ec);
+                }
+                return;
+            }
+
+            //Вместе с заголовком в буфер могли попасть первые байты тела
+            size_t additionalBytes = session->request->streambuf.size() - bytesTransferred;
+
+            if(!RequestMessage::parse(session->request->content, session->request->method, session->request->path,
+                                      session->request->query_string, session->request->http_version, session->request->header))
+            {
+                if(on_error)
+                {
+                    on_error(session->request, make_error_code::make_error_code(errc::protocol_error));
+                }
+                return;
+            }
+
+            //Длина тела задана и Content-Length, и Transfer-Encoding: прокси и сервер могут по-разному
+            //найти конец запроса, поэтому такой запрос не принимаем ни на потоковых, ни на обычных маршрутах (RFC 9112, 6.1)
+            if(session->request->header.find("Content-Length") != session->request->header.end() &&
+               session->request->header.find("Transfer-Encoding") != session->request->header.end())
+            {
+                rejectStream(session, StatusCode::client_error_bad_request);
+                return;
+            }
+
+            if(onRequest)
+            {
+                Admission& admission = static_cast<StreamSession&>(*session).admission;
+                admission = onRequest(session->request);
+
+                if(admission.status != StatusCode::success_ok)
+                {
+                    rejectRequest(session, additionalBytes);
+                    return;
+                }
+            }
+
+            StreamHandlerFactory* factory = findStreamResource(session);
+            if(factory)
+            {
+                readStream(session, (*factory)(session->request), additionalBytes);
+                return;
+            }
+
+            readContent(session, additionalBytes);
+        });
+    }
+
+    void Server<StreamingHTTP>::readContent(const std::shared_ptr<Session>& session, size_t additionalBytes)
+    {
+        if(session->request->header.find("Content-Length") != session->request->header.end())
+        {
+            unsigned long long contentLength = 0;
+            if(!getContentLength(session, contentLength))
+            {
+                return;
+            }
+
+            if(contentLength <= additionalBytes)
+            {
+                findResource(session);
+                return;
+            }
+
+            session->connection->set_timeout(config.timeout_content);
+
+            asio::async_read(*session->connection->socket, session->request->streambuf, asio::transfer_exactly(contentLength - additionalBytes),
+                             [this, session](const error_code& ec, size_t /*bytesTransferred*/)
+            {
+                auto lock = session->connection->handler_runner->continue_lock();
+                if(!lock)
+                {
+                    return;
+                }
+
+                if(ec)
+                {
+                    if(on_error)
+                    {
+                        on_error(session->request, ec);
+                    }
+                    return;
+                }
+
+                if(session->request->streambuf.size() == session->request->streambuf.max_size())
+                {
+                    ResourceFunction payloadTooLarge = [](std::shared_ptr<Response> response, std::shared_ptr<Request> /*request*/)
+                                                       {
+                                                           response->close_connection_after_response = true;
+                                                           response->write(StatusCode::client_error_payload_too_large);
+                                                       };
+
+                    writeResponse(session, payloadTooLarge);
+                    return;
+                }
+
+                findResource(session);
+            });
+
+            return;
+        }
+
+        auto transferEncoding = session->request->header.find("Transfer-Encoding");
+        if(transferEncoding != session->request->header.end() && case_insensitive_equal(transferEncoding->second, "chunked"))
+        {
+            //Разбор chunked тела оставляем SimpleWeb. Такое соединение дальше обслуживается обычным ServerBase::read,
+            //на его последующих запросах потоковое чтение тела не используется
+            auto chunksStreambuf = std::make_shared<asio::streambuf>(config.max_request_streambuf_size);
+            read_chunked_transfer_encoded(session, chunksStreambuf);
+            return;
+        }
+
+        findResource(session);
+    }
+
+    void Server<StreamingHTTP>::rejectRequest(const std::shared_ptr<Session>& session, size_t additionalBytes)
+    {
+        const Admission& admission = static_cast<StreamSession&>(*session).admission;
+
+        unsigned long long contentLength = 0;
+        if(!getContentLength(session, contentLength))
+        {
+            return;
+        }
+
+        //Тело не читаем. Если оно пришло не целиком вместе с заголовком, следующий запрос из соединения не прочитать
+        bool bodyUnread = contentLength > additionalBytes ||
+                          session->request->header.find("Transfer-Encoding") != session->request->header.end();
+
+        StatusCode status = admission.status;
+        CaseInsensitiveMultimap header = admission.header;
+
+        ResourceFunction reject = [status, header, bodyUnread](std::shared_ptr<Response> response, std::shared_ptr<Request> /*request*/)
+                                  {
+                                      response->close_connection_after_response = bodyUnread;
+                                      response->write(status, header);
+                                  };
+
+        writeResponse(session, reject);
+    }
+
+    void Server<StreamingHTTP>::readStream(const std::shared_ptr<Session>& session,
+                                           const std::shared_ptr<StreamHandler>& handler,
+                                           size_t additionalBytes)
+    {
+        if(session->request->header.find("Content-Length") == session->request->header.end() &&
+           session->request->header.find("Transfer-Encoding") != session->request->header.end())
+        {
+            //Потоковое чтение работает только с известной длиной тела
+            rejectStream(session, StatusCode::client_error_length_required);
+            return;
+        }
+
+        unsigned long long contentLength = 0;
+        if(!getContentLength(session, contentLength))
+        {
+            return;
+        }
+
+        //Всё, что можно решить по заголовкам, решаем до чтения тела
+        if(maxStreamBodySize > 0 && contentLength > maxStreamBodySize)
+        {
+            rejectStream(session, StatusCode::client_error_payload_too_large);
+            return;
+        }
+
+        //Из ожиданий клиента поддерживается только 100-continue
+        auto expect = session->request->header.find("Expect");
+        if(expect != session->request->header.end() && !case_insensitive_equal(expect->second, "100-continue"))
+        {
+            rejectStream(session, StatusCode::client_error_expectation_failed);
+            return;
+        }
+
+        if(!handler->admit(session->request))
+        {
+            finishStream(session, handler, false);
+            return;
+        }
+
+        //Клиент ждёт разрешения, прежде чем отправлять тело
+        if(expect != session->request->header.end() && additionalBytes < contentLength)
+        {
+            auto continueResponse = std::make_shared<std::string>("HTTP/1.1 100 Continue\r\n\r\n");
+
+            asio::async_write(*session->connection->socket, asio::buffer(*continueResponse),
+                              [this, session, handler, additionalBytes, contentLength, continueResponse](const error_code& ec, size_t /*bytesTransferred*/)
+            {
+                auto lock = session->connection->handler_runner->continue_lock();
+                if(!lock)
+                {
+                    return;
+                }
+
+                if(ec)
+                {
+                    if(on_error)
+                    {
+                        on_error(session->request, ec);
+                    }
+                    return;
+                }
+
+                receiveStream(session, handler, additionalBytes, contentLength);
+            });
+            return;
+        }
+
+        receiveStream(session, handler, additionalBytes, contentLength);
+    }
+
+    void Server<StreamingHTTP>::receiveStream(const std::shared_ptr<Session>& session,
+                                              const std::shared_ptr<StreamHandler>& handler,
+                                              size_t additionalBytes,
+                                              unsigned long long contentLength)
+    {
+        auto buffer = std::make_shared<std::vector<char>>(streamBufferSize);
+
+        //Отдаём обработчику байты тела, прочитанные вместе с заголовком
+        size_t initialBytes = static_cast<size_t>(std::min<unsigned long long>(additionalBytes, contentLength));
+        size_t receivedBytes = initialBytes;
+
+        while(initialBytes > 0)
+        {
+            size_t portion = asio::buffer_copy(asio::buffer(buffer->data(), std::min(initialBytes, buffer->size())),
+                                               session->request->streambuf.data());
+            session->request->streambuf.consume(portion);
+            initialBytes -= portion;
+            contentLength -= portion;
+
+            if(!handler->receive(buffer->data(), portion))
+            {
+                finishStream(session, handler, false);
+                return;
+            }
+        }
+
+        //Байты, пришедшие с заголовком, тоже учитываются в скорости клиента: пауза придётся на следующую порцию
+        const Admission& admission = static_cast<StreamSession&>(*session).admission;
+        if(admission.pace && receivedBytes > 0)
+        {
+            admission.pace(receivedBytes);
+        }
+
+        readStreamChunk(session, handler, buffer, contentLength);
+    }
+
+    void Server<StreamingHTTP>::rejectStream(const std::shared_ptr<Session>& session, StatusCode status)
+    {
+        //Тело не прочитано, поэтому следующий запрос из этого соединения читать нельзя
+        ResourceFunction reject = [status](std::shared_ptr<Response> response, std::shared_ptr<Request> /*request*/)
+                                  {
+                                      response->close_connection_after_response = true;
+                                      response->write(status);
+                                  };
+
+        writeResponse(session, reject);
+    }
+
+    void Server<StreamingHTTP>::readStreamChunk(const std::shared_ptr<Session>& session,
+                                                const std::shared_ptr<StreamHandler>& handler,
+                                                const std::shared_ptr<std::vector<char>>& buffer,
+                                                unsigned long long remaining)
+    {
+        if(remaining == 0)
+        {
+            finishStream(session, handler, true);
+            return;
+        }
+
+        //Обработчик не успевает (например, диск отстаёт от сети) - не читаем сокет, пока он не позовёт нас снова.
+        //TCP окно при этом заполняется, и клиент сам замедляет отправку
+        auto resume = [this, session, handler, buffer, remaining]()
+                      {
+                          asio::post(*io_service, [this, session, handler, buffer, remaining]()
+                          {
+                              auto lock = session->connection->handler_runner->continue_lock();
+                              if(!lock)
+                              {
+                                  return;
+                              }
+
+                              readStreamChunk(session, handler, buffer, remaining);
+                          });
+                      };
+
+        if(!handler->ready(resume))
+        {
+            //Пока чтение стоит по нашей инициативе, таймаут соединения не считаем
+            session->connection->cancel_timeout();
+            return;
+        }
+
+        //Таймаут считаем от последней полученной порции, а не от начала тела: загрузка может идти часами
+        session->connection->set_timeout(config.timeout_content);
+
+        size_t size = static_cast<size_t>(std::min<unsigned long long>(remaining, buffer->size()));
+
+        session->connection->socket->async_read_some(asio::buffer(buffer->data(), size),
+                                                     [this, session, handler, buffer, remaining](const error_code& ec, size_t bytesTransferred)
+        {
+            auto lock = session->connection->handler_runner->continue_lock();
+            if(!lock)
+            {
+                return;
+            }
+
+            if(ec)
+            {
+                if(on_error)
+                {
+                    on_error(session->request, ec);
+                }
+                return;
+            }
+
+            if(!handler->receive(buffer->data(), bytesTransferred))
+            {
+                finishStream(session, handler, false);
+                return;
+            }
+
+            //Клиент превысил свою скорость - выдерживаем паузу перед следующим чтением, TCP окно замедлит его отправку
+            const Admission& admission = static_cast<StreamSession&>(*session).admission;
+            std::chrono::nanoseconds pause = admission.pace ? admission.pace(bytesTransferred) : std::chrono::nanoseconds(0);
+
+            if(pause.count() > 0 && remaining > bytesTransferred)
+            {
+                session->connection->cancel_timeout();
+
+                auto timer = std::make_shared<asio::steady_timer>(*io_service, pause);
+                timer->async_wait([this, session, handler, buffer, remaining, bytesTransferred, timer](const error_code& ec)
+                {
+                    auto lock = session->connection->handler_runner->continue_lock();
+                    if(!lock || ec)
+                    {
+                        return;
+                    }
+
+                    readStreamChunk(session, handler, buffer, remaining - bytesTransferred);
+                });
+                return;
+            }
+
+            readStreamChunk(session, handler, buffer, remaining - bytesTransferred);
+        });
+    }
+
+    void Server<StreamingHTTP>::finishStream(const std::shared_ptr<Session>& session,
+                                             const std::shared_ptr<StreamHandler>& handler,
+                                             bool completed)
+    {
+        ResourceFunction resourceFunction = [handler, completed](std::shared_ptr<Response> response, std::shared_ptr<Request> request)
+                                            {
+                                                //Непрочитанный остаток тела не позволяет читать из соединения следующий запрос
+                                                if(!completed)
+                                                {
+                                                    response->close_connection_after_response = true;
+                                                }
+
+                                                handler->finish(response, request);
+                                            };
+
+        writeResponse(session, resourceFunction);
+    }
+
+    Server<StreamingHTTP>::StreamHandlerFactory* Server<StreamingHTTP>::findStreamResource(const std::shared_ptr<Session>& session)
+    {
+        return m_streamRoutes.find(session->request->method, session->request->path, session->request->path_match);
+    }
+
+    void Server<StreamingHTTP>::findResource(const std::shared_ptr<Session>& session)
+    {
+        //Порядок как раньше: маршруты с sendfile, затем обычные, затем default_resource
+        FileResourceFunction* fileFunction = m_fileRoutes.find(session->request->method, session->request->path, session->request->path_match);
+        if(fileFunction)
+        {
+            writeFileResponse(session, *fileFunction);
+            return;
+        }
+
+        ResourceFunction* resourceFunction = m_routes.find(session->request->method, session->request->path, session->request->path_match);
+        if(resourceFunction)
+        {
+            writeResponse(session, *resourceFunction);
+            return;
+        }
+
+        auto it = default_resource.find(session->request->method);
+        if(it != default_resource.end())
+        {
+            writeResponse(session, it->second);
+        }
+    }
+
+    void Server<StreamingHTTP>::writeResponse(const std::shared_ptr<Session>& session, ResourceFunction& resourceFunction)
+    {
+        //Повторяет ServerBase::write, но следующий запрос соединения читается через readRequest
+        auto response = std::shared_ptr<Response>(new Response(session, config.timeout_content), [this](Response* responsePtr)
+        {
+            auto response = std::shared_ptr<Response>(responsePtr);
+
+            //Код ответа из строки статуса "HTTP/1.1 200 OK", пока буфер ещё не отправлен
+            int status = 0;
+            if(onResponse)
+            {
+                char statusLine[12];
+                if(asio::buffer_copy(asio::buffer(statusLine), response->streambuf->data()) == sizeof(statusLine))
+                {
+                    status = std::atoi(std::string(statusLine + 9, 3).c_str());
+                }
+            }
+
+            response->send_on_delete([this, response, status](const error_code& ec)
+            {
+                response->session->connection->cancel_timeout();
+
+                if(ec)
+                {
+                    if(on_error)
+                    {
+                        on_error(response->session->request, ec);
+                    }
+                    return;
+                }
+
+                if(onResponse)
+                {
+                    onResponse(response->session->request, status);
+                }
+
+                if(response->close_connection_after_response)
+                {
+                    return;
+                }
+
+                readNextRequest(response->session);
+            });
+        });
+
+        try
+        {
+            resourceFunction(response, session->request);
+        }
+        catch(const std::exception&)
+        {
+            if(on_error)
+            {
+                on_error(session->request, make_error_code::make_error_code(errc::operation_canceled));
+            }
+        }
+    }
+
+    bool Server<StreamingHTTP>::parseRange(const std::string& value, unsigned long long total,
+                                           unsigned long long& begin, unsigned long long& end)
+    {
+        const std::string prefix = "bytes=";
+
+        //Несколько диапазонов не поддерживаем
+        if(value.compare(0, prefix.size(), prefix) != 0 || value.find(',') != std::string::npos)
+        {
+            return false;
+        }
+
+        std::string range = value.substr(prefix.size());
+
+        size_t dash = range.find('-');
+        if(dash == std::string::npos)
+        {
+            return false;
+        }
+
+        std::string first = range.substr(0, dash);
+        std::string last = range.substr(dash + 1);
+
+        try
+        {
+            if(first.empty())
+            {
+                //bytes=-N - последние N байт
+                unsigned long long count = std::stoull(last);
+                if(count == 0 || total == 0)
+                {
+                    return false;
+                }
+
+                begin = total - std::min(count, total);
+                end = total;
+                return true;
+            }
+
+            begin = std::stoull(first);
+            end = last.empty() ? total : std::min(std::stoull(last) + 1, total);
+        }
+        catch(const std::exception&)
+        {
+            return false;
+        }
+
+        return begin < end;
+    }
+
+    void Server<StreamingHTTP>::writeFileResponse(const std::shared_ptr<Session>& session, FileResourceFunction& resourceFunction)
+    {
+        std::shared_ptr<FileResponse> fileResponse;
+
+        try
+        {
+            fileResponse = resourceFunction(session->request);
+        }
+        catch(const std::exception&)
+        {
+            if(on_error)
+            {
+                on_error(session->request, make_error_code::make_error_code(errc::operation_canceled));
+            }
+            return;
+        }
+
+        if(!fileResponse)
+        {
+            return;
+        }
+
+        unsigned long long contentLength = fileResponse->content.size();
+        if(fileResponse->memory)
+        {
+            contentLength += fileResponse->memoryLength;
+        }
+        for(auto& part : fileResponse->files)
+        {
+            contentLength += part.length;
+        }
+
+        //Заголовок и текстовую часть тела отправляем обычной записью, файлы - через sendfile
+        auto head = std::make_shared<std::string>("HTTP/1.1 " + status_code(fileResponse->status) + "\r\n");
+        for(auto& field : fileResponse->header)
+        {
+            *head += field.first + ": " + field.second + "\r\n";
+        }
+        //У 304 тела нет, Content-Length для него не отправляем
+        if(fileResponse->status != StatusCode::redirection_not_modified)
+        {
+            *head += "Content-Length: " + std::to_string(contentLength) + "\r\n";
+        }
+        *head += "\r\n";
+        *head += fileResponse->content;
+
+        session->connection->set_timeout(config.timeout_content);
+
+        std::vector<asio::const_buffer> buffers = {asio::buffer(*head)};
+        if(fileResponse->memory && fileResponse->memoryLength > 0)
+        {
+            buffers.push_back(asio::buffer(fileResponse->memory->data() + fileResponse->memoryOffset, fileResponse->memoryLength));
+        }
+
+        asio::async_write(*session->connection->socket, buffers,
+                          [this, session, fileResponse, head](const error_code& ec, size_t /*bytesTransferred*/)
+        {
+            auto lock = session->connection->handler_runner->continue_lock();
+            if(!lock)
+            {
+                return;
+            }
+
+            if(ec)
+            {
+                if(on_error)
+                {
+                    on_error(session->request, ec);
+                }
+                return;
+            }
+
+            //sendfile не должен блокировать поток сервера: при заполненном буфере сокета ждём готовности к записи
+            error_code nonBlockingError;
+            session->connection->socket->non_blocking(true, nonBlockingError);
+
+            sendFiles(session, fileResponse, 0);
+        });
+    }
+
+    void Server<StreamingHTTP>::sendFiles(const std::shared_ptr<Session>& session, const std::shared_ptr<FileResponse>& fileResponse, size_t index)
+    {
+        while(index < fileResponse->files.size())
+        {
+            FilePart& part = fileResponse->files[index];
+
+            if(part.length == 0)
+            {
+                index++;
+                continue;
+            }
+
+            off_t offset = static_cast<off_t>(part.offset);
+            ssize_t sent = ::sendfile(session->connection->socket->native_handle(), part.fd, &offset, static_cast<size_t>(part.length));
+
+            if(sent > 0)
+            {
+                part.offset += sent;
+                part.length -= sent;
+                continue;
+            }
+
+            if(sent < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                session->connection->set_timeout(config.timeout_content);
+
+                session->connection->socket->async_wait(asio::socket_base::wait_write, [this, session, fileResponse, index](const error_code& ec)
+                {
+                    auto lock = session->connection->handler_runner->continue_lock();
+                    if(!lock)
+                    {
+                        return;
+                    }
+
+                    if(ec)
+                    {
+                        if(on_error)
+                        {
+                            on_error(session->request, ec);
+                        }
+                        return;
+                    }
+
+                    sendFiles(session, fileResponse, index);
+                });
+
+                return;
+            }
+
+            //Файл стал короче, чем обещано в Content-Length, или сокет закрыт. Ответ уже не завершить, соединение закроется
+            if(on_error)
+            {
+                on_error(session->request, make_error_code::make_error_code(errc::io_error));
+            }
+            return;
+        }
+
+        session->connection->cancel_timeout();
+
+        if(onResponse)
+        {
+            onResponse(session->request, static_cast<int>(fileResponse->status));
+        }
+
+        readNextRequest(session);
+    }
+
+    void Server<StreamingHTTP>::readNextRequest(const std::shared_ptr<Session>& session)
+    {
+        auto range = session->request->header.equal_range("Connection");
+        for(auto it = range.first; it != range.second; it++)
+        {
+            if(case_insensitive_equal(it->second, "close"))
+            {
+                return;
+            }
+            else if(case_insensitive_equal(it->second, "keep-alive"))
+            {
+                auto newSession = std::make_shared<StreamSession>(config.max_request_streambuf_size, session->connection);
+                readRequest(newSession);
+                return;
+            }
+        }
+
+        if(session->request->http_version >= "1.1")
+        {
+            auto newSession = std::make_shared<StreamSession>(config.max_request_streambuf_size, session->connection);
+            readRequest(newSession);
+        }
+    }
+
+    bool Server<StreamingHTTP>::getContentLength(const std::shared_ptr<Session>& session, unsigned long long& contentLength)
+    {
+        contentLength = 0;
+
+        auto it = session->request->header.find("Content-Length");
+        if(it == session->request->header.end())
+        {
+            return true;
+        }
+
+        try
+        {
+            contentLength = std::stoull(it->second);
+        }
+        catch(const std::exception&)
+        {
+            if(on_error)
+            {
+                on_error(session->request, make_error_code::make_error_code(errc::protocol_error));
+            }
+            return false;
+        }
+
+        return true;
+    }
+}
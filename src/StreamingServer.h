@@ -0,0 +1,197 @@
+#ifndef STREAMING_SERVER_H
+#define STREAMING_SERVER_H
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <map>
+#include <functional>
+#include <chrono>
+
+#include "server_http.hpp"
+#include "RouteTable.h"
+
+
+//Сокет потокового сервера. Отдельный тип нужен только для специализации SimpleWeb::Server
+class StreamingHTTP : public asio::ip::tcp::socket
+{
+public:
+    using asio::ip::tcp::socket::basic_stream_socket;
+};
+
+
+namespace SimpleWeb
+{
+    //HTTP сервер, который умеет отдавать тело запроса обработчику порциями по мере чтения из сокета.
+    //Обычные маршруты (resource, default_resource) работают так же, как в Server<HTTP>
+    template <>
+    class Server<StreamingHTTP> : public ServerBase<StreamingHTTP>
+    {
+    public:
+        //Обработчик маршрута с потоковым чтением тела запроса
+        class StreamHandler
+        {
+        public:
+            virtual ~StreamHandler() = default;
+
+            //Вызывается после чтения заголовков, до чтения тела. Если вернуть false, тело не читается,
+            //а ответ с причиной отказа формирует finish. На Expect: 100-continue сервер отвечает только после true
+            virtual bool admit(const std::shared_ptr<Request>& /*request*/)
+            {
+                return true;
+            }
+
+            //Очередная порция тела запроса. Если вернуть false, чтение тела прекращается
+            virtual bool receive(const char* data, size_t size) = 0;
+
+            //Можно ли читать следующую порцию. Если вернуть false, чтение из сокета приостанавливается
+            //до вызова resume (из любого потока)
+            virtual bool ready(std::function<void()> /*resume*/)
+            {
+                return true;
+            }
+
+            //Тело запроса прочитано (или чтение прекращено), нужно сформировать ответ
+            virtual void finish(std::shared_ptr<Response> response, std::shared_ptr<Request> request) = 0;
+        };
+
+        using StreamHandlerFactory = std::function<std::shared_ptr<StreamHandler>(std::shared_ptr<Request>)>;
+
+        //Участок файла в теле ответа. Дескриптор принадлежит FilePart и закрывается вместе с ним
+        class FilePart
+        {
+        public:
+            FilePart(int fd, unsigned long long offset, unsigned long long length) noexcept;
+            FilePart(FilePart&& other) noexcept;
+            FilePart(const FilePart&) = delete;
+            FilePart& operator=(const FilePart&) = delete;
+            ~FilePart();
+
+            int fd;
+            unsigned long long offset;
+            unsigned long long length;
+        };
+
+        //Ответ, тело которого отправляется прямо из файлов через sendfile, без чтения в память процесса.
+        //Content-Length сервер считает сам
+        struct FileResponse
+        {
+            FileResponse() : status(StatusCode::success_ok), memoryOffset(0), memoryLength(0) {}
+
+            StatusCode status;
+            CaseInsensitiveMultimap header;
+            std::string content;            //Отправляется перед файлами, например текст ошибки
+
+            //Участок тела из общей памяти (например, из кэша файлов), отправляется без копирования после content
+            std::shared_ptr<const std::string> memory;
+            size_t memoryOffset;
+            size_t memoryLength;
+
+            std::vector<FilePart> files;
+        };
+
+        using FileResourceFunction = std::function<std::shared_ptr<FileResponse>(std::shared_ptr<Request>)>;
+
+        //Решение onRequest о запросе
+        struct Admission
+        {
+            Admission() : status(StatusCode::success_ok) {}
+
+            StatusCode status;                  //Не 200 - запрос отклоняется с этим кодом, маршрут не вызывается
+            CaseInsensitiveMultimap header;     //Заголовки ответа с отказом, например Retry-After
+
+            std::shared_ptr<void> ticket;       //Живёт, пока запрос обрабатывается и отправляется ответ
+
+            //Вызывается после чтения каждой порции тела потокового маршрута, возвращает паузу перед чтением следующей
+            std::function<std::chrono::nanoseconds(size_t bytes)> pace;
+        };
+
+        //Маршруты с потоковым чтением тела. Проверяются раньше resource
+        std::map<regex_orderable, std::map<std::string, StreamHandlerFactory>> streamResource;
+
+        //Маршруты, которые отдают файлы через sendfile. Проверяются раньше resource
+        std::map<regex_orderable, std::map<std::string, FileResourceFunction>> fileResource;
+
+        //Размер буфера чтения тела запроса для одного соединения
+        size_t streamBufferSize;
+
+        //Максимальный размер тела для потоковых маршрутов, 0 - без ограничения. Больше - 413 без чтения тела
+        unsigned long long maxStreamBodySize;
+
+        //Вызывается после разбора заголовков, до выбора маршрута и чтения тела
+        std::function<Admission(const std::shared_ptr<Request>& request)> onRequest;
+
+        //Вызывается после отправки каждого ответа, status - код ответа (0, если его не удалось разобрать)
+        std::function<void(const std::shared_ptr<Request>& request, int status)> onResponse;
+
+        Server() noexcept;
+
+        //Количество открытых соединений
+        size_t activeConnections();
+
+        //Вместо bind: открывает сокет с SO_REUSEPORT, чтобы несколько серверов, каждый со своим io_service,
+        //слушали один порт - ядро само распределяет между ними соединения. Дальше нужно вызвать accept_and_run.
+        //Если io_service задан заранее, запускать его должен вызывающий
+        unsigned short bindShared();
+
+        //Разбирает заголовок Range: bytes=... для тела размером total в полуинтервал [begin, end).
+        //Несколько диапазонов не поддерживаются
+        static bool parseRange(const std::string& value, unsigned long long total,
+                               unsigned long long& begin, unsigned long long& end);
+
+    protected:
+        void accept() override;
+
+        //Маршруты индексируются один раз при запуске, после этого таблицы маршрутов менять нельзя
+        void after_bind() override;
+
+    private:
+        //Сессия запроса вместе с решением onRequest. Все сессии, которые читает readRequest, создаются этого типа
+        class StreamSession : public Session
+        {
+        public:
+            using Session::Session;
+
+            Admission admission;
+        };
+
+        using ResourceFunction = std::function<void(std::shared_ptr<Response>, std::shared_ptr<Request>)>;
+
+        RouteTable<StreamHandlerFactory> m_streamRoutes;
+        RouteTable<FileResourceFunction> m_fileRoutes;
+        RouteTable<ResourceFunction> m_routes;
+
+        void readRequest(const std::shared_ptr<Session>& session);
+        void readContent(const std::shared_ptr<Session>& session, size_t additionalBytes);
+        void rejectRequest(const std::shared_ptr<Session>& session, size_t additionalBytes);
+
+        void readStream(const std::shared_ptr<Session>& session,
+                        const std::shared_ptr<StreamHandler>& handler,
+                        size_t additionalBytes);
+        void receiveStream(const std::shared_ptr<Session>& session,
+                           const std::shared_ptr<StreamHandler>& handler,
+                           size_t additionalBytes,
+                           unsigned long long contentLength);
+        void rejectStream(const std::shared_ptr<Session>& session, StatusCode status);
+        void readStreamChunk(const std::shared_ptr<Session>& session,
+                             const std::shared_ptr<StreamHandler>& handler,
+                             const std::shared_ptr<std::vector<char>>& buffer,
+                             unsigned long long remaining);
+        void finishStream(const std::shared_ptr<Session>& session,
+                          const std::shared_ptr<StreamHandler>& handler,
+                          bool completed);
+
+        StreamHandlerFactory* findStreamResource(const std::shared_ptr<Session>& session);
+        void findResource(const std::shared_ptr<Session>& session);
+        void writeResponse(const std::shared_ptr<Session>& session, ResourceFunction& resourceFunction);
+        void writeFileResponse(const std::shared_ptr<Session>& session, FileResourceFunction& resourceFunction);
+        void sendFiles(const std::shared_ptr<Session>& session, const std::shared_ptr<FileResponse>& fileResponse, size_t index);
+        void readNextRequest(const std::shared_ptr<Session>& session);
+
+        bool getContentLength(const std::shared_ptr<Session>& session, unsigned long long& contentLength);
+    };
+}
+
+using HttpServer = SimpleWeb::Server<StreamingHTTP>;
+
+#endif //STREAMING_SERVER_H
@@ -0,0 +1,151 @@
+#include "UploadHandler.h"
+#include "JsonResponse.h"
+
+#include <algorithm>
+
+//Шаг, которым резервируются распакованные байты сжатого тела
+const uint64_t decodedReserveStep = 4 * 1024 * 1024;
+
+
+UploadHandler::UploadHandler(std::shared_ptr<FileSaver> fileSaver, std::shared_ptr<HttpServer::Request> request,
+                             std::shared_ptr<UploadQuota> quota) :
+               m_fileSaver(fileSaver),
+               m_finished(false),
+               m_quota(quota),
+               m_reserved(0),
+               m_rejectStatus(SimpleWeb::StatusCode::success_ok)
+{
+    m_fileSaver->setRequestHeader(request->header);
+}
+
+UploadHandler::~UploadHandler()
+{
+    if(m_reserved > 0)
+    {
+        m_quota->release(m_client, m_reserved);
+    }
+
+    //Соединение оборвалось до ответа - файлы запроса удаляются, прежние файлы с теми же именами остаются.
+    //Ответ отправлять некому, callback только держит FileSaver до конца записи
+    if(!m_finished)
+    {
+        std::shared_ptr<FileSaver> fileSaver = m_fileSaver;
+        m_fileSaver->abortStream([fileSaver]() {});
+    }
+}
+
+bool UploadHandler::admit(const std::shared_ptr<HttpServer::Request>& request)
+{
+    bool expectsContinue = request->header.find("Expect") != request->header.end();
+
+    switch(m_fileSaver->admission())
+    {
+        case FileSaver::NotEnoughSpace:
+        {
+            m_rejectStatus = SimpleWeb::StatusCode::client_error_payload_too_large;
+            return false;
+        }
+        case FileSaver::UnsupportedEncoding:
+        {
+            m_rejectStatus = SimpleWeb::StatusCode::client_error_unsupported_media_type;
+            return false;
+        }
+        case FileSaver::InvalidHeader:
+        {
+            //Клиенту, который ждёт 100 Continue, сообщаем, что продолжать не нужно
+            m_rejectStatus = expectsContinue ? SimpleWeb::StatusCode::client_error_expectation_failed :
+                                               SimpleWeb::StatusCode::client_error_bad_request;
+            return false;
+        }
+        case FileSaver::Accepted:
+        default:
+            break;
+    }
+
+    if(!m_quota)
+    {
+        return true;
+    }
+
+    uint64_t contentLength = 0;
+    auto it = request->header.find("Content-Length");
+    if(it != request->header.end())
+    {
+        try
+        {
+            contentLength = std::stoull(it->second);
+        }
+        catch(const std::exception&)
+        {
+            contentLength = 0;
+        }
+    }
+
+    m_client = request->remote_endpoint_address();
+
+    if(!m_quota->reserve(m_client, contentLength))
+    {
+        m_rejectStatus = SimpleWeb::StatusCode::client_error_too_many_requests;
+        m_rejectReason = "Upload quota exceeded for " + m_client;
+        return false;
+    }
+
+    m_reserved = contentLength;
+
+    //Сжатое тело зарезервировано по Content-Length, а на диск ляжет распакованное.
+    //То, что распаковалось сверх резерва, дозаказываем кусками, чтобы не брать мьютекс квоты на каждый кусок
+    m_fileSaver->setDecodedQuota([this](uint64_t decoded)
+                                 {
+                                     if(decoded <= m_reserved)
+                                     {
+                                         return true;
+                                     }
+
+                                     uint64_t extra = std::max(decoded - m_reserved, decodedReserveStep);
+
+                                     if(!m_quota->reserve(m_client, extra))
+                                     {
+                                         m_rejectStatus = SimpleWeb::StatusCode::client_error_too_many_requests;
+                                         m_rejectReason = "Upload quota exceeded for " + m_client;
+                                         return false;
+                                     }
+
+                                     m_reserved += extra;
+                                     return true;
+                                 });
+
+    return true;
+}
+
+bool UploadHandler::receive(const char* data, size_t size)
+{
+    return m_fileSaver->processChunk(data, size);
+}
+
+bool UploadHandler::ready(std::function<void()> resume)
+{
+    return m_fileSaver->ready(std::move(resume));
+}
+
+void UploadHandler::finish(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> /*request*/)
+{
+    m_finished = true;
+
+    //Отвечаем, когда файлы записаны на диск. Ответ отправится при освобождении response
+    std::shared_ptr<FileSaver> fileSaver = m_fileSaver;
+    SimpleWeb::StatusCode status = m_rejectStatus;
+    std::string reason = m_rejectReason;
+
+    m_fileSaver->finishStream([fileSaver, response, status, reason]()
+                              {
+                                  if(!reason.empty())
+                                  {
+                                      JsonResponse::sendError(response, status, reason);
+                                      return;
+                                  }
+
+                                  JsonResponse result(status);
+                                  fileSaver->writeResult(result.body());
+                                  result.send(response);
+                              });
+}
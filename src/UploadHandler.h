@@ -0,0 +1,39 @@
+#ifndef UPLOAD_HANDLER_H
+#define UPLOAD_HANDLER_H
+
+#include <memory>
+#include <string>
+
+#include "FileSaver.h"
+#include "UploadQuota.h"
+#include "StreamingServer.h"
+
+
+//Потоковый обработчик /upload: передаёт тело запроса в FileSaver по мере чтения из сокета.
+//Создаётся на каждый запрос со своим FileSaver, поэтому загрузки в разных потоках не мешают друг другу.
+//Заголовки и квота проверяются до чтения тела, отклонённое тело сервер не читает
+class UploadHandler : public HttpServer::StreamHandler
+{
+public:
+    UploadHandler(std::shared_ptr<FileSaver> fileSaver, std::shared_ptr<HttpServer::Request> request,
+                  std::shared_ptr<UploadQuota> quota = nullptr);
+    ~UploadHandler();
+
+    bool admit(const std::shared_ptr<HttpServer::Request>& request) override;
+    bool receive(const char* data, size_t size) override;
+    bool ready(std::function<void()> resume) override;
+    void finish(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request) override;
+
+private:
+    std::shared_ptr<FileSaver> m_fileSaver;
+    bool m_finished;
+
+    std::shared_ptr<UploadQuota> m_quota;
+    std::string m_client;
+    uint64_t m_reserved;        //Зарезервировано в квоте
+
+    SimpleWeb::StatusCode m_rejectStatus;   //success_ok - запрос принят
+    std::string m_rejectReason;             //Причина, если её не знает FileSaver
+};
+
+#endif //UPLOAD_HANDLER_H
@@ -0,0 +1,456 @@
+#include "UploadIndex.h"
+
+#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <nlohmann/json.hpp>
+
+
+using json = nlohmann::json;
+
+//Журнал сворачивается, когда в нём больше записей, чем файлов в индексе, но не раньше этого числа записей
+const uint64_t minCompactRecords = 10000;
+
+UploadIndex::UploadIndex(std::string dir, std::shared_ptr<spdlog::logger> logger) :
+             m_indexDir(dir + "/.index"),
+             m_dir(dir),
+             m_logger(logger),
+             m_count(0),
+             m_journalFd(-1),
+             m_journalRecords(0),
+             m_compacting(false),
+             m_compactRequested(false),
+             m_stop(false)
+{
+    if(mkdir(m_indexDir.c_str(), 0755) != 0 && errno != EEXIST && m_logger)
+    {
+        m_logger->error("Cannot create directory for upload index: " + m_indexDir);
+    }
+
+    m_compactThread = std::thread([this]() { runCompaction(); });
+}
+
+UploadIndex::~UploadIndex()
+{
+    //Начатую свёртку дожидаемся, запрошенную не начинаем: журнал и так на диске, при запуске он будет прочитан
+    {
+        std::lock_guard<std::mutex> lock(m_compactMutex);
+        m_stop = true;
+        m_compactCondition.notify_all();
+    }
+
+    m_compactThread.join();
+
+    if(m_journalFd >= 0)
+    {
+        ::close(m_journalFd);
+    }
+}
+
+bool UploadIndex::load()
+{
+    struct stat info;
+    bool exists = stat(snapshotPath().c_str(), &info) == 0 || stat(journalPath().c_str(), &info) == 0 ||
+                  stat(oldJournalPath().c_str(), &info) == 0;
+
+    if(!exists)
+    {
+        //Индекса ещё нет - каталог сканируем один раз и сразу сохраняем снимок
+        scanDirectory();
+        writeSnapshot();
+    }
+    else
+    {
+        //journal.old остаётся, если сервер остановился посреди свёртки. Операции идемпотентны,
+        //поэтому повторное применение уже попавших в снимок записей ничего не портит
+        applyFile(snapshotPath(), nullptr);
+        applyFile(oldJournalPath(), nullptr);
+        uint64_t records = 0;
+        applyFile(journalPath(), &records);
+        m_journalRecords = records;
+    }
+
+    openJournal();
+
+    if(m_logger)
+    {
+        m_logger->info("Upload index loaded: " + std::to_string(size()) + " files, " +
+                       std::to_string(m_journalRecords.load()) + " journal records");
+    }
+
+    return m_journalFd >= 0;
+}
+
+void UploadIndex::put(const Entry& entry)
+{
+    json record =
+    {
+        {"op", "put"},
+        {"name", entry.name},
+        {"size", entry.size},
+        {"time", entry.time},
+        {"digest", entry.digest}
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(m_journalMutex);
+
+        append(record.dump() + "\n");
+        applyPut(entry);
+    }
+
+    if(m_journalRecords > minCompactRecords && m_journalRecords > size())
+    {
+        requestCompaction();
+    }
+}
+
+void UploadIndex::remove(const std::string& name)
+{
+    json record =
+    {
+        {"op", "remove"},
+        {"name", name}
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(m_journalMutex);
+
+        append(record.dump() + "\n");
+        applyRemove(name);
+    }
+
+    if(m_journalRecords > minCompactRecords && m_journalRecords > size())
+    {
+        requestCompaction();
+    }
+}
+
+bool UploadIndex::find(const std::string& name, Entry& entry) const
+{
+    const Shard& current = shard(name);
+    std::shared_lock<std::shared_mutex> lock(current.mutex);
+
+    auto it = current.entries.find(name);
+    if(it == current.entries.end())
+    {
+        return false;
+    }
+
+    entry = it->second;
+    return true;
+}
+
+std::vector<UploadIndex::Entry> UploadIndex::list(const std::string& prefix, const std::string& after, size_t limit) const
+{
+    std::vector<Entry> result;
+
+    //Из каждого шарда берём не больше limit подходящих имён, затем сливаем и оставляем первые limit
+    for(const Shard& current : m_shards)
+    {
+        std::shared_lock<std::shared_mutex> lock(current.mutex);
+
+        auto it = (after < prefix) ? current.entries.lower_bound(prefix) : current.entries.upper_bound(after);
+
+        for(size_t count = 0; it != current.entries.end() && count < limit; ++it, ++count)
+        {
+            if(it->first.compare(0, prefix.size(), prefix) != 0)
+            {
+                break;
+            }
+
+            result.push_back(it->second);
+        }
+    }
+
+    std::sort(result.begin(), result.end(), [](const Entry& a, const Entry& b) { return a.name < b.name; });
+
+    if(result.size() > limit)
+    {
+        result.resize(limit);
+    }
+
+    return result;
+}
+
+size_t UploadIndex::size() const
+{
+    return m_count.load(std::memory_order_relaxed);
+}
+
+void UploadIndex::compact()
+{
+    bool expected = false;
+    if(!m_compacting.compare_exchange_strong(expected, true))
+    {
+        return;
+    }
+
+    //Новые записи идут в новый журнал, старый станет не нужен, когда снимок будет на диске.
+    //Снимок берётся после смены журнала, поэтому содержит всё из старого журнала
+    {
+        std::lock_guard<std::mutex> lock(m_journalMutex);
+
+        if(m_journalFd >= 0)
+        {
+            ::close(m_journalFd);
+            m_journalFd = -1;
+        }
+
+        std::rename(journalPath().c_str(), oldJournalPath().c_str());
+        openJournal();
+        m_journalRecords = 0;
+    }
+
+    if(writeSnapshot())
+    {
+        std::remove(oldJournalPath().c_str());
+    }
+
+    m_compacting = false;
+}
+
+void UploadIndex::requestCompaction()
+{
+    std::lock_guard<std::mutex> lock(m_compactMutex);
+
+    m_compactRequested = true;
+    m_compactCondition.notify_one();
+}
+
+void UploadIndex::runCompaction()
+{
+    std::unique_lock<std::mutex> lock(m_compactMutex);
+
+    while(true)
+    {
+        m_compactCondition.wait(lock, [this]() { return m_stop || m_compactRequested; });
+
+        if(m_stop)
+        {
+            return;
+        }
+
+        m_compactRequested = false;
+
+        //Пока шла прошлая свёртка, запрос мог прийти ещё по старому журналу
+        if(m_journalRecords <= minCompactRecords || m_journalRecords <= size())
+        {
+            continue;
+        }
+
+        //Снимок пишется долго, put и remove в это время только снова выставляют флаг
+        lock.unlock();
+        compact();
+        lock.lock();
+    }
+}
+
+UploadIndex::Shard& UploadIndex::shard(const std::string& name)
+{
+    return m_shards[std::hash<std::string>()(name) % shardCount];
+}
+
+const UploadIndex::Shard& UploadIndex::shard(const std::string& name) const
+{
+    return m_shards[std::hash<std::string>()(name) % shardCount];
+}
+
+void UploadIndex::apply(const std::string& line)
+{
+    json record = json::parse(line, nullptr, false);
+
+    //Последняя строка может быть недописана, если сервер остановился во время записи
+    if(record.is_discarded() || !record.contains("name"))
+    {
+        return;
+    }
+
+    std::string name = record["name"].get<std::string>();
+
+    if(record.value("op", "put") == "remove")
+    {
+        applyRemove(name);
+        return;
+    }
+
+    Entry entry;
+    entry.name = name;
+    entry.size = record.value("size", uint64_t(0));
+    entry.time = record.value("time", int64_t(0));
+    entry.digest = record.value("digest", std::string());
+
+    applyPut(entry);
+}
+
+void UploadIndex::applyFile(const std::string& path, uint64_t* records)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::string line;
+
+    while(std::getline(file, line))
+    {
+        apply(line);
+
+        if(records)
+        {
+            (*records)++;
+        }
+    }
+}
+
+void UploadIndex::append(const std::string& line)
+{
+    if(m_journalFd < 0)
+    {
+        return;
+    }
+
+    //Строка пишется одним вызовом в файл с O_APPEND
+    if(::write(m_journalFd, line.data(), line.size()) != static_cast<ssize_t>(line.size()) && m_logger)
+    {
+        m_logger->error("Cannot write upload index journal: " + journalPath());
+    }
+
+    m_journalRecords++;
+}
+
+void UploadIndex::openJournal()
+{
+    m_journalFd = ::open(journalPath().c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    if(m_journalFd < 0 && m_logger)
+    {
+        m_logger->error("Cannot open upload index journal: " + journalPath());
+    }
+}
+
+bool UploadIndex::writeSnapshot()
+{
+    std::string tempPath = snapshotPath() + ".tmp";
+
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+
+        //Шарды копируются по очереди, запись в остальные в это время не ждёт
+        for(Shard& current : m_shards)
+        {
+            std::vector<Entry> entries;
+            {
+                std::shared_lock<std::shared_mutex> lock(current.mutex);
+
+                entries.reserve(current.entries.size());
+                for(auto& item : current.entries)
+                {
+                    entries.push_back(item.second);
+                }
+            }
+
+            for(const Entry& entry : entries)
+            {
+                json record =
+                {
+                    {"name", entry.name},
+                    {"size", entry.size},
+                    {"time", entry.time},
+                    {"digest", entry.digest}
+                };
+
+                file << record.dump() << '\n';
+            }
+        }
+
+        if(!file.good())
+        {
+            if(m_logger)
+            {
+                m_logger->error("Cannot write upload index snapshot: " + tempPath);
+            }
+
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+
+    return std::rename(tempPath.c_str(), snapshotPath().c_str()) == 0;
+}
+
+void UploadIndex::scanDirectory()
+{
+    DIR* directory = opendir(m_dir.c_str());
+    if(!directory)
+    {
+        return;
+    }
+
+    while(struct dirent* item = readdir(directory))
+    {
+        //Скрытые - временные файлы и служебные каталоги
+        if(item->d_name[0] == '.')
+        {
+            continue;
+        }
+
+        struct stat info;
+        std::string path = m_dir + "/" + item->d_name;
+
+        if(stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+        {
+            continue;
+        }
+
+        Entry entry;
+        entry.name = item->d_name;
+        entry.size = info.st_size;
+        entry.time = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000 + info.st_mtim.tv_nsec / 1000000;
+
+        applyPut(entry);
+    }
+
+    closedir(directory);
+}
+
+void UploadIndex::applyPut(const Entry& entry)
+{
+    Shard& current = shard(entry.name);
+    std::unique_lock<std::shared_mutex> lock(current.mutex);
+
+    auto result = current.entries.insert_or_assign(entry.name, entry);
+    if(result.second)
+    {
+        m_count++;
+    }
+}
+
+void UploadIndex::applyRemove(const std::string& name)
+{
+    Shard& current = shard(name);
+    std::unique_lock<std::shared_mutex> lock(current.mutex);
+
+    if(current.entries.erase(name) > 0)
+    {
+        m_count--;
+    }
+}
+
+std::string UploadIndex::snapshotPath() const
+{
+    return m_indexDir + "/snapshot";
+}
+
+std::string UploadIndex::journalPath() const
+{
+    return m_indexDir + "/journal";
+}
+
+std::string UploadIndex::oldJournalPath() const
+{
+    return m_indexDir + "/journal.old";
+}
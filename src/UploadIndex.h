@@ -0,0 +1,103 @@
+#ifndef UPLOAD_INDEX_H
+#define UPLOAD_INDEX_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+#include "spdlog/logger.h"
+
+
+//Индекс загруженных файлов в памяти. Обновляется при каждом сохранении, поэтому каталог не сканируется.
+//На диске - снимок и журнал добавлений в подкаталоге .index: при запуске читается снимок и дописанный после него журнал,
+//когда журнал вырастает, он сворачивается в новый снимок в фоновом потоке, запись в индекс его не ждёт.
+//Индекс разбит на шарды со своими блокировками, запросы списка не останавливают ни запись, ни друг друга
+class UploadIndex
+{
+public:
+    struct Entry
+    {
+        std::string name;
+        uint64_t size;
+        int64_t time;           //Время сохранения, мс от начала эпохи Unix
+        std::string digest;     //Хэш содержимого, если его считали
+    };
+
+    UploadIndex(std::string dir, std::shared_ptr<spdlog::logger> logger);
+    ~UploadIndex();
+
+    //Читает снимок и журнал. Если индекса ещё нет, один раз строит его по содержимому каталога
+    bool load();
+
+    void put(const Entry& entry);
+    void remove(const std::string& name);
+
+    bool find(const std::string& name, Entry& entry) const;
+
+    //Страница списка по возрастанию имён: имена с началом prefix, строго после after, не больше limit
+    std::vector<Entry> list(const std::string& prefix, const std::string& after, size_t limit) const;
+
+    size_t size() const;
+
+    //Сворачивает журнал в снимок в вызывающем потоке
+    void compact();
+
+private:
+    static const size_t shardCount = 16;
+
+    struct Shard
+    {
+        mutable std::shared_mutex mutex;
+        std::map<std::string, Entry> entries;
+    };
+
+    std::string m_indexDir;
+    std::string m_dir;
+    std::shared_ptr<spdlog::logger> m_logger;
+
+    Shard m_shards[shardCount];
+    std::atomic<size_t> m_count;
+
+    //Запись в журнал и изменение шарда выполняются под одной блокировкой, чтобы снимок не потерял изменения
+    std::mutex m_journalMutex;
+    int m_journalFd;
+    std::atomic<uint64_t> m_journalRecords;
+
+    std::atomic<bool> m_compacting;
+
+    //Фоновая свёртка журнала, put и remove только будят поток
+    std::mutex m_compactMutex;
+    std::condition_variable m_compactCondition;
+    bool m_compactRequested;
+    bool m_stop;
+    std::thread m_compactThread;
+
+    Shard& shard(const std::string& name);
+    const Shard& shard(const std::string& name) const;
+
+    void apply(const std::string& line);
+    void applyFile(const std::string& path, uint64_t* records);
+    void append(const std::string& line);
+    void openJournal();
+    bool writeSnapshot();
+    void scanDirectory();
+
+    void requestCompaction();
+    void runCompaction();
+
+    void applyPut(const Entry& entry);
+    void applyRemove(const std::string& name);
+
+    std::string snapshotPath() const;
+    std::string journalPath() const;
+    std::string oldJournalPath() const;
+};
+
+#endif //UPLOAD_INDEX_H
@@ -0,0 +1,57 @@
+#include "UploadQuota.h"
+
+#include <algorithm>
+
+
+UploadQuota::UploadQuota(uint64_t maxBytesPerClient, uint64_t maxBytesTotal) :
+             m_maxBytesPerClient(maxBytesPerClient),
+             m_maxBytesTotal(maxBytesTotal),
+             m_total(0)
+{
+}
+
+bool UploadQuota::reserve(const std::string& client, uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if(m_maxBytesTotal > 0 && m_total + bytes > m_maxBytesTotal)
+    {
+        return false;
+    }
+
+    uint64_t& used = m_clients[client];
+
+    if(m_maxBytesPerClient > 0 && used + bytes > m_maxBytesPerClient)
+    {
+        //Не оставляем пустые записи для отклонённых клиентов
+        if(used == 0)
+        {
+            m_clients.erase(client);
+        }
+        return false;
+    }
+
+    used += bytes;
+    m_total += bytes;
+
+    return true;
+}
+
+void UploadQuota::release(const std::string& client, uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_clients.find(client);
+    if(it == m_clients.end())
+    {
+        return;
+    }
+
+    it->second -= std::min(it->second, bytes);
+    m_total -= std::min(m_total, bytes);
+
+    if(it->second == 0)
+    {
+        m_clients.erase(it);
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef UPLOAD_QUOTA_H
+#define UPLOAD_QUOTA_H
+
+#include <string>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+
+
+//Ограничение объёма одновременно принимаемых тел запросов: для каждого клиента (по IP) и для сервера в целом.
+//Объём резервируется по Content-Length до чтения тела и освобождается, когда запрос обработан
+class UploadQuota
+{
+public:
+    //0 - без ограничения
+    UploadQuota(uint64_t maxBytesPerClient, uint64_t maxBytesTotal);
+
+    //false - квота исчерпана, ничего не зарезервировано
+    bool reserve(const std::string& client, uint64_t bytes);
+    void release(const std::string& client, uint64_t bytes);
+
+private:
+    const uint64_t m_maxBytesPerClient;
+    const uint64_t m_maxBytesTotal;
+
+    std::mutex m_mutex;
+    std::unordered_map<std::string, uint64_t> m_clients;
+    uint64_t m_total;
+};
+
+#endif //UPLOAD_QUOTA_H
@@ -0,0 +1,468 @@
+#include "UploadSessions.h"
+
+#include "AsyncFileWriter.h"
+
+#include <fstream>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+
+UploadSessions::UploadSessions(std::string dir, FileWriter::Backend writerBackend, std::shared_ptr<spdlog::logger> logger) :
+                m_dir(dir),
+                m_sessionsDir(dir + "/.resumable"),
+                m_writerBackend(writerBackend),
+                m_writerBufferSize(1024 * 1024),
+                m_logger(logger),
+                m_maxPendingBytes(0),
+                m_contentAddressed(false),
+                m_sha256(false)
+{
+    createDirectories();
+}
+
+void UploadSessions::setDiskWriteStage(std::shared_ptr<DiskWriteStage> stage, size_t maxPendingBytes)
+{
+    m_diskWriteStage = stage;
+    m_maxPendingBytes = maxPendingBytes;
+}
+
+void UploadSessions::setWriterBufferSize(size_t bufferSize)
+{
+    m_writerBufferSize = bufferSize;
+}
+
+void UploadSessions::setUploadIndex(std::shared_ptr<UploadIndex> uploadIndex)
+{
+    m_uploadIndex = uploadIndex;
+}
+
+void UploadSessions::setStorage(std::shared_ptr<UploadStorage> storage)
+{
+    m_storage = storage;
+    createDirectories();
+}
+
+void UploadSessions::setContentAddressed(bool enabled, bool sha256)
+{
+    m_contentAddressed = enabled;
+    m_sha256 = sha256;
+    createDirectories();
+}
+
+void UploadSessions::setDurability(std::shared_ptr<DurabilityCommitter> committer)
+{
+    m_committer = committer;
+}
+
+bool UploadSessions::create(const std::string& filename, uint64_t length, Session& session, std::string& error)
+{
+    //Путь из имени убираем так же, как FileSaver
+    std::string name = filename;
+
+    size_t lastSlash = name.find_last_of("/\\");
+    if(lastSlash != std::string::npos)
+    {
+        name = name.substr(lastSlash + 1);
+    }
+
+    if(name.empty() || name == "." || name == "..")
+    {
+        error = "Invalid file name: " + filename;
+        return false;
+    }
+
+    //Данные сразу пишутся в каталог, где файл будет лежать: переименование между дисками невозможно
+    std::string location = m_storage ? m_storage->target(m_storage->choose(name)).dir : m_dir;
+
+    //Загрузку, которая заведомо не поместится на диск, отклоняем сразу
+    struct statvfs info;
+    if(statvfs(location.c_str(), &info) == 0)
+    {
+        uint64_t available = static_cast<uint64_t>(info.f_bavail) * info.f_frsize;
+
+        if(available < length)
+        {
+            error = "Not enough free space in " + location + ": " + std::to_string(length) +
+                    " bytes required, " + std::to_string(available) + " available";
+            return false;
+        }
+    }
+
+    session.id = generateId();
+    session.filename = name;
+    session.length = length;
+    session.offset = 0;
+    session.location = location;
+
+    int fd = ::open(partPath(session).c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if(fd < 0)
+    {
+        error = "Cannot create file: " + partPath(session);
+        return false;
+    }
+    ::close(fd);
+
+    //Описание пишем во временный файл и переименовываем, чтобы после сбоя не остался обрезанный json
+    json meta =
+    {
+        {"filename", session.filename},
+        {"length", session.length},
+        {"location", session.location}
+    };
+
+    std::string tempPath = metaPath(session.id) + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary);
+        file << meta.dump();
+
+        if(!file.good())
+        {
+            error = "Cannot write file: " + tempPath;
+            std::remove(tempPath.c_str());
+            std::remove(partPath(session).c_str());
+            return false;
+        }
+    }
+
+    if(std::rename(tempPath.c_str(), metaPath(session.id).c_str()) != 0)
+    {
+        error = "Cannot rename file: " + tempPath;
+        std::remove(tempPath.c_str());
+        std::remove(partPath(session).c_str());
+        return false;
+    }
+
+    if(m_logger)
+    {
+        m_logger->trace("Created resumable upload " + session.id + " for " + session.filename + ", size: " + std::to_string(length));
+    }
+
+    return true;
+}
+
+bool UploadSessions::find(const std::string& id, Session& session)
+{
+    std::ifstream file(metaPath(id), std::ios::binary);
+    if(!file.is_open())
+    {
+        return false;
+    }
+
+    json meta = json::parse(file, nullptr, false);
+    if(meta.is_discarded() || !meta.contains("filename") || !meta.contains("length"))
+    {
+        return false;
+    }
+
+    session.id = id;
+    session.filename = meta["filename"].get<std::string>();
+    session.length = meta["length"].get<uint64_t>();
+
+    //Сессии, созданные до появления хранилища, лежат в основном каталоге
+    session.location = meta.contains("location") ? meta["location"].get<std::string>() : m_dir;
+
+    struct stat info;
+    if(stat(partPath(session).c_str(), &info) != 0)
+    {
+        return false;
+    }
+
+    session.offset = static_cast<uint64_t>(info.st_size);
+
+    return true;
+}
+
+bool UploadSessions::acquire(const std::string& id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_active.insert(id).second;
+}
+
+void UploadSessions::release(const std::string& id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_active.erase(id);
+}
+
+bool UploadSessions::finish(const std::string& id, std::string& error, std::function<void(bool, const Session&)> callback)
+{
+    if(!acquire(id))
+    {
+        error = "Upload " + id + " is receiving data";
+        return false;
+    }
+
+    Session session;
+    if(!find(id, session))
+    {
+        release(id);
+        error = "Upload " + id + " not found";
+        return false;
+    }
+
+    if(session.offset != session.length)
+    {
+        release(id);
+        error = "Upload " + id + " is incomplete: " + std::to_string(session.offset) +
+                " of " + std::to_string(session.length) + " bytes received";
+        return false;
+    }
+
+    std::string blobPath;
+
+    if(m_contentAddressed)
+    {
+        std::shared_ptr<ContentHash> hash = takeHash(session);
+
+        if(!hash)
+        {
+            hash = std::make_shared<ContentHash>();
+            hash->reset(true);
+
+            if(!hashFile(partPath(session), *hash))
+            {
+                release(id);
+                error = "Cannot read file: " + partPath(session);
+                return false;
+            }
+        }
+
+        session.xxh64 = hash->xxh64Digest();
+        session.sha256 = hash->sha256Digest();
+
+        //Ключ blob - SHA-256, как у файлов /upload
+        blobPath = session.location + "/.blobs/" + session.sha256;
+    }
+
+    std::vector<std::string> directories = {session.location};
+    if(!blobPath.empty())
+    {
+        directories.push_back(session.location + "/.blobs");
+    }
+
+    auto finished = [this, id, session, callback](bool stored)
+                    {
+                        release(id);
+                        callback(stored, session);
+                    };
+
+    //.part сбрасывается на диск до переименования, как временные файлы /upload
+    if(m_committer)
+    {
+        m_committer->commit({partPath(session)}, std::move(directories),
+                            [this, id, session, blobPath]() { return publish(id, session, blobPath); }, finished);
+    }
+    else
+    {
+        finished(publish(id, session, blobPath));
+    }
+
+    return true;
+}
+
+bool UploadSessions::remove(const std::string& id)
+{
+    if(!acquire(id))
+    {
+        return false;
+    }
+
+    Session session;
+    bool found = find(id, session);
+
+    bool removed = std::remove(metaPath(id).c_str()) == 0;
+    if(found)
+    {
+        std::remove(partPath(session).c_str());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_hashes.erase(id);
+    }
+
+    release(id);
+
+    return removed;
+}
+
+std::string UploadSessions::partPath(const Session& session) const
+{
+    return session.location + "/.resumable/" + session.id + ".part";
+}
+
+std::unique_ptr<FileWriter> UploadSessions::createWriter(const Session& session)
+{
+    std::unique_ptr<FileWriter> writer = FileWriter::create(m_writerBackend, m_writerBufferSize);
+
+    //Каталог хранилища пишут его собственные дисковые потоки
+    std::shared_ptr<DiskWriteStage> stage = m_diskWriteStage;
+    for(size_t i = 0; m_storage && i < m_storage->size(); i++)
+    {
+        if(m_storage->target(i).dir == session.location)
+        {
+            stage = m_storage->target(i).stage;
+        }
+    }
+
+    if(stage)
+    {
+        writer.reset(new AsyncFileWriter(stage, std::move(writer), m_maxPendingBytes));
+    }
+
+    return writer;
+}
+
+std::shared_ptr<ContentHash> UploadSessions::takeHash(const Session& session)
+{
+    if(!m_contentAddressed)
+    {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_hashes.find(session.id);
+    if(it != m_hashes.end())
+    {
+        HashState state = std::move(it->second);
+        m_hashes.erase(it);
+
+        //Прошлый запрос записал на диск не всё, что посчитал, - состояние не годится
+        if(state.length == session.offset)
+        {
+            return state.hash;
+        }
+    }
+
+    if(session.offset != 0)
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<ContentHash> hash = std::make_shared<ContentHash>();
+    hash->reset(true);
+
+    return hash;
+}
+
+void UploadSessions::storeHash(const std::string& id, std::shared_ptr<ContentHash> hash, uint64_t length)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_hashes[id] = {std::move(hash), length};
+}
+
+std::string UploadSessions::metaPath(const std::string& id) const
+{
+    return m_sessionsDir + "/" + id + ".json";
+}
+
+void UploadSessions::createDirectories()
+{
+    std::vector<std::string> dirs = {m_dir};
+    for(size_t i = 0; m_storage && i < m_storage->size(); i++)
+    {
+        dirs.push_back(m_storage->target(i).dir);
+    }
+
+    for(const std::string& dir : dirs)
+    {
+        std::vector<std::string> created = {dir + "/.resumable"};
+        if(m_contentAddressed)
+        {
+            created.push_back(dir + "/.blobs");
+        }
+
+        for(const std::string& path : created)
+        {
+            if(mkdir(path.c_str(), 0755) != 0 && errno != EEXIST && m_logger)
+            {
+                m_logger->error("Cannot create directory: " + path);
+            }
+        }
+    }
+}
+
+bool UploadSessions::publish(const std::string& id, const Session& session, const std::string& blobPath)
+{
+    std::string finalPath = session.location + "/" + session.filename;
+
+    if(!FileWriter::publish(partPath(session), blobPath, finalPath))
+    {
+        if(m_logger)
+        {
+            m_logger->error("Cannot store file " + partPath(session) + " as " + finalPath);
+        }
+
+        return false;
+    }
+
+    std::remove(metaPath(id).c_str());
+
+    //Пока шла загрузка, файл с тем же именем мог появиться в другом каталоге хранилища - у имени остаётся одна копия
+    for(size_t i = 0; m_storage && i < m_storage->size(); i++)
+    {
+        if(m_storage->target(i).dir != session.location)
+        {
+            std::remove((m_storage->target(i).dir + "/" + session.filename).c_str());
+        }
+    }
+
+    if(m_uploadIndex)
+    {
+        UploadIndex::Entry entry;
+        entry.name = session.filename;
+        entry.size = session.length;
+        entry.time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        entry.digest = m_sha256 ? session.sha256 : session.xxh64;
+
+        m_uploadIndex->put(entry);
+    }
+
+    if(m_logger)
+    {
+        m_logger->trace("Was saved file: " + session.filename + ", size: " + std::to_string(session.length));
+    }
+
+    return true;
+}
+
+bool UploadSessions::hashFile(const std::string& path, ContentHash& hash)
+{
+    std::ifstream file(path, std::ios::binary);
+    if(!file.is_open())
+    {
+        return false;
+    }
+
+    std::vector<char> buffer(1024 * 1024);
+
+    while(file)
+    {
+        file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        hash.update(buffer.data(), static_cast<size_t>(file.gcount()));
+    }
+
+    return file.eof();
+}
+
+std::string UploadSessions::generateId()
+{
+    static thread_local std::mt19937_64 generator(std::random_device{}());
+
+    char id[33];
+    std::snprintf(id, sizeof(id), "%016llx%016llx",
+                  static_cast<unsigned long long>(generator()),
+                  static_cast<unsigned long long>(generator()));
+
+    return id;
+}
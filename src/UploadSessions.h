@@ -0,0 +1,133 @@
+#ifndef UPLOAD_SESSIONS_H
+#define UPLOAD_SESSIONS_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <map>
+#include <functional>
+#include <cstdint>
+
+#include <nlohmann/json.hpp>
+
+#include "FileWriter.h"
+#include "DiskWriteStage.h"
+#include "UploadIndex.h"
+#include "UploadStorage.h"
+#include "DurabilityCommitter.h"
+#include "ContentHash.h"
+
+#include "spdlog/logger.h"
+
+
+using json = nlohmann::json;
+
+//Сессии докачиваемых загрузок. Состояние хранится на диске в подкаталоге .resumable каталога загрузок:
+//<id>.json - имя файла, полный размер и каталог хранилища, <id>.part - уже принятые данные в .resumable этого каталога.
+//Текущее смещение - размер .part, поэтому после перезапуска сервера загрузка продолжается с того, что уже записано на диск.
+//Завершённый файл сохраняется так же, как файлы /upload: по содержимому, если оно включено, и со сбросом на диск
+class UploadSessions
+{
+public:
+    struct Session
+    {
+        std::string id;
+        std::string filename;
+        uint64_t length;    //Полный размер файла
+        uint64_t offset;    //Принято байт
+        std::string location;   //Каталог хранилища, в нём лежит .part и появится файл
+
+        //Заполняются в finish при хранении по содержимому
+        std::string xxh64;
+        std::string sha256;
+    };
+
+    UploadSessions(std::string dir, FileWriter::Backend writerBackend, std::shared_ptr<spdlog::logger> logger);
+
+    //Запись в дисковых потоках. Без стадии данные пишутся синхронно
+    void setDiskWriteStage(std::shared_ptr<DiskWriteStage> stage, size_t maxPendingBytes);
+
+    //Память писателя под открытый файл, см. FileWriter::create
+    void setWriterBufferSize(size_t bufferSize);
+
+    //Индекс, в который записываются завершённые загрузки
+    void setUploadIndex(std::shared_ptr<UploadIndex> uploadIndex);
+
+    //Каталог для новой загрузки выбирается так же, как для файлов /upload. Вызывать до создания сессий
+    void setStorage(std::shared_ptr<UploadStorage> storage);
+
+    //Хранение по содержимому, см. FileSaver::setContentAddressed
+    void setContentAddressed(bool enabled, bool sha256);
+
+    //Сброс файла на диск перед ответом на finish, см. FileSaver::setDurability
+    void setDurability(std::shared_ptr<DurabilityCommitter> committer);
+
+    //Новая сессия. false - в error причина
+    bool create(const std::string& filename, uint64_t length, Session& session, std::string& error);
+
+    //false - сессии с таким id нет
+    bool find(const std::string& id, Session& session);
+
+    //Сессию в каждый момент дополняет только один запрос. false - её уже кто-то дополняет
+    bool acquire(const std::string& id);
+    void release(const std::string& id);
+
+    //Переносит принятый файл на его место в каталоге хранилища. false - загрузку нельзя завершить, в error причина.
+    //Иначе callback вызывается, когда файл на месте и сброшен на диск, возможно из другого потока.
+    //false в callback - ошибка записи, сессия остаётся и finish можно повторить
+    bool finish(const std::string& id, std::string& error, std::function<void(bool, const Session&)> callback);
+
+    //Отменяет загрузку и удаляет принятые данные
+    bool remove(const std::string& id);
+
+    std::string partPath(const Session& session) const;
+
+    //Писатель с настройками сервера и дисковыми потоками каталога сессии, его нужно открыть через reopen(partPath(session), offset)
+    std::unique_ptr<FileWriter> createWriter(const Session& session);
+
+    //Хэш для хранения по содержимому считается по мере приёма данных и между запросами хранится в памяти.
+    //takeHash - состояние для продолжения с session.offset. nullptr - хэш не нужен или после перезапуска
+    //сервера состояние потеряно, тогда finish посчитает хэш чтением файла
+    std::shared_ptr<ContentHash> takeHash(const Session& session);
+
+    //Возвращает состояние хэша, в который передано length байт сессии id
+    void storeHash(const std::string& id, std::shared_ptr<ContentHash> hash, uint64_t length);
+
+private:
+    std::string m_dir;
+    std::string m_sessionsDir;
+    FileWriter::Backend m_writerBackend;
+    size_t m_writerBufferSize;
+    std::shared_ptr<spdlog::logger> m_logger;
+
+    std::shared_ptr<DiskWriteStage> m_diskWriteStage;
+    size_t m_maxPendingBytes;
+
+    std::shared_ptr<UploadIndex> m_uploadIndex;
+    std::shared_ptr<UploadStorage> m_storage;
+    std::shared_ptr<DurabilityCommitter> m_committer;
+
+    bool m_contentAddressed;
+    bool m_sha256;
+
+    struct HashState
+    {
+        std::shared_ptr<ContentHash> hash;
+        uint64_t length;
+    };
+
+    std::mutex m_mutex;
+    std::set<std::string> m_active;             //Сессии, которые сейчас дополняются
+    std::map<std::string, HashState> m_hashes;  //Хэши принятых частей, пока сессия не дополняется
+
+    std::string metaPath(const std::string& id) const;
+    std::string generateId();
+
+    //.resumable и .blobs в каждом каталоге хранилища
+    void createDirectories();
+    bool publish(const std::string& id, const Session& session, const std::string& blobPath);
+    static bool hashFile(const std::string& path, ContentHash& hash);
+};
+
+#endif //UPLOAD_SESSIONS_H
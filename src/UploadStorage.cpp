@@ -0,0 +1,149 @@
+#include "UploadStorage.h"
+
+#include <limits>
+#include <stdexcept>
+#include <sys/statvfs.h>
+#include <sys/stat.h>
+
+
+UploadStorage::UploadStorage(std::vector<std::string> dirs, Placement placement) :
+               m_placement(placement),
+               m_next(0)
+{
+    if(dirs.empty())
+    {
+        throw std::invalid_argument("UploadStorage: no directories");
+    }
+
+    for(std::string& dir : dirs)
+    {
+        m_targets.push_back({std::move(dir), nullptr});
+    }
+}
+
+void UploadStorage::setDiskWriteStage(size_t index, std::shared_ptr<DiskWriteStage> stage)
+{
+    m_targets.at(index).stage = stage;
+}
+
+size_t UploadStorage::size() const
+{
+    return m_targets.size();
+}
+
+const UploadStorage::Target& UploadStorage::target(size_t index) const
+{
+    return m_targets[index];
+}
+
+size_t UploadStorage::choose(const std::string& name) const
+{
+    if(m_targets.size() == 1)
+    {
+        return 0;
+    }
+
+    //Перезапись: файл остаётся там, где лежит прежний, иначе GET мог бы отдать устаревшую копию
+    struct stat info;
+    for(size_t i = 0; i < m_targets.size(); i++)
+    {
+        if(stat((m_targets[i].dir + "/" + name).c_str(), &info) == 0)
+        {
+            return i;
+        }
+    }
+
+    if(m_placement == NameHash)
+    {
+        return nameHash(name) % m_targets.size();
+    }
+
+    size_t start = m_next.fetch_add(1, std::memory_order_relaxed) % m_targets.size();
+    size_t best = start;
+    uint64_t bestValue = 0;
+
+    for(size_t k = 0; k < m_targets.size(); k++)
+    {
+        size_t i = (start + k) % m_targets.size();
+        uint64_t pending = pendingBytes(i);
+        uint64_t value;
+
+        if(m_placement == FreeSpace)
+        {
+            //Данные в очереди уже обещаны диску, но statvfs их ещё не видит
+            uint64_t free = available(i);
+            value = free > pending ? free - pending : 0;
+        }
+        else
+        {
+            //Меньше ожидающих данных - лучше, сравниваем как "больше - лучше"
+            value = std::numeric_limits<uint64_t>::max() - pending;
+        }
+
+        if(k == 0 || value > bestValue)
+        {
+            best = i;
+            bestValue = value;
+        }
+    }
+
+    return best;
+}
+
+uint64_t UploadStorage::available(size_t index) const
+{
+    struct statvfs info;
+    if(statvfs(m_targets[index].dir.c_str(), &info) != 0)
+    {
+        return std::numeric_limits<uint64_t>::max();
+    }
+
+    return static_cast<uint64_t>(info.f_bavail) * info.f_frsize;
+}
+
+std::string UploadStorage::placementName(Placement placement)
+{
+    switch(placement)
+    {
+        case FreeSpace:
+        {
+            return "free space";
+        }
+        case QueueDepth:
+        {
+            return "queue depth";
+        }
+        case NameHash:
+        {
+            return "name hash";
+        }
+        default:
+        {
+            return "unknown";
+        }
+    }
+}
+
+uint64_t UploadStorage::pendingBytes(size_t index) const
+{
+    if(!m_targets[index].stage)
+    {
+        return 0;
+    }
+
+    return m_targets[index].stage->statistics().bytesPending;
+}
+
+uint64_t UploadStorage::nameHash(const std::string& name)
+{
+    //FNV-1a: не зависит от реализации std::hash, каталог имени не меняется между запусками
+    uint64_t hash = 14695981039346656037ULL;
+
+    for(unsigned char c : name)
+    {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
@@ -0,0 +1,60 @@
+#ifndef UPLOAD_STORAGE_H
+#define UPLOAD_STORAGE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+#include "DiskWriteStage.h"
+
+
+//Каталоги для загружаемых файлов, обычно на разных дисках. Каждый новый файл целиком пишется в один каталог,
+//разные файлы расходятся по каталогам, и диски пишутся параллельно - у каждого каталога свои дисковые потоки.
+//Файл с уже существующим именем пишется туда, где лежит прежний, так что у имени всегда одна копия
+class UploadStorage
+{
+public:
+    //Как выбирается каталог для нового файла
+    enum Placement : uint8_t
+    {
+        FreeSpace,      //Больше всего свободного места за вычетом ещё не записанных данных
+        QueueDepth,     //Меньше всего данных ждут записи в дисковых потоках каталога
+        NameHash        //По хэшу имени, одно имя всегда в одном каталоге
+    };
+
+    struct Target
+    {
+        std::string dir;
+        std::shared_ptr<DiskWriteStage> stage;  //nullptr - файлы пишутся синхронно
+    };
+
+    UploadStorage(std::vector<std::string> dirs, Placement placement);
+
+    //Дисковые потоки каталога index. Вызывать до начала загрузок
+    void setDiskWriteStage(size_t index, std::shared_ptr<DiskWriteStage> stage);
+
+    size_t size() const;
+    const Target& target(size_t index) const;
+
+    //Номер каталога для файла name
+    size_t choose(const std::string& name) const;
+
+    //Свободное место в каталоге, байт. Если узнать не удалось - максимальное значение
+    uint64_t available(size_t index) const;
+
+    static std::string placementName(Placement placement);
+
+private:
+    std::vector<Target> m_targets;
+    Placement m_placement;
+
+    //С какого каталога начинать перебор при равенстве, чтобы одинаковые каталоги заполнялись по очереди
+    mutable std::atomic<size_t> m_next;
+
+    uint64_t pendingBytes(size_t index) const;
+    static uint64_t nameHash(const std::string& name);
+};
+
+#endif //UPLOAD_STORAGE_H
@@ -1,18 +1,68 @@
 #include "FileSaver.h"
+#include "FileSaverPool.h"
+#include "StreamingServer.h"
+#include "UploadHandler.h"
+#include "UploadSessions.h"
+#include "ResumableUploadHandler.h"
+#include "LogHandler.h"
+#include "FileHandler.h"
+#include "UploadIndex.h"
+#include "LogRingSink.h"
+#include "Metrics.h"
+#include "ResponseCache.h"
+#include "RateLimiter.h"
+#include "JsonResponse.h"
+#include "UploadStorage.h"
+#include "DurabilityCommitter.h"
 
-#include "server_http.hpp"
-#include <nlohmann/json.hpp>
 #include "spdlog/spdlog.h"
 #include "spdlog/sinks/rotating_file_sink.h"
 #include "spdlog/logger.h"
+#include "spdlog/async.h"
+#include "spdlog/async_logger.h"
 
 #include <fstream>
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
 
 using namespace std;
-using HttpServer = SimpleWeb::Server<SimpleWeb::HTTP>;
-using json = nlohmann::json;
 
 const std::string uploadDirectory = "/tmp";
+const std::vector<std::string> uploadDirectories = {uploadDirectory};        //Каталоги для файлов /upload, лучше по одному на диск. У каждого свои дисковые потоки
+const UploadStorage::Placement uploadPlacement = UploadStorage::FreeSpace; //Выбор каталога для нового файла: FreeSpace, QueueDepth или NameHash
+const size_t uploadWindowSize = 256 * 1024; //Сколько тела запроса /upload держим в памяти на одно соединение
+const FileWriter::Backend writerBackend = FileWriter::IoUring; //Способ записи загружаемых файлов на диск
+const bool contentAddressedStorage = false; //Хранить файлы в .blobs под их хэшем, одинаковые файлы - один раз
+const bool sha256Digest = false;           //Дайджест в индексе и GET /files: SHA-256 вместо XXH64. Blob хранится под SHA-256 всегда
+const size_t fileCacheSize = 64 * 1024 * 1024;   //Кэш небольших файлов для /files/ в памяти
+const size_t fileCacheMaxFileSize = 256 * 1024;  //Файлы крупнее отдаются через sendfile
+const size_t fileListMaxLimit = 1000;            //Максимальный размер страницы GET /files
+const unsigned long long maxUploadBodySize = 64ULL * 1024 * 1024 * 1024; //Больший запрос /upload или PATCH /uploads отклоняется с 413 до чтения тела, сжатое тело /upload не распаковывается больше этого
+const uint64_t uploadQuotaPerClient = 16ULL * 1024 * 1024 * 1024;        //Сколько байт тел /upload одновременно принимается от одного IP, 0 - без ограничения
+const uint64_t uploadQuotaTotal = 0;                                     //То же для всех клиентов вместе
+const double rateLimitRequestsPerSecond = 200;               //Запросов в секунду от одного IP, 0 - без ограничения
+const double rateLimitRequestBurst = 400;                    //Сколько запросов IP может сделать разом после простоя
+const double rateLimitBytesPerSecond = 128 * 1024 * 1024;    //Скорость приёма тел загрузок от одного IP, 0 - без ограничения
+const double rateLimitByteBurst = 16 * 1024 * 1024;
+const size_t rateLimitClients = 65536;                       //Сколько IP одновременно помнит ограничитель
+const size_t maxConcurrentUploads = 512;                     //Одновременных запросов /upload, больше - 503
+const size_t maxConcurrentResumableUploads = 512;            //То же для /uploads/
+const size_t maxConcurrentDownloads = 1024;                  //То же для /files/
+const size_t maxConcurrentLogReads = 16;                     //То же для /log
+const size_t logRingCapacity = 8192; //Сколько последних записей лога /log хранит в памяти
+const bool asyncLogging = true;      //Запись лога в фоновом потоке, а не в потоке запроса
+const size_t logQueueSize = 8192;    //Очередь асинхронного лога, выделяется заранее
+const spdlog::async_overflow_policy logOverflowPolicy = spdlog::async_overflow_policy::overrun_oldest; //block - ждать места, overrun_oldest - вытеснять старые записи
+const std::chrono::seconds logFlushInterval(1); //Как часто фоновый поток сбрасывает лог на диск
+const size_t threadPoolSize = std::max(1u, std::thread::hardware_concurrency());
+const size_t diskThreadCount = 2;                           //Потоки записи на диск, 0 - писать прямо в сетевых потоках
+const size_t diskQueueCapacity = 1024;                      //Заданий в очереди одного дискового потока
+const size_t diskBufferSize = uploadWindowSize;             //Промежуточный буфер между сетью и диском, столько же памяти у писателя на каждый открытый файл
+const size_t maxPendingBytesPerUpload = 4 * diskBufferSize; //Сколько данных соединения может ждать записи, дальше чтение из сокета приостанавливается
+const DurabilityCommitter::Mode durabilityMode = DurabilityCommitter::GroupCommit; //Ответ /upload после сброса файлов на диск: None, PerFile или GroupCommit
+const std::chrono::microseconds groupCommitWindow(200);    //Сколько пачка GroupCommit ждёт файлы других запросов. Файлы, закрытые во время сброса, и так попадут в следующую пачку
+const size_t groupCommitMaxFiles = 256;                     //Пачка сбрасывается раньше, если в ней столько файлов
 
 bool isValidIP(const std::string& ip)
 {
@@ -55,11 +105,50 @@ bool isUserPort(const std::string& portStr)
 
 void printUsage(const char* programName)
 {
-    std::cout << "Использование: " << programName << " <IP-адрес> <порт>" << std::endl;
+    std::cout << "Использование: " << programName << " <IP-адрес> <порт> [--shards <N|auto>] [--pin <none|cores>] [--limits <on|off>]" << std::endl;
     std::cout << "Пример: " << programName << " 192.168.1.1 8080" << std::endl;
+    std::cout << "Пример: " << programName << " 192.168.1.1 8080 --shards auto --pin cores" << std::endl;
     std::cout << "IP-адрес должен быть валидным IPv4 адресом" << std::endl;
     std::cout << "Порт должен быть в диапазоне 1-65535" << std::endl;
     std::cout << "Порт должен быть ≥ 1024" << std::endl;
+    std::cout << "--shards - число серверов на одном порту (SO_REUSEPORT), у каждого свой поток; auto - по числу доступных ядер" << std::endl;
+    std::cout << "--pin cores - закрепить поток каждого сервера за своим ядром" << std::endl;
+    std::cout << "--limits off - без ограничения частоты запросов, одновременных запросов и квоты загрузок (для нагрузочных тестов)" << std::endl;
+}
+
+//Ядра, на которых процессу разрешено работать
+std::vector<int> allowedCpus()
+{
+    std::vector<int> cpus;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if(sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if(CPU_ISSET(cpu, &set))
+            {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+
+    if(cpus.empty())
+    {
+        cpus.push_back(0);
+    }
+
+    return cpus;
+}
+
+bool pinCurrentThread(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
 }
 
 bool checkRootPrivileges()
@@ -98,7 +187,7 @@ bool createUploadsDirectory(std::string newDirectory)
 int main(int argc, char* argv[])
 {
     //Проверка количества аргументов
-    if(argc != 3)
+    if(argc < 3)
     {
         std::cerr << "Ошибка: неверное количество аргументов!" << std::endl;
         printUsage(argv[0]);
@@ -132,6 +221,40 @@ int main(int argc, char* argv[])
         return 1;
     }
 
+    //Необязательные параметры после IP-адреса и порта
+    size_t shardCount = 0;  //0 - один сервер с общим пулом потоков
+    bool pinShards = false;
+    bool limits = true;     //Ограничитель запросов и квота /upload
+
+    for(int i = 3; i < argc; i += 2)
+    {
+        std::string option = argv[i];
+        std::string value = i + 1 < argc ? argv[i + 1] : "";
+
+        if(option == "--shards" && value == "auto")
+        {
+            shardCount = allowedCpus().size();
+        }
+        else if(option == "--shards" && !value.empty() && value.size() <= 4 && std::all_of(value.begin(), value.end(), ::isdigit))
+        {
+            shardCount = std::stoul(value);
+        }
+        else if(option == "--pin" && (value == "none" || value == "cores"))
+        {
+            pinShards = value == "cores";
+        }
+        else if(option == "--limits" && (value == "on" || value == "off"))
+        {
+            limits = value == "on";
+        }
+        else
+        {
+            std::cerr << "Ошибка: неверный параметр: " << option << " " << value << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
     //Проверка, запущено ли от root'а
     if(!checkRootPrivileges())
     {
@@ -146,157 +269,484 @@ int main(int argc, char* argv[])
         return 1;
     }
 
+    for(const std::string& directory : uploadDirectories)
+    {
+        if(!createUploadsDirectory(directory))
+        {
+            std::cerr << "Не удалось создать директорию: " << directory << std::endl;
+            return 1;
+        }
+    }
+
     //Создаём логгер
     auto max_size = 1024 * 1024 * 1024 * 2.5; //2.5 Мб, общий размер двух файлов лога 5 МБ
     auto max_files = 1;
 
-    auto file_sink = std::make_shared<spdlog::sinks::rotating_file_sink_st>("log.txt", max_size, max_files);
+    auto file_sink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>("log.txt", max_size, max_files);
     file_sink->set_level(spdlog::level::trace);
 
-    auto logger = std::make_shared<spdlog::logger>("HTTP server logger", file_sink);
+    //Последние записи дублируются в память, чтобы /log мог отвечать без чтения файлов
+    auto ring_sink = std::make_shared<LogRingSink>(logRingCapacity);
+    ring_sink->set_level(spdlog::level::trace);
+
+    std::shared_ptr<spdlog::logger> logger;
+    std::shared_ptr<spdlog::details::thread_pool> logThreadPool;
+
+    if(asyncLogging)
+    {
+        //Поток запроса только кладёт запись в очередь. Фоновый поток пишет записи пачками через буфер файла
+        //и сбрасывает его на диск по заполнении, раз в logFlushInterval или сразу при ошибке
+        logThreadPool = std::make_shared<spdlog::details::thread_pool>(logQueueSize, 1);
+        logger = std::make_shared<spdlog::async_logger>("HTTP server logger", spdlog::sinks_init_list{file_sink, ring_sink},
+                                                        logThreadPool, logOverflowPolicy);
+        logger->flush_on(spdlog::level::err);
+
+        spdlog::register_logger(logger);
+        spdlog::flush_every(logFlushInterval);
+    }
+    else
+    {
+        logger = std::make_shared<spdlog::logger>("HTTP server logger", spdlog::sinks_init_list{file_sink, ring_sink});
+        logger->flush_on(spdlog::level::trace);
+    }
+
     logger->set_level(spdlog::level::trace);
-    logger->flush_on(spdlog::level::trace);
 
 
     //Создаём сервер
     HttpServer server;
     server.config.address = ip;
     server.config.port = std::stoi(port);
+    server.config.thread_pool_size = threadPoolSize;
+    server.streamBufferSize = uploadWindowSize;
+    server.maxStreamBodySize = maxUploadBodySize;
+
+    //Остальные серверы шардированного режима, заполняются после настройки маршрутов
+    std::vector<std::unique_ptr<HttpServer>> shards;
 
 
-    //Создаём сохраняльщик файлов
-    FileSaver fileSaver;
-    fileSaver.setLogger(logger);
-    fileSaver.setDir(uploadDirectory);
+    //Метрики для /metrics
+    auto metrics = std::make_shared<Metrics>();
+    for(const char* route : {"/info", "/upload", "/log", "/metrics", "/files", "/files/", "/uploads", "/uploads/"})
+    {
+        if(!metrics->addRoute(route))
+        {
+            logger->error(std::string("Too many routes for /metrics, requests to ") + route + " are counted as other");
+        }
+    }
+    metrics->setActiveConnections([&server, &shards]()
+                                  {
+                                      size_t connections = server.activeConnections();
+                                      for(auto& shard : shards)
+                                      {
+                                          connections += shard->activeConnections();
+                                      }
+                                      return connections;
+                                  });
+
+    server.onResponse = [metrics](const shared_ptr<HttpServer::Request>& request, int status)
+                        {
+                            metrics->response(request->path, status, std::chrono::system_clock::now() - request->header_read_time);
+                        };
+
+
+    //Ограничитель перед таблицей маршрутов: частота запросов и скорость тел от каждого IP,
+    //число одновременных запросов к тяжёлым маршрутам. Отказы видны в логе и в /metrics.
+    //Нагрузочный тест шлёт все запросы с одного адреса, для него ограничитель отключается параметром --limits off
+    if(limits)
+    {
+        auto rateLimiter = std::make_shared<RateLimiter>(rateLimitRequestsPerSecond, rateLimitRequestBurst,
+                                                         rateLimitBytesPerSecond, rateLimitByteBurst,
+                                                         rateLimitClients, logger);
+        rateLimiter->setMetrics(metrics);
+        rateLimiter->addRoute("/upload", maxConcurrentUploads);
+        rateLimiter->addRoute("/uploads/", maxConcurrentResumableUploads);
+        rateLimiter->addRoute("/files/", maxConcurrentDownloads);
+        rateLimiter->addRoute("/log", maxConcurrentLogReads);
+
+        server.onRequest = [rateLimiter](const shared_ptr<HttpServer::Request>& request)
+                           {
+                               HttpServer::Admission admission;
+                               std::string client = request->remote_endpoint_address();
+
+                               //Клиент шлёт запросы слишком часто - 429, повторить можно, когда ведро наполнится
+                               std::chrono::nanoseconds wait = rateLimiter->request(client);
+                               if(wait.count() > 0)
+                               {
+                                   admission.status = SimpleWeb::StatusCode::client_error_too_many_requests;
+                                   admission.header.emplace("Retry-After", std::to_string(std::chrono::duration_cast<std::chrono::seconds>(wait).count() + 1));
+                                   return admission;
+                               }
+
+                               //Маршрут перегружен не по вине клиента - 503
+                               if(!rateLimiter->enter(client, request->path, admission.ticket))
+                               {
+                                   admission.status = SimpleWeb::StatusCode::server_error_service_unavailable;
+                                   admission.header.emplace("Retry-After", "1");
+                                   return admission;
+                               }
+
+                               admission.pace = [rateLimiter, client](size_t bytes)
+                                                {
+                                                    return rateLimiter->received(client, bytes);
+                                                };
+
+                               return admission;
+                           };
+    }
+
+
+    //Индекс загруженных файлов для GET /files, сохраняется в том же каталоге
+    auto uploadIndex = std::make_shared<UploadIndex>(uploadDirectory, logger);
+    uploadIndex->load();
+
+    //Создаём пул сохраняльщиков файлов, каждый запрос /upload получает свой
+    auto fileSaverPool = std::make_shared<FileSaverPool>(uploadDirectory, uploadWindowSize, writerBackend, logger, threadPoolSize * 4);
+    fileSaverPool->setMetrics(metrics);
+    fileSaverPool->setWriterBufferSize(diskBufferSize);
+    fileSaverPool->setContentAddressed(contentAddressedStorage, sha256Digest);
+    fileSaverPool->setUploadIndex(uploadIndex);
+    fileSaverPool->setMaxDecodedSize(maxUploadBodySize);
+
+    //Докачиваемые загрузки хранят состояние в том же каталоге
+    auto uploadSessions = std::make_shared<UploadSessions>(uploadDirectory, writerBackend, logger);
+    uploadSessions->setWriterBufferSize(diskBufferSize);
+    uploadSessions->setUploadIndex(uploadIndex);
+
+    //Запись на диск в отдельных потоках, чтобы медленный диск не занимал сетевые потоки
+    std::shared_ptr<DiskWriteStage> diskWriteStage;
+    if(diskThreadCount > 0)
+    {
+        diskWriteStage = std::make_shared<DiskWriteStage>(diskThreadCount, diskQueueCapacity, diskBufferSize);
+        fileSaverPool->setDiskWriteStage(diskWriteStage, maxPendingBytesPerUpload);
+        uploadSessions->setDiskWriteStage(diskWriteStage, maxPendingBytesPerUpload);
+        metrics->setDiskWriteStage(diskWriteStage);
+    }
+
+    //Файлы /upload расходятся по каталогам хранилища. Каждый каталог пишут свои дисковые потоки,
+    //основной каталог делит их с докачиваемыми загрузками
+    auto uploadStorage = std::make_shared<UploadStorage>(uploadDirectories, uploadPlacement);
+    for(size_t i = 0; i < uploadStorage->size() && diskWriteStage; i++)
+    {
+        uploadStorage->setDiskWriteStage(i, uploadStorage->target(i).dir == uploadDirectory ? diskWriteStage :
+                                            std::make_shared<DiskWriteStage>(diskThreadCount, diskQueueCapacity, diskBufferSize));
+    }
+    fileSaverPool->setStorage(uploadStorage);
+    uploadSessions->setStorage(uploadStorage);
+    uploadSessions->setContentAddressed(contentAddressedStorage, sha256Digest);
+
+    //Ответ /upload уходит, когда файлы запроса сброшены на диск
+    auto durabilityCommitter = std::make_shared<DurabilityCommitter>(durabilityMode, groupCommitWindow, groupCommitMaxFiles);
+    durabilityCommitter->setMetrics(metrics);
+    fileSaverPool->setDurability(durabilityCommitter);
+    uploadSessions->setDurability(durabilityCommitter);
+    logger->info("Upload durability: " + DurabilityCommitter::modeName(durabilityMode));
+    logger->info("Upload storage: " + std::to_string(uploadStorage->size()) + " directories, placement by " +
+                 UploadStorage::placementName(uploadPlacement));
 
 
     //GET запрос по пути /info
-    server.resource["^/info$"]["GET"] = [](shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+    //Ответ /info строится заново только при изменении статистики, версия - свёртка её полей
+    auto infoCache = make_shared<ResponseCache>("application/json",
+                                                [diskWriteStage]()
+                                                {
+                                                    uint64_t stamp = 0;
+
+                                                    if(diskWriteStage)
+                                                    {
+                                                        DiskWriteStage::Statistics statistics = diskWriteStage->statistics();
+
+                                                        for(uint64_t value : {statistics.threads, statistics.queueDepth, statistics.queueCapacity,
+                                                                              statistics.queueFullWaits, statistics.stalls, statistics.stallTimeUs,
+                                                                              statistics.bufferSize, statistics.buffersAllocated, statistics.buffersInUse,
+                                                                              statistics.bytesPending, statistics.bytesWritten})
+                                                        {
+                                                            stamp = ResponseCache::combine(stamp, value);
+                                                        }
+                                                    }
+
+                                                    return stamp;
+                                                },
+                                                [diskWriteStage]()
+                                                {
+                                                    std::string info;
+                                                    JsonWriter writer(info);
+
+                                                    writer.beginObject()
+                                                          .field("state:", "ok");
+
+                                                    if(diskWriteStage)
+                                                    {
+                                                        DiskWriteStage::Statistics statistics = diskWriteStage->statistics();
+
+                                                        writer.key("diskWrite")
+                                                              .beginObject()
+                                                              .field("threads", statistics.threads)
+                                                              .field("queueDepth", statistics.queueDepth)
+                                                              .field("queueCapacity", statistics.queueCapacity)
+                                                              .field("queueFullWaits", statistics.queueFullWaits)
+                                                              .field("stalls", statistics.stalls)
+                                                              .field("stallTimeUs", statistics.stallTimeUs)
+                                                              .field("bufferSize", statistics.bufferSize)
+                                                              .field("buffersAllocated", statistics.buffersAllocated)
+                                                              .field("buffersInUse", statistics.buffersInUse)
+                                                              .field("bytesPending", statistics.bytesPending)
+                                                              .field("bytesWritten", statistics.bytesWritten)
+                                                              .endObject();
+                                                    }
+
+                                                    writer.endObject();
+
+                                                    return info;
+                                                });
+
+    server.resource["^/info$"]["GET"] = [infoCache](shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
                                         {
-                                            json info =
-                                            {
-                                                {"state:", "ok"}
-                                            };
-
-                                            auto content = info.dump(2);
-                                            *response << "HTTP/1.1 200 OK\r\n"
-                                                      << "Content-Type: application/json\r\n"
-                                                      << "Content-Length: " << content.length() << "\r\n"
-                                                      << "\r\n"
-                                                      << content;
+                                            infoCache->write(response, request);
                                         };
 
 
-    //POST запрос по пути /upload
-    server.resource["^/upload$"]["POST"] = [&fileSaver](auto response, auto request)
+    //GET запрос по пути /metrics, формат Prometheus
+    server.resource["^/metrics$"]["GET"] = [metrics](shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> /*request*/)
                                            {
-                                                   fileSaver.setRequestHeader(request->header);
-                                                   json result = fileSaver.processStream(request->content);
+                                               auto content = metrics->render();
+                                               *response << "HTTP/1.1 200 OK\r\n"
+                                                         << "Content-Type: text/plain; version=0.0.4\r\n"
+                                                         << "Content-Length: " << content.length() << "\r\n"
+                                                         << "\r\n"
+                                                         << content;
+                                           };
 
-                                                   std::string response_content = result.dump();
 
-                                                   *response << "HTTP/1.1 200 OK\r\n"
-                                                             << "Content-Type: application/json\r\n"
-                                                             << "Content-Length: " << response_content.length() << "\r\n"
-                                                             << "\r\n" << response_content;
-                                           };
+    //POST запрос по пути /upload, тело запроса передаётся в FileSaver по мере чтения из сокета.
+    //Заголовки, свободное место и квота клиента проверяются до чтения тела
+    auto uploadQuota = limits ? std::make_shared<UploadQuota>(uploadQuotaPerClient, uploadQuotaTotal) : nullptr;
 
+    server.streamResource["^/upload$"]["POST"] = [fileSaverPool, uploadQuota](shared_ptr<HttpServer::Request> request)
+                                                 {
+                                                     return std::make_shared<UploadHandler>(fileSaverPool->acquire(), request, uploadQuota);
+                                                 };
 
-    //GET запрос по пути /log
-    server.resource["^/log$"]["GET"] = [](shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
-                                       {
-                                           try
-                                           {
-                                               const size_t MAX_TOTAL_SIZE = 1024 * 1024 * 1024 * 5; //5 Мб
-                                               size_t total_size = 0;
-                                               std::string content;
-                                               bool log_exists = false;
-                                               bool log1_exists = false;
-
-                                               //Проверяем существование и размер log.1.txt
-                                               std::ifstream file1("log.1.txt");
-                                               if(file1)
-                                               {
-                                                   log1_exists = true;
-                                                   file1.seekg(0, std::ios::end);
-                                                   std::streampos size1 = file1.tellg();
-                                                   file1.seekg(0, std::ios::beg);
-                                                   total_size += size1;
-
-                                                   if(size1 > 0)
-                                                   {
-                                                       content += std::string((std::istreambuf_iterator<char>(file1)), std::istreambuf_iterator<char>());
-                                                   }
-                                               }
-
-
-                                               //Проверяем существование и размер log.txt
-                                               std::ifstream file("log.txt");
-                                               if(file)
-                                               {
-                                                   log_exists = true;
-                                                   file.seekg(0, std::ios::end);
-                                                   std::streampos size = file.tellg();
-                                                   file.seekg(0, std::ios::beg);
-                                                   total_size += size;
-
-                                                   if(size > 0)
-                                                   {
-                                                       content += std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-                                                   }
-                                               }
-
-
-                                               //Проверяем общий размер файлов
-                                               if(total_size > MAX_TOTAL_SIZE)
-                                               {
-                                                   std::string size_warning = "Общий размер файла логов превышает 5 МБ: " + std::to_string(total_size) + " байт";
-                                                   *response << "HTTP/1.1 200 OK\r\n"
-                                                               << "Content-Type: text/plain; charset=utf-8\r\n"
-                                                               << "Content-Length: " << size_warning.length() << "\r\n"
-                                                               << "\r\n"
-                                                               << size_warning;
-                                                   return;
-                                               }
-
-                                               //Формируем ответ в зависимости от наличия файлов и их содержимого
-                                               if(!content.empty())
-                                               {
-                                                   *response << "HTTP/1.1 200 OK\r\n"
-                                                               << "Content-Type: text/plain; charset=utf-8\r\n"
-                                                               << "Content-Length: " << content.length() << "\r\n"
-                                                               << "\r\n"
-                                                               << content;
-                                               }
-                                               else if(log_exists)
-                                               {
-                                                   std::string empty_content = "Файл логов существует, но пуст";
-                                                   *response << "HTTP/1.1 200 OK\r\n"
-                                                               << "Content-Type: text/plain; charset=utf-8\r\n"
-                                                               << "Content-Length: " << empty_content.length() << "\r\n"
-                                                               << "\r\n"
-                                                               << empty_content;
-                                               }
-                                               else
-                                               {
-                                                   std::string no_files_content = "Файл логов отсутствует";
-                                                   *response << "HTTP/1.1 200 OK\r\n"
-                                                               << "Content-Type: text/plain; charset=utf-8\r\n"
-                                                               << "Content-Length: " << no_files_content.length() << "\r\n"
-                                                               << "\r\n"
-                                                               << no_files_content;
-                                               }
-                                           }
-                                           catch (const std::exception& e)
-                                           {
-                                               std::string error_content = "Ошибка: " + std::string(e.what());
-                                               *response << "HTTP/1.1 500 Internal Server Error\r\n"
-                                                           << "Content-Type: text/plain; charset=utf-8\r\n"
-                                                           << "Content-Length: " << error_content.length() << "\r\n"
-                                                           << "\r\n"
-                                                           << error_content;
-                                           }
-                                       };
+
+    //Докачиваемая загрузка: POST /uploads создаёт сессию (заголовки Upload-Name и Upload-Length),
+    //PATCH /uploads/<id> дописывает данные с Upload-Offset, GET /uploads/<id> возвращает текущее смещение,
+    //POST /uploads/<id>/finish переносит файл в каталог загрузок, DELETE /uploads/<id> отменяет загрузку
+    server.resource["^/uploads$"]["POST"] = [uploadSessions](shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+                                            {
+                                                auto name = request->header.find("Upload-Name");
+                                                auto length = request->header.find("Upload-Length");
+
+                                                if(name == request->header.end() || length == request->header.end())
+                                                {
+                                                    JsonResponse::sendError(response, SimpleWeb::StatusCode::client_error_bad_request,
+                                                                            "Upload-Name and Upload-Length headers are required");
+                                                    return;
+                                                }
+
+                                                uint64_t size = 0;
+                                                try
+                                                {
+                                                    size = std::stoull(length->second);
+                                                }
+                                                catch(const std::exception&)
+                                                {
+                                                    JsonResponse::sendError(response, SimpleWeb::StatusCode::client_error_bad_request, "Invalid Upload-Length");
+                                                    return;
+                                                }
+
+                                                UploadSessions::Session session;
+                                                std::string error;
+                                                if(!uploadSessions->create(name->second, size, session, error))
+                                                {
+                                                    JsonResponse::sendError(response, SimpleWeb::StatusCode::client_error_bad_request, error);
+                                                    return;
+                                                }
+
+                                                JsonResponse result(SimpleWeb::StatusCode::success_created,
+                                                                    "Location: /uploads/" + session.id + "\r\nUpload-Offset: 0\r\n");
+                                                result.body().beginObject()
+                                                             .field("status", "success")
+                                                             .field("id", session.id)
+                                                             .field("offset", session.offset)
+                                                             .field("length", session.length)
+                                                             .endObject();
+                                                result.send(response);
+                                            };
+
+    server.resource["^/uploads/([0-9a-f]{32})$"]["GET"] = [uploadSessions](shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+                                                          {
+                                                              UploadSessions::Session session;
+                                                              if(!uploadSessions->find(request->path_match[1].str(), session))
+                                                              {
+                                                                  JsonResponse::sendError(response, SimpleWeb::StatusCode::client_error_not_found, "Upload not found");
+                                                                  return;
+                                                              }
+
+                                                              JsonResponse result(SimpleWeb::StatusCode::success_ok,
+                                                                                  "Upload-Offset: " + std::to_string(session.offset) + "\r\n");
+                                                              result.body().beginObject()
+                                                                           .field("status", "success")
+                                                                           .field("id", session.id)
+                                                                           .field("filename", session.filename)
+                                                                           .field("offset", session.offset)
+                                                                           .field("length", session.length)
+                                                                           .endObject();
+                                                              result.send(response);
+                                                          };
+
+    server.streamResource["^/uploads/([0-9a-f]{32})$"]["PATCH"] = [uploadSessions](shared_ptr<HttpServer::Request> request)
+                                                                  {
+                                                                      return std::make_shared<ResumableUploadHandler>(uploadSessions, request);
+                                                                  };
+
+    server.resource["^/uploads/([0-9a-f]{32})/finish$"]["POST"] = [uploadSessions](shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+                                                                  {
+                                                                      std::string error;
+                                                                      auto finished = [response](bool stored, const UploadSessions::Session& session)
+                                                                                      {
+                                                                                          if(!stored)
+                                                                                          {
+                                                                                              JsonResponse::sendError(response, SimpleWeb::StatusCode::server_error_internal_server_error,
+                                                                                                                      "Error while storing file " + session.filename);
+                                                                                              return;
+                                                                                          }
+
+                                                                                          //Ответ в том же виде, что и у /upload
+                                                                                          JsonResponse result(SimpleWeb::StatusCode::success_ok);
+                                                                                          JsonWriter& body = result.body();
+
+                                                                                          body.beginObject()
+                                                                                              .field("status", "success")
+                                                                                              .key("uploadedFiles")
+                                                                                              .beginArray()
+                                                                                              .beginObject()
+                                                                                              .field("filename", session.filename)
+                                                                                              .field("size", session.length);
+
+                                                                                          if(!session.xxh64.empty())
+                                                                                          {
+                                                                                              body.field("xxh64", session.xxh64)
+                                                                                                  .field("sha256", session.sha256);
+                                                                                          }
+
+                                                                                          body.field("location", session.location)
+                                                                                              .endObject()
+                                                                                              .endArray()
+                                                                                              .endObject();
+                                                                                          result.send(response);
+                                                                                      };
+
+                                                                      //Ответ уходит, когда файл на месте и сброшен на диск
+                                                                      if(!uploadSessions->finish(request->path_match[1].str(), error, finished))
+                                                                      {
+                                                                          JsonResponse::sendError(response, SimpleWeb::StatusCode::client_error_conflict, error);
+                                                                      }
+                                                                  };
+
+    server.resource["^/uploads/([0-9a-f]{32})$"]["DELETE"] = [uploadSessions](shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+                                                             {
+                                                                 if(!uploadSessions->remove(request->path_match[1].str()))
+                                                                 {
+                                                                     JsonResponse::sendError(response, SimpleWeb::StatusCode::client_error_not_found,
+                                                                                             "Upload not found or is receiving data");
+                                                                     return;
+                                                                 }
+
+                                                                 JsonResponse result(SimpleWeb::StatusCode::success_ok);
+                                                                 result.body().beginObject()
+                                                                              .field("status", "success")
+                                                                              .endObject();
+                                                                 result.send(response);
+                                                             };
+
+
+    //GET запрос по пути /files, список загруженных файлов из индекса.
+    //?prefix= - только имена с этим началом, ?after= - продолжить после имени (значение next из прошлой страницы), ?limit= - размер страницы
+    server.resource["^/files$"]["GET"] = [uploadIndex](shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+                                         {
+                                             auto query = request->parse_query_string();
+
+                                             std::string prefix;
+                                             std::string after;
+                                             size_t limit = 100;
+
+                                             auto it = query.find("prefix");
+                                             if(it != query.end())
+                                             {
+                                                 prefix = it->second;
+                                             }
+
+                                             it = query.find("after");
+                                             if(it != query.end())
+                                             {
+                                                 after = it->second;
+                                             }
+
+                                             it = query.find("limit");
+                                             if(it != query.end())
+                                             {
+                                                 try
+                                                 {
+                                                     limit = std::min<size_t>(std::stoull(it->second), fileListMaxLimit);
+                                                 }
+                                                 catch(const std::exception&)
+                                                 {
+                                                     JsonResponse::sendError(response, SimpleWeb::StatusCode::client_error_bad_request, "limit must be a number");
+                                                     return;
+                                                 }
+                                             }
+
+                                             //Берём на одно имя больше, чтобы знать, есть ли следующая страница
+                                             std::vector<UploadIndex::Entry> entries = uploadIndex->list(prefix, after, limit + 1);
+
+                                             JsonResponse result(SimpleWeb::StatusCode::success_ok);
+                                             JsonWriter& body = result.body();
+
+                                             body.beginObject()
+                                                 .field("status", "success")
+                                                 .field("total", uploadIndex->size())
+                                                 .key("files")
+                                                 .beginArray();
+
+                                             for(size_t i = 0; i < entries.size() && i < limit; i++)
+                                             {
+                                                 body.beginObject()
+                                                     .field("name", entries[i].name)
+                                                     .field("size", entries[i].size)
+                                                     .field("time", entries[i].time)
+                                                     .field("digest", entries[i].digest)
+                                                     .endObject();
+                                             }
+
+                                             body.endArray();
+
+                                             if(entries.size() > limit && limit > 0)
+                                             {
+                                                 body.field("next", entries[limit - 1].name);
+                                             }
+
+                                             body.endObject();
+
+                                             result.send(response);
+                                         };
+
+
+    //GET запрос по пути /files/<имя>, загруженные файлы отдаются через sendfile или из кэша в памяти
+    //Основной каталог первым: туда же сохраняют докачиваемые загрузки
+    std::vector<std::string> fileDirectories = {uploadDirectory};
+    for(const std::string& directory : uploadDirectories)
+    {
+        if(directory != uploadDirectory)
+        {
+            fileDirectories.push_back(directory);
+        }
+    }
+
+    server.fileResource["^/files/([^/]+)$"]["GET"] = FileHandler(fileDirectories, std::make_shared<FileCache>(fileCacheSize, fileCacheMaxFileSize));
+
+
+    //GET запрос по пути /log, файлы отдаются через sendfile без чтения в память
+    server.fileResource["^/log$"]["GET"] = LogHandler({"log.1.txt", "log.txt"}, ring_sink);
 
 
     std::string info = "Запущен сервер с IP = " + server.config.address + " и портом = " + std::to_string(server.config.port);
@@ -304,7 +754,86 @@ int main(int argc, char* argv[])
     std::cout << info << std::endl;
 
     //Запуск сервера
-    server.start();
+    if(shardCount == 0)
+    {
+        server.start();
+    }
+    else
+    {
+        //Шардированный режим: shardCount серверов слушают один порт через SO_REUSEPORT, у каждого свой io_service
+        //и один поток. Соединение от accept до закрытия обслуживает поток своего шарда, поэтому буферы соединения
+        //выделяются и используются на одном ядре (а при закреплении - в памяти его узла NUMA)
+        std::vector<HttpServer*> servers = {&server};
+
+        for(size_t i = 1; i < shardCount; i++)
+        {
+            shards.emplace_back(new HttpServer());
+            HttpServer& shard = *shards.back();
+
+            shard.config = server.config;
+            shard.streamBufferSize = server.streamBufferSize;
+            shard.maxStreamBodySize = server.maxStreamBodySize;
+            shard.resource = server.resource;
+            shard.default_resource = server.default_resource;
+            shard.streamResource = server.streamResource;
+            shard.fileResource = server.fileResource;
+            shard.onRequest = server.onRequest;
+            shard.onResponse = server.onResponse;
+            shard.on_error = server.on_error;
+
+            servers.push_back(&shard);
+        }
+
+        //Сначала открываем порт во всех шардах, потоки запускаем, только когда это удалось всем:
+        //выходить из main с работающими потоками нельзя
+        for(HttpServer* shard : servers)
+        {
+            shard->io_service = std::make_shared<SimpleWeb::io_context>();
+
+            try
+            {
+                shard->bindShared();
+                shard->accept_and_run();
+            }
+            catch(const std::exception& e)
+            {
+                std::cerr << "Ошибка: не удалось открыть порт " << port << ": " << e.what() << std::endl;
+                logger->error("Cannot listen on port " + port + ": " + e.what());
+                return 1;
+            }
+        }
+
+        std::vector<int> cpus = allowedCpus();
+        std::vector<std::thread> threads;
+
+        for(size_t i = 0; i < servers.size(); i++)
+        {
+            HttpServer* shard = servers[i];
+            int cpu = cpus[i % cpus.size()];
+
+            threads.emplace_back([shard, cpu, pinShards, logger]()
+                                 {
+                                     //Закрепляем до первого accept, чтобы вся память шарда выделялась уже на своём ядре
+                                     if(pinShards && !pinCurrentThread(cpu))
+                                     {
+                                         logger->warn("Cannot pin server thread to CPU " + std::to_string(cpu));
+                                     }
+
+                                     shard->io_service->run();
+                                 });
+        }
+
+        logger->info("Server shards: " + std::to_string(servers.size()) + (pinShards ? ", pinned to cores" : ""));
+
+        for(auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    //Дописываем очередь лога перед выходом
+    logger->flush();
+    spdlog::shutdown();
 
     return 0;
 }
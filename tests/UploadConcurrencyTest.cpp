@@ -0,0 +1,515 @@
+//Проверка одновременных загрузок: сервер с маршрутом /upload, собранным как в main.cpp (FileSaverPool, UploadHandler,
+//дисковые потоки), работает в этом же процессе на случайном порту loopback. Много клиентских потоков одновременно
+//шлют POST /upload по keep-alive соединениям, в каждом запросе несколько файлов со случайным содержимым,
+//в том числе с кусками boundary и переводами строк. Каждый сохранённый файл сравнивается с отправленным побайтно.
+//Одновременно другие клиенты обрывают соединение посреди тела и шлют тела без завершающего boundary под именами
+//уже сохранённых файлов: прежние файлы и их записи в индексе должны остаться как были.
+//
+//UploadConcurrencyTest [клиентов] [загрузок на клиента] [потоков сервера]
+
+#include "StreamingServer.h"
+#include "FileSaverPool.h"
+#include "UploadHandler.h"
+#include "DiskWriteStage.h"
+#include "UploadIndex.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+using HttpServer = SimpleWeb::Server<StreamingHTTP>;
+
+const std::string boundary = "----ConcurrencyTestBoundary9fQ2";
+
+struct ExpectedFile
+{
+    std::string name;
+    std::string content;
+};
+
+//Случайное содержимое, в котором часто встречаются переводы строк и начало boundary
+std::string fileContent(std::mt19937& random, size_t size)
+{
+    static const std::string fragments[] = {"\r\n", "\r\n--", "--" + boundary.substr(0, 10), "\r\n--" + boundary.substr(0, boundary.size() - 1), "\n", "\r"};
+
+    std::string data;
+    data.reserve(size);
+
+    while(data.size() < size)
+    {
+        if(random() % 64 == 0)
+        {
+            data += fragments[random() % (sizeof(fragments) / sizeof(fragments[0]))];
+        }
+        else
+        {
+            data.push_back(static_cast<char>(random()));
+        }
+    }
+
+    data.resize(size);
+    return data;
+}
+
+int connectTo(unsigned short port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+    {
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+
+    if(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+//Отправляет запрос порциями случайного размера, чтобы тело приходило на сервер разными кусками
+bool sendAll(int fd, const std::string& data, std::mt19937& random)
+{
+    size_t sent = 0;
+
+    while(sent < data.size())
+    {
+        size_t size = std::min<size_t>(data.size() - sent, 1 + random() % (96 * 1024));
+
+        ssize_t result = send(fd, data.data() + sent, size, MSG_NOSIGNAL);
+        if(result <= 0)
+        {
+            return false;
+        }
+
+        sent += result;
+    }
+
+    return true;
+}
+
+//Читает один ответ с Content-Length. buffer хранит байты, прочитанные сверх ответа
+bool readResponse(int fd, std::string& buffer, int& status, std::string& body)
+{
+    char chunk[16 * 1024];
+    size_t headerEnd;
+
+    while((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos)
+    {
+        ssize_t result = recv(fd, chunk, sizeof(chunk), 0);
+        if(result <= 0)
+        {
+            return false;
+        }
+
+        buffer.append(chunk, result);
+    }
+
+    std::string header = buffer.substr(0, headerEnd);
+    status = (header.size() > 12) ? std::atoi(header.c_str() + 9) : 0;
+
+    size_t contentLength = 0;
+    std::string lower = header;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+
+    size_t position = lower.find("content-length:");
+    if(position != std::string::npos)
+    {
+        contentLength = std::stoull(header.substr(position + 15));
+    }
+
+    size_t total = headerEnd + 4 + contentLength;
+
+    while(buffer.size() < total)
+    {
+        ssize_t result = recv(fd, chunk, sizeof(chunk), 0);
+        if(result <= 0)
+        {
+            return false;
+        }
+
+        buffer.append(chunk, result);
+    }
+
+    body = buffer.substr(headerEnd + 4, contentLength);
+    buffer.erase(0, total);
+
+    return true;
+}
+
+//closed - с завершающим boundary. Без него тело разобрано не до конца и загрузка должна завершиться ошибкой
+std::string makeRequest(const std::vector<ExpectedFile>& files, bool closed = true)
+{
+    std::string body;
+
+    for(const ExpectedFile& file : files)
+    {
+        body += "--" + boundary + "\r\n"
+                "Content-Disposition: form-data; name=\"file\"; filename=\"" + file.name + "\"\r\n"
+                "Content-Type: application/octet-stream\r\n"
+                "\r\n" + file.content + "\r\n";
+    }
+
+    if(closed)
+    {
+        body += "--" + boundary + "--\r\n";
+    }
+
+    return "POST /upload HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+           "Content-Type: multipart/form-data; boundary=" + boundary + "\r\n"
+           "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+std::string readFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream content;
+    content << file.rdbuf();
+
+    return content.str();
+}
+
+//Загрузки одного клиента. Сохранённые файлы проверяются после остановки сервера
+void runClient(size_t index, unsigned short port, size_t uploads, std::vector<ExpectedFile>& expected, std::atomic<size_t>& errors)
+{
+    std::mt19937 random(static_cast<uint32_t>(index) * 7919 + 1);
+
+    int fd = connectTo(port);
+    if(fd < 0)
+    {
+        std::cerr << "Client " << index << ": cannot connect" << std::endl;
+        errors++;
+        return;
+    }
+
+    std::string buffer;
+
+    for(size_t i = 0; i < uploads; i++)
+    {
+        //Пустые файлы, файлы меньше и больше окна разбора и буфера чтения сервера
+        std::vector<ExpectedFile> files(1 + random() % 3);
+        for(size_t f = 0; f < files.size(); f++)
+        {
+            static const size_t sizes[] = {0, 1, 100, 4 * 1024, 64 * 1024, 300 * 1024};
+            size_t size = sizes[random() % (sizeof(sizes) / sizeof(sizes[0]))] + random() % 2048;
+
+            files[f].name = "concurrency_" + std::to_string(index) + "_" + std::to_string(i) + "_" + std::to_string(f) + ".bin";
+            files[f].content = fileContent(random, size);
+        }
+
+        int status = 0;
+        std::string body;
+
+        if(!sendAll(fd, makeRequest(files), random) || !readResponse(fd, buffer, status, body))
+        {
+            std::cerr << "Client " << index << ": connection closed on upload " << i << std::endl;
+            errors++;
+            break;
+        }
+
+        if(status != 200 || body.find("\"success\"") == std::string::npos)
+        {
+            std::cerr << "Client " << index << ": upload " << i << " failed with " << status << ": " << body << std::endl;
+            errors++;
+            continue;
+        }
+
+        expected.insert(expected.end(), files.begin(), files.end());
+    }
+
+    close(fd);
+}
+
+//Одна загрузка по новому соединению. true - сервер ответил успехом
+bool upload(unsigned short port, const std::string& request, std::mt19937& random, std::string& body)
+{
+    int fd = connectTo(port);
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    std::string buffer;
+    int status = 0;
+
+    bool answered = sendAll(fd, request, random) && readResponse(fd, buffer, status, body);
+    close(fd);
+
+    return answered && status == 200 && body.find("\"success\"") != std::string::npos;
+}
+
+//Отправляет половину запроса и обрывает соединение
+void uploadAndDisconnect(unsigned short port, const std::string& request, std::mt19937& random)
+{
+    int fd = connectTo(port);
+    if(fd < 0)
+    {
+        return;
+    }
+
+    sendAll(fd, request.substr(0, request.size() / 2), random);
+
+    //Даём серверу начать запись файла до обрыва
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    close(fd);
+}
+
+//Клиент, чьи неудачные загрузки не должны испортить сохранённый ранее файл. Сохранённый файл попадает в expected,
+//имя файла, который ни разу не был загружен целиком, - в missing
+void runFailingClient(size_t index, unsigned short port, size_t attempts, std::vector<ExpectedFile>& expected,
+                      std::vector<std::string>& missing, std::atomic<size_t>& errors)
+{
+    std::mt19937 random(static_cast<uint32_t>(index) * 104729 + 7);
+
+    ExpectedFile good = {"failing_" + std::to_string(index) + ".bin", fileContent(random, 128 * 1024 + random() % 4096)};
+    std::string body;
+
+    if(!upload(port, makeRequest({good}), random, body))
+    {
+        std::cerr << "Failing client " << index << ": first upload failed: " << body << std::endl;
+        errors++;
+        return;
+    }
+
+    expected.push_back(good);
+
+    std::string neverSaved = "aborted_" + std::to_string(index) + ".bin";
+    missing.push_back(neverSaved);
+
+    for(size_t i = 0; i < attempts; i++)
+    {
+        ExpectedFile broken = {good.name, fileContent(random, 128 * 1024 + random() % 4096)};
+
+        uploadAndDisconnect(port, makeRequest({broken}), random);
+        uploadAndDisconnect(port, makeRequest({{neverSaved, broken.content}}), random);
+
+        if(upload(port, makeRequest({broken}, false), random, body))
+        {
+            std::cerr << "Failing client " << index << ": body without closing boundary was accepted" << std::endl;
+            errors++;
+        }
+    }
+}
+
+//Есть ли в каталоге временные файлы загрузок. Оборванные загрузки удаляют их в дисковых потоках уже после обрыва
+bool hasTempFiles(const std::string& dir)
+{
+    bool found = false;
+
+    if(DIR* handle = opendir(dir.c_str()))
+    {
+        while(dirent* entry = readdir(handle))
+        {
+            std::string name = entry->d_name;
+            found = found || (name.size() > 5 && name.compare(name.size() - 5, 5, ".part") == 0);
+        }
+
+        closedir(handle);
+    }
+
+    return found;
+}
+
+//Удаляет каталог индекса вместе с файлами
+void removeIndex(const std::string& dir)
+{
+    std::string indexDir = dir + "/.index";
+
+    if(DIR* handle = opendir(indexDir.c_str()))
+    {
+        while(dirent* entry = readdir(handle))
+        {
+            std::remove((indexDir + "/" + entry->d_name).c_str());
+        }
+
+        closedir(handle);
+    }
+
+    rmdir(indexDir.c_str());
+}
+
+int main(int argc, char* argv[])
+{
+    size_t clients = argc > 1 ? std::stoul(argv[1]) : 32;
+    size_t uploads = argc > 2 ? std::stoul(argv[2]) : 20;
+    size_t serverThreads = argc > 3 ? std::stoul(argv[3]) : std::max(4u, std::thread::hardware_concurrency());
+
+    char dirTemplate[] = "/tmp/upload_concurrency_XXXXXX";
+    if(!mkdtemp(dirTemplate))
+    {
+        std::cerr << "Cannot create temporary directory" << std::endl;
+        return 1;
+    }
+
+    std::string dir = dirTemplate;
+
+    auto logger = std::make_shared<spdlog::logger>("UploadConcurrencyTest");
+
+    auto uploadIndex = std::make_shared<UploadIndex>(dir, logger);
+    uploadIndex->load();
+
+    //Небольшие окно и буферы, чтобы границы частей чаще попадали на стыки порций
+    auto fileSaverPool = std::make_shared<FileSaverPool>(dir, 16 * 1024, FileWriter::Pwritev, logger, clients);
+    auto diskWriteStage = std::make_shared<DiskWriteStage>(2, 64, 16 * 1024);
+    fileSaverPool->setDiskWriteStage(diskWriteStage, 4 * 16 * 1024);
+    fileSaverPool->setUploadIndex(uploadIndex);
+
+    HttpServer server;
+    server.config.address = "127.0.0.1";
+    server.config.port = 0;
+    server.streamBufferSize = 8 * 1024;
+
+    server.streamResource["^/upload$"]["POST"] = [fileSaverPool](std::shared_ptr<HttpServer::Request> request)
+                                                 {
+                                                     return std::make_shared<UploadHandler>(fileSaverPool->acquire(), request);
+                                                 };
+
+    //Порт выбирает система, потоки сервера запускаем сами
+    server.io_service = std::make_shared<SimpleWeb::io_context>();
+    unsigned short port = server.bindShared();
+    server.accept_and_run();
+
+    std::vector<std::thread> serverPool;
+    for(size_t i = 0; i < serverThreads; i++)
+    {
+        serverPool.emplace_back([&server]() { server.io_service->run(); });
+    }
+
+    size_t failingClients = std::max<size_t>(1, clients / 4);
+
+    std::vector<std::vector<ExpectedFile>> expected(clients + failingClients);
+    std::vector<std::vector<std::string>> missing(failingClients);
+    std::atomic<size_t> errors(0);
+    std::vector<std::thread> clientThreads;
+
+    for(size_t i = 0; i < clients; i++)
+    {
+        clientThreads.emplace_back([i, port, uploads, &expected, &errors]() { runClient(i, port, uploads, expected[i], errors); });
+    }
+
+    for(size_t i = 0; i < failingClients; i++)
+    {
+        clientThreads.emplace_back([i, port, uploads, clients, &expected, &missing, &errors]()
+                                   {
+                                       runFailingClient(i, port, std::max<size_t>(1, uploads / 4), expected[clients + i], missing[i], errors);
+                                   });
+    }
+
+    for(std::thread& thread : clientThreads)
+    {
+        thread.join();
+    }
+
+    for(int attempt = 0; attempt < 500 && hasTempFiles(dir); attempt++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    //io_service задан снаружи, stop его не останавливает
+    server.stop();
+    server.io_service->stop();
+
+    for(std::thread& thread : serverPool)
+    {
+        thread.join();
+    }
+
+    //Ответ отправляется после записи файлов, поэтому все файлы уже на своих местах
+    size_t checked = 0;
+    size_t mismatched = 0;
+
+    for(const std::vector<ExpectedFile>& files : expected)
+    {
+        for(const ExpectedFile& file : files)
+        {
+            std::string path = dir + "/" + file.name;
+
+            if(readFile(path) != file.content)
+            {
+                std::cerr << "File " << file.name << " differs from the uploaded content" << std::endl;
+                mismatched++;
+            }
+
+            UploadIndex::Entry entry;
+            if(!uploadIndex->find(file.name, entry) || entry.size != file.content.size())
+            {
+                std::cerr << "Index entry of " << file.name << " does not match the saved file" << std::endl;
+                mismatched++;
+            }
+
+            std::remove(path.c_str());
+            checked++;
+        }
+    }
+
+    //Ни одна неудачная загрузка не должна попасть в индекс
+    for(const std::vector<std::string>& names : missing)
+    {
+        for(const std::string& name : names)
+        {
+            UploadIndex::Entry entry;
+            if(uploadIndex->find(name, entry))
+            {
+                std::cerr << "Failed upload " << name << " was added to the index" << std::endl;
+                mismatched++;
+            }
+        }
+    }
+
+    uploadIndex.reset();
+    removeIndex(dir);
+
+    //Кроме проверенных файлов в каталоге ничего не должно остаться: ни временных, ни чужих
+    size_t leftovers = 0;
+
+    if(DIR* handle = opendir(dir.c_str()))
+    {
+        while(dirent* entry = readdir(handle))
+        {
+            std::string name = entry->d_name;
+            if(name == "." || name == "..")
+            {
+                continue;
+            }
+
+            std::cerr << "Unexpected file left in upload directory: " << name << std::endl;
+            std::remove((dir + "/" + name).c_str());
+            leftovers++;
+        }
+
+        closedir(handle);
+    }
+
+    rmdir(dir.c_str());
+
+    std::cout << clients << " clients x " << uploads << " uploads, " << serverThreads << " server threads: "
+              << checked << " files checked, " << mismatched << " mismatched, "
+              << errors.load() << " failed requests, " << leftovers << " leftover files" << std::endl;
+
+    return (errors == 0 && mismatched == 0 && leftovers == 0 && checked > 0) ? 0 : 1;
+}